@@ -14,6 +14,36 @@ typedef struct arguments_t
     char* input;        // input system
     char* output;       // output system
     char* filename;     // filename for argument -f
+    char* integrator;   // integrator of equations of motion
+    nb_float block_eta; // accuracy parameter of block time steps
+    nb_float tolerance; // tolerance of adaptive steps
+    char* simd;         // instruction set of force kernel
+    char* kernel;       // kernel of the calculation of forces
+    bool rsqrt;         // inverse distances by reciprocal square root
+    char* schedule;     // schedule of rows of the force loop
+    bool pin;           // pin threads to physical cores
+    size_t tile_i;      // count of bodies "i" in tile of direct kernel
+    size_t tile_j;      // count of bodies "j" in tile of direct kernel
+    char* engine;       // engine of the calculation of forces
+    nb_float theta;     // opening angle of Barnes-Hut and FMM engines
+    bool quadrupole;    // use quadrupole moments in Barnes-Hut engine
+    size_t fmm_order;   // order of expansions of FMM engine
+    size_t pm_grid;     // count of cells of particle-mesh along axis
+    char* pm_scheme;    // assignment scheme of particle-mesh
+    bool pm_periodic;   // periodic boundaries of particle-mesh
+    nb_float skin;      // skin of lists of neighbours
+    bool ensemble;      // model an ensemble of systems
+    size_t variations;  // count of variations of input system in ensemble
+    nb_float spread;    // relative spread of variations
+    char* trajectory;   // file of snapshots of run
+    size_t every;       // count of steps between snapshots
+    char* format;       // format of output files
+    bool convert;       // convert input file to output without run
+    char* compress;     // mode of trajectory file
+    nb_float max_error; // bound of error of lossy trajectory
+    size_t chunk;       // count of frames of chunk of trajectory
+    nb_float at;        // time of frame of input trajectory (NaN - none)
+    char* bodies;       // indices of bodies of frame
 } arguments_t;
 
 
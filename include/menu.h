@@ -6,6 +6,8 @@
 
 #include "nb_system.h"
 #include "nb_rand.h"
+#include "nb_format.h"
+#include "nb_trajectory.h"
 
 
 #define NB_MAX_BODIES 65536
@@ -16,6 +18,11 @@ typedef struct menu_run_t
 {
     bool seq: 1;
     bool openmp: 1;
+    const char* trajectory;  // file of snapshots (NULL - without them)
+    size_t every;            // count of steps between snapshots
+    nb_trajectory_mode mode; // mode of trajectory file
+    nb_float max_error;      // bound of error of lossy mode
+    size_t chunk;            // count of frames of chunk of trajectory
 } menu_run_t;
 
 
@@ -28,8 +35,10 @@ void menu_rand(nb_system *const system, nb_uint count,
 void menu_run_system(nb_system *const system, nb_float end_time,
     nb_float dt, menu_run_t run);
 bool menu_load_system(nb_system *const system, const char *const filename);
+bool menu_load_frame(nb_system *const system, const char *const filename,
+    nb_float time, const char *const bodies);
 bool menu_save_system(const nb_system *const system,
-    const char *const filename);
+    const char *const filename, nb_format format);
 bool menu_print_system(const nb_system *const system, FILE* stream);
 
 
@@ -0,0 +1,22 @@
+#ifndef NB_ADAPTIVE_H
+#define NB_ADAPTIVE_H
+
+
+#include "nb_system.h"
+
+
+// Counts of steps of adaptive run
+typedef struct nb_adaptive_stats
+{
+    size_t accepted;    // accepted steps
+    size_t rejected;    // steps repeated with a smaller step
+    nb_float dt_min;    // smallest and largest accepted steps
+    nb_float dt_max;
+} nb_adaptive_stats;
+
+
+bool nb_adaptive_run(nb_system *const system, nb_float end_time,
+    nb_float dt, bool parallel, nb_adaptive_stats *const stats);
+
+
+#endif
@@ -0,0 +1,27 @@
+#ifndef NB_BALANCE_H
+#define NB_BALANCE_H
+
+
+#include "nb_calculation.h"
+
+
+// Measured times of rows of the force loop and busy times of threads
+typedef struct nb_balance
+{
+    size_t count;       // count of rows
+    size_t threads;     // count of threads, for which busy times are kept
+    double* cost[2];    // times of rows at even and odd balanced passes
+    double* busy;       // busy times of threads since the start of run
+    size_t passes;      // count of balanced passes
+} nb_balance;
+
+
+nb_balance* nb_balance_get(nb_system *const system);
+void nb_balance_reset(nb_system *const system);
+void nb_balance_range(const nb_balance *const balance, size_t pass,
+    bool is_triangular, size_t thread, size_t threads, size_t *const begin,
+    size_t *const end);
+void nb_balance_destroy(nb_system *const system);
+
+
+#endif
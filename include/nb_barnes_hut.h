@@ -0,0 +1,11 @@
+#ifndef NB_BARNES_HUT_H
+#define NB_BARNES_HUT_H
+
+
+#include "nb_calculation.h"
+
+
+bool nb_barnes_hut_forces(nb_system *const system, bool parallel);
+
+
+#endif
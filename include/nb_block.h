@@ -0,0 +1,20 @@
+#ifndef NB_BLOCK_H
+#define NB_BLOCK_H
+
+
+#include "nb_calculation.h"
+
+
+// count of levels of block time steps: the smallest step of body is the
+// step of run divided by 2^NB_BLOCK_LEVELS
+#define NB_BLOCK_LEVELS 30
+
+
+void nb_block_init(nb_system *const system);
+bool nb_block_step(nb_system *const system, nb_float dt, bool parallel);
+bool nb_block_stats(const nb_system *const system, size_t *const blocks,
+    size_t *const updates);
+void nb_block_destroy(nb_system *const system);
+
+
+#endif
@@ -5,8 +5,153 @@
 #include "nb_system.h"
 
 
+// square root with precision of "nb_float" numbers
+#if NB_FLOAT_PRECISION == 1
+#define NB_SQRT(x) sqrtf(x)
+#elif NB_FLOAT_PRECISION == 2
+#define NB_SQRT(x) sqrt(x)
+#elif NB_FLOAT_PRECISION == 4
+#define NB_SQRT(x) sqrtl(x)
+#endif
+
+
+// maximum count of bodies "i" in the tile of direct kernel
+#define NB_TILE_MAX 1024
+// default sizes of tiles, so that the tile of bodies "j" fits into L1 cache
+#define NB_TILE_I_DEFAULT 64
+#define NB_TILE_J_DEFAULT 512
+
+// maximum and default orders of expansions of fast multipole method
+#define NB_FMM_ORDER_MAX 16
+#define NB_FMM_ORDER_DEFAULT 6
+
+// size of chunk of rows of the dynamic schedule
+#define NB_SCHEDULE_CHUNK 16
+
+// default accuracy parameter of block time steps
+#define NB_BLOCK_ETA_DEFAULT 0.02
+
+// minimum, maximum and default counts of cells of particle-mesh along axis
+#define NB_PM_GRID_MIN 16
+#define NB_PM_GRID_MAX 8192
+#define NB_PM_GRID_DEFAULT 256
+
+
+// Instruction sets, which can be used by the vectorized kernels
+typedef enum nb_simd_level
+{
+    NB_SIMD_NONE,    // scalar kernel
+    NB_SIMD_SSE2,
+    NB_SIMD_AVX2,
+    NB_SIMD_AVX512
+} nb_simd_level;
+
+// Kernels of the all-pairs calculation of forces
+typedef enum nb_kernel
+{
+    NB_KERNEL_DIRECT,     // each pair is visited twice, for both bodies
+    NB_KERNEL_SYMMETRIC   // each pair is visited once (Newton's third law)
+} nb_kernel;
+
+// Schedules of rows of the force loop between threads
+typedef enum nb_schedule
+{
+    NB_SCHEDULE_STATIC,    // equal counts of rows
+    NB_SCHEDULE_GUIDED,    // chunks decreasing from rows / threads
+    NB_SCHEDULE_DYNAMIC,   // small chunks taken by free threads
+    NB_SCHEDULE_BALANCED   // equal times of rows of the previous step
+} nb_schedule;
+
+// Engines of the calculation of forces
+typedef enum nb_engine
+{
+    NB_ENGINE_DIRECT,      // all-pairs calculation by the chosen kernel
+    NB_ENGINE_BARNES_HUT,  // approximation by quadtree of Barnes-Hut
+    NB_ENGINE_FMM,         // fast multipole method
+    NB_ENGINE_PM           // particle-mesh with FFT
+} nb_engine;
+
+// Integrators of equations of motion
+typedef enum nb_integrator
+{
+    NB_INTEGRATOR_EULER,        // new coordinates by averaged speed
+    NB_INTEGRATOR_LEAPFROG,     // kick-drift-kick leapfrog (second order)
+    NB_INTEGRATOR_FOREST_RUTH,  // Forest-Ruth (Yoshida, fourth order)
+    NB_INTEGRATOR_YOSHIDA6,     // Yoshida, solution A (sixth order)
+    NB_INTEGRATOR_PEFRL,        // position extended Forest-Ruth like
+                                // (Omelyan, Mryglod and Folk, fourth order)
+    NB_INTEGRATOR_HERMITE,      // Hermite predictor-corrector by forces and
+                                // jerks (fourth order)
+    NB_INTEGRATOR_BLOCK         // individual block time steps of Hermite
+                                // scheme (fourth order)
+} nb_integrator;
+
+// Schemes of assignment of masses to nodes of particle-mesh
+typedef enum nb_pm_scheme
+{
+    NB_PM_CIC,   // cloud in cell (4 nearest nodes)
+    NB_PM_TSC    // triangular shaped cloud (9 nearest nodes)
+} nb_pm_scheme;
+
+// Settings of calculation, which are common for all runs of system
+typedef struct nb_calc_settings
+{
+    nb_integrator integrator;  // integrator of equations of motion
+    nb_float block_eta;  // accuracy parameter of block time steps
+    nb_float tolerance;  // tolerance of adaptive steps (0 - fixed steps)
+    nb_engine engine;    // engine of the calculation of forces
+    nb_simd_level simd;  // instruction set of force kernel
+    nb_kernel kernel;    // kernel of the calculation of forces
+    bool rsqrt;          // inverse distances by reciprocal square root
+    nb_schedule schedule;  // schedule of rows of the force loop
+    size_t tile_i;       // count of bodies "i" in tile (0 - without tiles)
+    size_t tile_j;       // count of bodies "j" in tile
+    nb_float theta;      // opening angle of Barnes-Hut and FMM engines
+    bool quadrupole;     // use quadrupole moments in Barnes-Hut engine
+    size_t fmm_order;    // order of expansions of FMM engine
+    size_t pm_grid;      // count of cells of particle-mesh along axis
+    nb_pm_scheme pm_scheme;  // assignment scheme of particle-mesh
+    bool pm_periodic;    // periodic boundaries of particle-mesh
+    nb_float skin;       // skin of lists of neighbours of Barnes-Hut, FMM
+                         // and PM engines (0 - without lists)
+} nb_calc_settings;
+
+// Partial sums of interactions of body "i" with a range of bodies "j"
+typedef struct nb_row_acc
+{
+    nb_float fx, fy;             // total force acting on body "i"
+    nb_float t_mass;             // total mass of collided bodies
+    nb_float t_impulse_x;        // total impulse of collided bodies
+    nb_float t_impulse_y;
+    bool is_collided;            // did body "i" collide with anyone body
+} nb_row_acc;
+
+
+extern const nb_float gravity_const;
+extern nb_calc_settings calc_settings;
+
+
+const char* nb_integrator_name(nb_integrator integrator);
+bool nb_integrator_parse(const char *const name,
+    nb_integrator *const integrator);
+const char* nb_engine_name(nb_engine engine);
+bool nb_engine_parse(const char *const name, nb_engine *const engine);
+const char* nb_kernel_name(nb_kernel kernel);
+bool nb_kernel_parse(const char *const name, nb_kernel *const kernel);
+const char* nb_schedule_name(nb_schedule schedule);
+bool nb_schedule_parse(const char *const name, nb_schedule *const schedule);
+void nb_schedule_apply();
+const char* nb_pm_scheme_name(nb_pm_scheme scheme);
+bool nb_pm_scheme_parse(const char *const name, nb_pm_scheme *const scheme);
+void nb_calc_set_row(nb_system *const system, size_t i,
+    const nb_row_acc *const acc);
+void nb_calc_move(nb_system *const system, size_t i, nb_float dt);
+void nb_calc_forces(nb_system *const system, bool parallel);
+void nb_calc_pairs_destroy(nb_system *const system);
 void nb_euler_singlethread(nb_system *const system, nb_float dt);
 void nb_euler_multithreading(nb_system *const system, nb_float dt);
+bool nb_euler_run(nb_system *const system, size_t steps, nb_float dt,
+    bool parallel);
 
 
 #endif
@@ -0,0 +1,15 @@
+#ifndef NB_COLLISION_H
+#define NB_COLLISION_H
+
+
+#include "nb_calculation.h"
+
+
+bool nb_collision_pass(const nb_system *const system, nb_row_acc *const accs,
+    bool parallel);
+bool nb_collision_neighbours(const nb_system *const system, nb_float skin,
+    size_t *const first, size_t **const bodies, size_t *const capacity,
+    bool parallel);
+
+
+#endif
@@ -0,0 +1,29 @@
+#ifndef NB_ENSEMBLE_H
+#define NB_ENSEMBLE_H
+
+
+#include "nb_calculation.h"
+#include "nb_format.h"
+
+
+// Many independent systems, which are modeled at once. The systems are
+// read from files or they are variations of one system.
+typedef struct nb_ensemble
+{
+    char** inputs;      // paths of input systems (one path for variations)
+    size_t count;       // count of systems
+    size_t variations;  // count of variations of input system (0 - files)
+    nb_float spread;    // relative spread of coordinates and speeds
+    const char* output; // directory of output systems
+    nb_format format;   // format of output systems
+} nb_ensemble;
+
+
+bool nb_ensemble_init(nb_ensemble *const ensemble, const char *const input,
+    const char *const output, size_t variations, nb_float spread);
+size_t nb_ensemble_run(const nb_ensemble *const ensemble,
+    nb_float end_time, nb_float dt, bool parallel);
+void nb_ensemble_destroy(nb_ensemble *const ensemble);
+
+
+#endif
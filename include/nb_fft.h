@@ -0,0 +1,12 @@
+#ifndef NB_FFT_H
+#define NB_FFT_H
+
+
+#include "nb_types.h"
+
+
+bool nb_fft_2d(nb_float *const re, nb_float *const im, size_t n,
+    bool inverse, bool parallel);
+
+
+#endif
@@ -0,0 +1,11 @@
+#ifndef NB_FMM_H
+#define NB_FMM_H
+
+
+#include "nb_calculation.h"
+
+
+bool nb_fmm_forces(nb_system *const system, bool parallel);
+
+
+#endif
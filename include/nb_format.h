@@ -0,0 +1,37 @@
+#ifndef NB_FORMAT_H
+#define NB_FORMAT_H
+
+
+#include <stdio.h>
+
+#include "nb_system.h"
+
+
+// version of the columnar format
+#define NB_FORMAT_VERSION 2
+// size of magic at the start of files of columnar format
+#define NB_FORMAT_MAGIC_SIZE 8
+// alignment of header and columns in files of columnar format (bytes)
+#define NB_FORMAT_ALIGN 64
+
+
+// Formats of files of systems
+typedef enum nb_format
+{
+    NB_FORMAT_LEGACY,   // count, time and records of bodies
+    NB_FORMAT_V2,       // header, aligned columns and table of names
+    NB_FORMAT_V2_LEAN   // columnar format without forces
+} nb_format;
+
+
+const char* nb_format_name(nb_format format);
+bool nb_format_parse(const char *const name, nb_format *const format);
+bool nb_format_is_v2(FILE* stream);
+bool nb_format_read_v2(nb_system *const system, FILE* stream);
+bool nb_format_map_v2(nb_system *const system, const char *const filename);
+void nb_format_unmap(nb_system *const system);
+bool nb_format_write(const nb_system *const system, FILE* stream,
+    nb_format format);
+
+
+#endif
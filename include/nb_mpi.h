@@ -0,0 +1,16 @@
+#ifndef NB_MPI_H
+#define NB_MPI_H
+
+
+#include "nb_calculation.h"
+
+
+#ifdef NB_MPI
+int nb_mpi_rank();
+int nb_mpi_size();
+bool nb_mpi_run(nb_system *const system, size_t steps, nb_float dt,
+    bool parallel);
+#endif
+
+
+#endif
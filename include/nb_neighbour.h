@@ -0,0 +1,34 @@
+#ifndef NB_NEIGHBOUR_H
+#define NB_NEIGHBOUR_H
+
+
+#include "nb_calculation.h"
+
+
+// Verlet lists of neighbours of bodies for collision checks. A list holds
+// bodies within the sum of radii plus the skin, it stays valid until some
+// body moves more than half the skin from its place at the build.
+typedef struct nb_neighbour
+{
+    size_t count;       // count of bodies of lists
+    nb_float skin;      // skin of lists
+    bool is_valid;      // lists are built for the current bodies
+    size_t* first;      // first slot of list of each body (count + 1)
+    size_t* bodies;     // neighbours of bodies in order of indices
+    size_t capacity;    // capacity of "bodies"
+    nb_float* x;        // coordinates of bodies at the build of lists
+    nb_float* y;
+    size_t builds;      // count of builds since the start of run
+    size_t passes;      // count of collision passes since the start of run
+    size_t pairs;       // total size of lists of the last build
+    size_t max_list;    // largest list of the last build
+} nb_neighbour;
+
+
+bool nb_neighbour_pass(nb_system *const system, nb_row_acc *const accs,
+    bool parallel);
+void nb_neighbour_reset(nb_system *const system);
+void nb_neighbour_destroy(nb_system *const system);
+
+
+#endif
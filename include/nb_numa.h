@@ -0,0 +1,23 @@
+#ifndef NB_NUMA_H
+#define NB_NUMA_H
+
+
+#include "nb_types.h"
+
+
+// Processors, which are available to the program
+typedef struct nb_topology
+{
+    size_t cpus;       // logical processors
+    size_t cores;      // physical cores (SMT siblings share a core)
+    size_t packages;   // processor packages (sockets)
+    size_t nodes;      // NUMA nodes
+} nb_topology;
+
+
+bool nb_numa_topology(nb_topology *const topology);
+bool nb_numa_pin_threads();
+int nb_numa_thread_cpu(size_t thread);
+
+
+#endif
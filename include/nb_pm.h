@@ -0,0 +1,11 @@
+#ifndef NB_PM_H
+#define NB_PM_H
+
+
+#include "nb_calculation.h"
+
+
+bool nb_pm_forces(nb_system *const system, bool parallel);
+
+
+#endif
@@ -0,0 +1,44 @@
+#ifndef NB_QUADTREE_H
+#define NB_QUADTREE_H
+
+
+#include "nb_calculation.h"
+
+
+// maximum depth of tree (cells of coincident bodies are not divided deeper)
+#define NB_QUAD_DEPTH_MAX 64
+// size of stack of tree walk
+#define NB_QUAD_STACK_MAX (4 * NB_QUAD_DEPTH_MAX + 4)
+
+
+// Cell of quadtree. Children are always placed after their parent.
+typedef struct nb_quad_node
+{
+    nb_float x, y;            // center of cell
+    nb_float half;            // half of size of cell
+    nb_float mass;            // total mass of bodies in cell
+    nb_float mx, my;          // center of mass of bodies in cell
+    size_t first;             // index of the first body in permutation
+    size_t count;             // count of bodies in cell
+    size_t child[4];          // indices of children (0 - no child)
+    bool is_leaf;
+} nb_quad_node;
+
+// Quadtree of system
+typedef struct nb_quadtree
+{
+    nb_quad_node* nodes;
+    size_t count;             // count of nodes
+    size_t capacity;          // capacity of nodes array
+    size_t leaf_max;          // maximum count of bodies in leaf
+    size_t* perm;             // bodies ordered by cells of tree
+    size_t* _temp;            // buffer for partition of bodies by quadrants
+} nb_quadtree;
+
+
+bool nb_quadtree_build(nb_quadtree *const tree, const nb_system *const system,
+    size_t leaf_max);
+void nb_quadtree_destroy(nb_quadtree *const tree);
+
+
+#endif
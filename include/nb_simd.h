@@ -0,0 +1,16 @@
+#ifndef NB_SIMD_H
+#define NB_SIMD_H
+
+
+#include "nb_calculation.h"
+
+
+nb_simd_level nb_simd_detect();
+const char* nb_simd_name(nb_simd_level level);
+bool nb_simd_parse(const char *const name, nb_simd_level *const level);
+void nb_simd_row(nb_simd_level level, bool rsqrt,
+    const nb_system *const system, size_t i, size_t begin, size_t end,
+    nb_row_acc *const acc);
+
+
+#endif
@@ -0,0 +1,39 @@
+#ifndef NB_SNAPSHOT_H
+#define NB_SNAPSHOT_H
+
+
+#include "nb_system.h"
+#include "nb_trajectory.h"
+
+
+// count of copies of the state of system, which wait for the writer
+#define NB_SNAPSHOT_SLOTS 4
+
+
+// Writer of snapshots of system to a trajectory file by its own thread.
+// The snapshots are coded to frames of trajectory file by the writer.
+typedef struct nb_snapshot nb_snapshot;
+
+// Counts of snapshots of the run and the work of writer
+typedef struct nb_snapshot_stats
+{
+    size_t every;        // count of steps between snapshots
+    size_t written;      // count of written snapshots
+    size_t dropped;      // count of snapshots, which found no free slot
+    size_t bytes;        // count of written bytes
+    size_t raw_bytes;    // size of snapshots in the format of ".nb" files
+    double busy;         // busy time of writer (sec.)
+    bool is_failed;      // did writing to the file fail
+} nb_snapshot_stats;
+
+
+nb_snapshot* nb_snapshot_open(const char *const filename, size_t every,
+    nb_trajectory_mode mode, nb_float max_error, size_t chunk);
+size_t nb_snapshot_every(const nb_snapshot *const snapshot);
+bool nb_snapshot_put(nb_snapshot *const snapshot,
+    const nb_system *const system, size_t step, bool is_wait);
+void nb_snapshot_close(nb_snapshot *const snapshot,
+    nb_snapshot_stats *const stats);
+
+
+#endif
@@ -0,0 +1,12 @@
+#ifndef NB_SYMPLECTIC_H
+#define NB_SYMPLECTIC_H
+
+
+#include "nb_calculation.h"
+
+
+void nb_symplectic_init(nb_system *const system, bool parallel);
+void nb_symplectic_step(nb_system *const system, nb_float dt, bool parallel);
+
+
+#endif
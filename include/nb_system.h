@@ -7,10 +7,30 @@
 #include "nb_body.h"
 
 
+// writer of snapshots of system, see "nb_snapshot.h"
+struct nb_snapshot;
+
+
+// Body components are stored as separate contiguous arrays (structure of
+// arrays), so the calculation kernels only touch the data they really use.
+// All numeric arrays live in one memory block, the names are kept apart.
 typedef struct nb_system
 {
-    nb_body* bodies;
+    nb_float* cx;      // "x" coordinates
+    nb_float* cy;      // "y" coordinates
+    nb_float* sx;      // "x" component of speed
+    nb_float* sy;      // "y" component of speed
+    nb_float* fx;      // "x" component of force
+    nb_float* fy;      // "y" component of force
+    nb_float* mass;    // mass
+    nb_float* radius;  // radius
+    char (*names)[NB_NAME_MAX];  // names of bodies
     void* _calc_buf;  // buffer for new values of speed in calculation
+    void* _step_buf;  // individual times and steps of bodies
+    void* _balance_buf;  // times of rows of force loop and of threads
+    void* _neighbour_buf;  // lists of neighbours for collision checks
+    void* _pair_buf;  // accumulators of pairs of the symmetric kernel
+    void* _map_buf;  // mapping of file, which holds the columns
     size_t count;
     size_t capacity;
     nb_float time;
@@ -22,10 +42,23 @@ void nb_system_copy(nb_system *const system, const nb_system *const copy);
 const nb_system* nb_system_assign(nb_system *const system,
     const nb_system *const copy);
 void nb_system_destroy(nb_system *const system);
+void nb_system_reserve(nb_system *const system, size_t capacity);
+void nb_system_get_body(const nb_system *const system, size_t index,
+    nb_body *const body);
+void nb_system_set_body(nb_system *const system, size_t index,
+    const nb_body *const body);
 void nb_system_add_body(nb_system *const system, const nb_body *const body);
 void nb_system_remove_body(nb_system *const system, size_t index);
 void nb_system_clear(nb_system *const system);
+void nb_system_run_init(nb_system *const system, bool parallel);
 void nb_system_run(nb_system *const system, nb_float dt, bool parallel);
+size_t nb_system_steps(nb_float end_time, nb_float dt);
+void nb_system_run_steps(nb_system *const system, size_t steps,
+    nb_float dt, bool parallel);
+void nb_system_run_snapshots(nb_system *const system, size_t steps,
+    nb_float dt, bool parallel, struct nb_snapshot *const snapshot);
+void nb_system_run_for(nb_system *const system, nb_float end_time,
+    nb_float dt, bool parallel);
 bool nb_system_read(nb_system *const system, FILE* stream);
 bool nb_system_write(const nb_system *const system, FILE* stream);
 bool nb_system_print(const nb_system *const system, FILE* stream);
@@ -0,0 +1,89 @@
+#ifndef NB_TRAJECTORY_H
+#define NB_TRAJECTORY_H
+
+
+#include <stdio.h>
+
+#include "nb_system.h"
+
+
+// count of columns of frames: coordinates, speeds, masses and radii
+#define NB_TRAJECTORY_COLUMNS 6
+// default count of frames of chunk of compressed trajectory
+#define NB_TRAJECTORY_CHUNK 64
+
+
+// Modes of trajectory files
+typedef enum nb_trajectory_mode
+{
+    NB_TRAJECTORY_NONE,   // sequence of systems in the format of ".nb" files
+    NB_TRAJECTORY_XOR,    // lossless: values XOR predicted values
+    NB_TRAJECTORY_LOSSY   // coordinates and speeds quantized by the error
+} nb_trajectory_mode;
+
+// Entry of index of trajectory: a frame and the key frame, which starts
+// its decoding
+typedef struct nb_trajectory_entry
+{
+    nb_float time;            // time of system
+    size_t step;              // step of run
+    size_t offset;            // offset of frame in file
+    size_t key;               // index of key frame of the frame
+} nb_trajectory_entry;
+
+// Encoder or decoder of frames of trajectory file. Each frame is coded
+// against the values predicted by the last two frames, so the coder keeps
+// them. Frames go by chunks of "chunk" frames: the first frame of chunk
+// and the frames, which change the bodies, are key frames, they are coded
+// alone and hold the names. The index of frames is written after the last
+// one, so any frame is decoded from the key frame before it.
+typedef struct nb_trajectory
+{
+    FILE* file;               // trajectory file
+    nb_trajectory_mode mode;  // mode of file
+    nb_float max_error;       // bound of error of lossy mode
+    size_t chunk;             // count of frames of chunk
+    size_t count;             // count of bodies of the last frame
+    size_t order;             // count of frames since key frame (up to 2)
+    size_t capacity;          // count of bodies, which fit into "history"
+    nb_float* history;        // last two frames, columns of "capacity"
+    size_t last;              // index of the last frame in "history"
+    char* names;              // names of the last key frame one by one
+    size_t names_size;        // size of "names"
+    unsigned char* buffer;    // coded frame
+    size_t buffer_size;       // size of "buffer"
+    size_t frames;            // count of coded frames (index of the next)
+    size_t step;              // step of the last decoded frame
+    nb_trajectory_entry* index;  // entries of frames
+    size_t index_count;       // count of entries of "index"
+    size_t index_capacity;    // count of entries, which fit into "index"
+    long start;               // offset of the first frame in file
+    size_t raw_bytes;         // size of frames in the format of ".nb" files
+    size_t bytes;             // size of coded frames
+    bool is_end;              // the decoder has reached the end of file
+} nb_trajectory;
+
+
+const char* nb_trajectory_mode_name(nb_trajectory_mode mode);
+bool nb_trajectory_mode_parse(const char *const name,
+    nb_trajectory_mode *const mode);
+bool nb_trajectory_is_compressed(FILE* file);
+bool nb_trajectory_init_write(nb_trajectory *const trajectory, FILE* file,
+    nb_trajectory_mode mode, nb_float max_error, size_t chunk);
+bool nb_trajectory_init_read(nb_trajectory *const trajectory, FILE* file);
+bool nb_trajectory_write(nb_trajectory *const trajectory,
+    const nb_system *const system, size_t step);
+bool nb_trajectory_finish(nb_trajectory *const trajectory);
+bool nb_trajectory_read(nb_trajectory *const trajectory,
+    nb_system *const system);
+bool nb_trajectory_load_index(nb_trajectory *const trajectory);
+size_t nb_trajectory_find(const nb_trajectory *const trajectory,
+    nb_float time);
+bool nb_trajectory_read_frame(nb_trajectory *const trajectory,
+    size_t frame, nb_system *const system);
+bool nb_trajectory_select(nb_system *const system,
+    const char *const bodies);
+void nb_trajectory_destroy(nb_trajectory *const trajectory);
+
+
+#endif
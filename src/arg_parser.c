@@ -2,9 +2,13 @@
 
 #include <stdio.h>
 #include <stdlib.h>
+#include <stddef.h>
 #include <string.h>
+#include <math.h>
 #include <errno.h>
 
+#include "nb_trajectory.h"
+
 
 static bool _parse_single_dash_args(size_t argc, char** argv, 
     arguments_t *const args, size_t* const num);
@@ -12,12 +16,80 @@ static bool _parse_double_dash_args(size_t argc, char** argv,
     arguments_t *const args, size_t* const num);
 
 
+// Type of value of the parameter, which is set by double dash argument
+typedef enum _param_type
+{
+    _PARAM_FLAG,    // parameter without value
+    _PARAM_FLOAT,   // "nb_float" value
+    _PARAM_SIZE,    // "size_t" value
+    _PARAM_STRING   // string value
+} _param_type;
+
+// Description of the parameter, which is set by double dash argument
+typedef struct _param_t
+{
+    const char* name;    // name of parameter without dashes
+    _param_type type;    // type of value of parameter
+    size_t offset;       // offset of value field in "arguments_t"
+} _param_t;
+
+
+static const _param_t _params[] =
+{
+    {"help", _PARAM_FLAG, offsetof(arguments_t, h)},
+    {"time", _PARAM_FLOAT, offsetof(arguments_t, time)},
+    {"delta", _PARAM_FLOAT, offsetof(arguments_t, delta)},
+    {"file", _PARAM_STRING, offsetof(arguments_t, filename)},
+    {"integrator", _PARAM_STRING, offsetof(arguments_t, integrator)},
+    {"block-eta", _PARAM_FLOAT, offsetof(arguments_t, block_eta)},
+    {"tolerance", _PARAM_FLOAT, offsetof(arguments_t, tolerance)},
+    {"simd", _PARAM_STRING, offsetof(arguments_t, simd)},
+    {"kernel", _PARAM_STRING, offsetof(arguments_t, kernel)},
+    {"rsqrt", _PARAM_FLAG, offsetof(arguments_t, rsqrt)},
+    {"schedule", _PARAM_STRING, offsetof(arguments_t, schedule)},
+    {"pin", _PARAM_FLAG, offsetof(arguments_t, pin)},
+    {"tile-i", _PARAM_SIZE, offsetof(arguments_t, tile_i)},
+    {"tile-j", _PARAM_SIZE, offsetof(arguments_t, tile_j)},
+    {"engine", _PARAM_STRING, offsetof(arguments_t, engine)},
+    {"theta", _PARAM_FLOAT, offsetof(arguments_t, theta)},
+    {"quadrupole", _PARAM_FLAG, offsetof(arguments_t, quadrupole)},
+    {"fmm-order", _PARAM_SIZE, offsetof(arguments_t, fmm_order)},
+    {"pm-grid", _PARAM_SIZE, offsetof(arguments_t, pm_grid)},
+    {"pm-scheme", _PARAM_STRING, offsetof(arguments_t, pm_scheme)},
+    {"pm-periodic", _PARAM_FLAG, offsetof(arguments_t, pm_periodic)},
+    {"skin", _PARAM_FLOAT, offsetof(arguments_t, skin)},
+    {"ensemble", _PARAM_FLAG, offsetof(arguments_t, ensemble)},
+    {"variations", _PARAM_SIZE, offsetof(arguments_t, variations)},
+    {"spread", _PARAM_FLOAT, offsetof(arguments_t, spread)},
+    {"trajectory", _PARAM_STRING, offsetof(arguments_t, trajectory)},
+    {"every", _PARAM_SIZE, offsetof(arguments_t, every)},
+    {"format", _PARAM_STRING, offsetof(arguments_t, format)},
+    {"convert", _PARAM_FLAG, offsetof(arguments_t, convert)},
+    {"compress", _PARAM_STRING, offsetof(arguments_t, compress)},
+    {"max-error", _PARAM_FLOAT, offsetof(arguments_t, max_error)},
+    {"chunk", _PARAM_SIZE, offsetof(arguments_t, chunk)},
+    {"at", _PARAM_FLOAT, offsetof(arguments_t, at)},
+    {"bodies", _PARAM_STRING, offsetof(arguments_t, bodies)}
+};
+
 static arguments_t _default_args_settings = 
 {
     false, false,
     false, false,
     10.0, 0.1,
-    NULL, NULL, NULL, NULL
+    NULL, NULL, NULL, NULL,
+    NULL, 0.02, 0.0,
+    NULL, NULL, false, NULL, false,
+    0, 0,
+    NULL, 0.5, false,
+    0,
+    0, NULL, false,
+    0.0,
+    false, 0, 0.01,
+    NULL, 10,
+    NULL, false,
+    NULL, 1e-6,
+    NB_TRAJECTORY_CHUNK, NAN, NULL
 };
 
 
@@ -184,13 +256,41 @@ bool _parse_double_dash_args(size_t argc, char** argv, arguments_t *const args,
     size_t index = *num;
     char* arg = argv[index] + 2;
     char* sep = strchr(arg, '=');
+    size_t name_len = (sep != NULL) ? (size_t)(sep - arg) : strlen(arg);
+    const _param_t* param = NULL;
     char* add_arg;
-    char* temp;
 
-    // if argument is "help"
-    if (strcmp(arg, "help") == 0)
+    // Search the parameter by its name
+    for (size_t i = 0; i < sizeof(_params) / sizeof(_param_t); i++)
+    {
+        if (strlen(_params[i].name) == name_len &&
+            strncmp(arg, _params[i].name, name_len) == 0)
+        {
+            param = &_params[i];
+            break;
+        }
+    }
+
+    if (param == NULL)
+    {
+        printf("Failed parse: unknown parameter \"%s\".\n", arg);
+        return false;
+    }
+
+    void* field = (char*)args + param->offset;
+
+    // if parameter is flag without value
+    if (param->type == _PARAM_FLAG)
     {
-        args->h = true;
+        if (sep != NULL)
+        {
+            printf("Failed parse: parameter \"--%s\" must not have "
+                "a value.\n", param->name);
+            
+            return false;
+        }
+
+        *(bool*)field = true;
         return true;
     }
 
@@ -208,49 +308,20 @@ bool _parse_double_dash_args(size_t argc, char** argv, arguments_t *const args,
         *num = index;
     }
 
-    char flag;  // 't' - time, 'd' - delta, 'f' - file
-    char argname[10];
-
-    // if argument is "time"
-    if (sep != NULL && (strstr(arg, "time=") == arg) ||
-        sep == NULL && (strcmp(arg, "time") == 0))
-    {
-        flag = 't';
-        strncpy(argname, "--time", 10);
-    }
-    // if argument is "delta"
-    else if (sep != NULL && (strstr(arg, "delta=") == arg) ||
-        sep == NULL && (strcmp(arg, "delta") == 0))
-    {
-        flag = 'd';
-        strncpy(argname, "--delta", 10);
-    }
-    // if argument is "file"
-    else if (sep != NULL && (strstr(arg, "file=") == arg) ||
-        sep == NULL && (strcmp(arg, "file") == 0))
-    {
-        flag = 'f';
-        strncpy(argname, "--file", 10);
-    }
-    else
-    {
-        printf("Failed parse: unknown parameter \"%s\".\n", arg);
-        return false;
-    }
-
     if (add_arg == NULL)
     {
-        printf("Failed parse: value is not set for parameter \"%s\".\n", 
-            argname);
+        printf("Failed parse: value is not set for parameter \"--%s\".\n", 
+            param->name);
         
         return false;
     }
 
-    if (flag == 't' || flag == 'd')
+    if (param->type == _PARAM_FLOAT)
     {
         char* endptr = add_arg;
-        double value;
+        nb_float value;
         
+        errno = 0;
 #if NB_FLOAT_PRECISION == 1
         value = strtof(add_arg, &endptr);
 #elif NB_FLOAT_PRECISION == 2
@@ -261,28 +332,50 @@ bool _parse_double_dash_args(size_t argc, char** argv, arguments_t *const args,
 
         if (errno == ERANGE)
         {
-            printf("Failed parse: the value for parameter \"%s\" is "
-                "out of the allowed range.\n", argname);
+            printf("Failed parse: the value for parameter \"--%s\" is "
+                "out of the allowed range.\n", param->name);
             
             return false;
         }
-        else if (*endptr != '\0')
+        else if (*endptr != '\0' || endptr == add_arg)
         {
             printf("Failed parse: failed to conversion \"%s\" "
-                "to float value for parameter \"%s\".\n", add_arg, argname);
+                "to float value for parameter \"--%s\".\n", add_arg,
+                param->name);
             
             return false;
         }
         else
+            *(nb_float*)field = value;
+    }
+    else if (param->type == _PARAM_SIZE)
+    {
+        char* endptr = add_arg;
+        unsigned long long value;
+
+        errno = 0;
+        value = strtoull(add_arg, &endptr, 10);
+
+        if (errno == ERANGE || value > (size_t)-1)
         {
-            if (flag == 't')
-                args->time = value;
-            else
-                args->delta = value;
+            printf("Failed parse: the value for parameter \"--%s\" is "
+                "out of the allowed range.\n", param->name);
+            
+            return false;
         }
+        else if (*endptr != '\0' || endptr == add_arg || add_arg[0] == '-')
+        {
+            printf("Failed parse: failed to conversion \"%s\" "
+                "to unsigned integer value for parameter \"--%s\".\n",
+                add_arg, param->name);
+            
+            return false;
+        }
+        else
+            *(size_t*)field = (size_t)value;
     }
     else
-        args->filename = add_arg;
+        *(char**)field = add_arg;
     
     return true;
 }
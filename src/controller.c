@@ -2,25 +2,100 @@
 
 #include <stdio.h>
 #include <string.h>
+#include <math.h>
 #include <errno.h>
 
+#include <omp.h>
+
 #include "arg_parser.h"
 #include "menu.h"
+#include "nb_simd.h"
+#include "nb_numa.h"
+#include "nb_mpi.h"
+#include "nb_ensemble.h"
+#include "nb_format.h"
+#include "nb_trajectory.h"
+
+#ifdef NB_MPI
+#include <mpi.h>
+#endif
 
 
 static bool _print_manual(const char* progname);
 static bool _print_system(const nb_system *const system,
     arguments_t *const args, bool is_input_system);
 static void _print_nums_types_info();
+static bool _set_calc_settings(const arguments_t *const args);
+static void _print_calc_info();
+static void _print_collision_info();
+static void _print_threads_info();
+static int _run_ensemble(const arguments_t *const args, nb_format format);
+static int _convert(const arguments_t *const args, nb_format format);
+static int _convert_trajectory(const arguments_t *const args,
+    nb_trajectory_mode mode);
+static int _extract_frame(arguments_t *const args, nb_format format);
+#ifdef NB_MPI
+static int _run_mpi(arguments_t *const args, nb_format format);
+#endif
 
 
 int controller(int argc, char** argv) 
 {
     nb_system system;
     arguments_t args;
+    nb_format format = NB_FORMAT_LEGACY;
+    nb_trajectory_mode mode = NB_TRAJECTORY_NONE;
 
     if (!arg_parser((size_t)argc, argv, &args))
         return -1;
+
+    if (!_set_calc_settings(&args))
+        return -1;
+
+    if (args.format != NULL && !nb_format_parse(args.format, &format))
+    {
+        printf("Error: unknown format \"%s\".\n", args.format);
+        return -1;
+    }
+
+    if (args.compress != NULL && !nb_trajectory_mode_parse(args.compress,
+        &mode))
+    {
+        printf("Error: unknown mode of trajectory \"%s\".\n", args.compress);
+        return -1;
+    }
+
+    if (mode == NB_TRAJECTORY_LOSSY && !(args.max_error > 0.0))
+    {
+        printf("Error: bound of error of lossy trajectory must be greater "
+            "than zero.\n");
+        return -1;
+    }
+
+    if (args.chunk == 0)
+    {
+        printf("Error: count of frames of chunk must be greater than "
+            "zero.\n");
+        return -1;
+    }
+
+    if (args.bodies != NULL && isnan(args.at))
+    {
+        printf("Error: bodies are selected from a frame of trajectory only "
+            "(--at).\n");
+        return -1;
+    }
+
+    // threads are pinned before the first run, the memory of systems is
+    // touched by the pinned threads
+    if (args.pin && !nb_numa_pin_threads())
+        printf("Warning: failed to pin threads to physical cores.\n");
+
+#ifdef NB_MPI
+    // several processes share the bodies of one run
+    if (nb_mpi_size() > 1)
+        return _run_mpi(&args, format);
+#endif
     
     // if "help" flag is specified
     if (args.h)
@@ -28,6 +103,18 @@ int controller(int argc, char** argv)
         if (!_print_manual(args.progname))
             return -1;
     }
+    // if an ensemble of systems is modeled
+    else if (args.ensemble)
+        return _run_ensemble(&args, format);
+    // if the frame of the input trajectory is extracted
+    else if (!isnan(args.at))
+        return _extract_frame(&args, format);
+    // if the input trajectory is converted to the mode of output one
+    else if (args.convert && args.compress != NULL)
+        return _convert_trajectory(&args, mode);
+    // if the input file is converted to the format of output file
+    else if (args.convert)
+        return _convert(&args, format);
     // if the input file is specified, but the output file is not specified
     else if (args.input != NULL && args.output == NULL)
     {
@@ -62,6 +149,26 @@ int controller(int argc, char** argv)
 
         run.seq = args.s;
         run.openmp = args.m;
+        run.trajectory = args.trajectory;
+        run.every = args.every;
+        run.mode = mode;
+        run.max_error = args.max_error;
+        run.chunk = args.chunk;
+
+        if (args.trajectory != NULL && calc_settings.tolerance > 0.0)
+        {
+            printf("Error: trajectory is written by fixed steps only.\n");
+            nb_system_destroy(&system);
+            return -1;
+        }
+
+        if (args.every == 0)
+        {
+            printf("Error: count of steps between snapshots must be "
+                "greater than zero.\n");
+            nb_system_destroy(&system);
+            return -1;
+        }
         
         if (!menu_load_system(&system, args.input))
         {
@@ -70,6 +177,8 @@ int controller(int argc, char** argv)
         }
 
         _print_nums_types_info();
+        _print_calc_info();
+        _print_threads_info();
 
         if (!quiet)
             _print_system(&system, &args, true);
@@ -79,7 +188,7 @@ int controller(int argc, char** argv)
         if (!quiet)
             _print_system(&system, &args, false);
         
-        if (!menu_save_system(&system, args.output))
+        if (!menu_save_system(&system, args.output, format))
         {
             nb_system_destroy(&system);
             return -1;
@@ -97,6 +206,8 @@ int controller(int argc, char** argv)
         }
 
         _print_nums_types_info();
+        _print_calc_info();
+        _print_threads_info();
         menu_loop(&system);
         nb_system_destroy(&system);
     }
@@ -228,3 +339,588 @@ void _print_nums_types_info()
 
     printf("\tintegers in the %u-byte range;\n", NB_INT_SIZE);
 }
+
+bool _set_calc_settings(const arguments_t *const args)
+{
+    nb_simd_level max_simd = nb_simd_detect();
+
+    // By default the widest instruction set supported by host is used
+    calc_settings.simd = max_simd;
+
+    if (args->simd != NULL)
+    {
+        nb_simd_level simd;
+
+        if (!nb_simd_parse(args->simd, &simd))
+        {
+            printf("Error: unknown instruction set \"%s\".\n", args->simd);
+            return false;
+        }
+        else if (simd > max_simd)
+        {
+            printf("Error: instruction set \"%s\" is not supported by "
+                "this processor.\n", args->simd);
+            return false;
+        }
+
+        calc_settings.simd = simd;
+    }
+
+    if (args->integrator != NULL &&
+        !nb_integrator_parse(args->integrator, &calc_settings.integrator))
+    {
+        printf("Error: unknown integrator \"%s\".\n", args->integrator);
+        return false;
+    }
+
+    if (args->block_eta <= 0.0)
+    {
+        printf("Error: accuracy parameter of block time steps must be "
+            "greater than zero.\n");
+        return false;
+    }
+
+    calc_settings.block_eta = args->block_eta;
+
+    if (args->tolerance < 0.0)
+    {
+        printf("Error: tolerance of adaptive steps must not be "
+            "negative.\n");
+        return false;
+    }
+
+    calc_settings.tolerance = args->tolerance;
+
+    if (args->engine != NULL &&
+        !nb_engine_parse(args->engine, &calc_settings.engine))
+    {
+        printf("Error: unknown engine \"%s\".\n", args->engine);
+        return false;
+    }
+
+    if (args->theta <= 0.0)
+    {
+        printf("Error: opening angle must be greater than zero.\n");
+        return false;
+    }
+
+    // expansions of FMM engine do not converge for wider angles
+    if (calc_settings.engine == NB_ENGINE_FMM && args->theta >= 1.0)
+    {
+        printf("Error: opening angle of FMM engine must be less than 1.\n");
+        return false;
+    }
+
+    calc_settings.theta = args->theta;
+    calc_settings.quadrupole = args->quadrupole;
+
+    if (args->fmm_order != 0)
+    {
+        if (args->fmm_order > NB_FMM_ORDER_MAX)
+        {
+            printf("Error: order of expansions must not be greater "
+                "than %d.\n", NB_FMM_ORDER_MAX);
+            return false;
+        }
+
+        calc_settings.fmm_order = args->fmm_order;
+    }
+
+    if (args->pm_grid != 0)
+    {
+        // the count of cells must be a power of two for FFT
+        if (args->pm_grid < NB_PM_GRID_MIN || args->pm_grid > NB_PM_GRID_MAX ||
+            (args->pm_grid & (args->pm_grid - 1)) != 0)
+        {
+            printf("Error: count of cells of mesh must be a power of two "
+                "from %d to %d.\n", NB_PM_GRID_MIN, NB_PM_GRID_MAX);
+            return false;
+        }
+
+        calc_settings.pm_grid = args->pm_grid;
+    }
+
+    if (args->pm_scheme != NULL &&
+        !nb_pm_scheme_parse(args->pm_scheme, &calc_settings.pm_scheme))
+    {
+        printf("Error: unknown assignment scheme \"%s\".\n",
+            args->pm_scheme);
+        return false;
+    }
+
+    calc_settings.pm_periodic = args->pm_periodic;
+
+    if (args->skin < 0.0)
+    {
+        printf("Error: skin of lists of neighbours must not be "
+            "negative.\n");
+        return false;
+    }
+
+    calc_settings.skin = args->skin;
+
+    if (args->kernel != NULL &&
+        !nb_kernel_parse(args->kernel, &calc_settings.kernel))
+    {
+        printf("Error: unknown kernel \"%s\".\n", args->kernel);
+        return false;
+    }
+
+    calc_settings.rsqrt = args->rsqrt;
+
+    if (args->schedule != NULL &&
+        !nb_schedule_parse(args->schedule, &calc_settings.schedule))
+    {
+        printf("Error: unknown schedule \"%s\".\n", args->schedule);
+        return false;
+    }
+
+    // if one of sizes of tiles is set, then the other has default value
+    if (args->tile_i != 0 || args->tile_j != 0)
+    {
+        calc_settings.tile_i = (args->tile_i != 0) ? args->tile_i :
+            NB_TILE_I_DEFAULT;
+        calc_settings.tile_j = (args->tile_j != 0) ? args->tile_j :
+            NB_TILE_J_DEFAULT;
+
+        if (calc_settings.tile_i > NB_TILE_MAX)
+        {
+            printf("Error: count of bodies \"i\" in tile must not be "
+                "greater than %d.\n", NB_TILE_MAX);
+            return false;
+        }
+    }
+
+    return true;
+}
+
+void _print_calc_info()
+{
+    printf("To integrate equations of motion, \"%s\" scheme is used.\n",
+        nb_integrator_name(calc_settings.integrator));
+
+    if (calc_settings.tolerance > 0.0)
+    {
+        printf("Steps are adapted by step doubling with tolerance %lf.\n",
+            calc_settings.tolerance);
+    }
+
+    if (calc_settings.integrator == NB_INTEGRATOR_BLOCK)
+    {
+        printf("To calculate forces, the following are used:\n");
+        printf("\tall pairs of bodies of each block with accuracy "
+            "parameter %lf;\n", calc_settings.block_eta);
+        return;
+    }
+
+    if (calc_settings.integrator == NB_INTEGRATOR_HERMITE)
+    {
+        printf("To calculate forces and jerks, the following are used:\n");
+        printf("\tall pairs of bodies;\n");
+        return;
+    }
+
+    printf("To calculate forces, the following are used:\n");
+
+    if (calc_settings.engine == NB_ENGINE_BARNES_HUT)
+    {
+        printf("\tBarnes-Hut engine with opening angle %lf and %s "
+            "moments;\n", calc_settings.theta,
+            calc_settings.quadrupole ? "quadrupole" : "monopole");
+        _print_collision_info();
+        return;
+    }
+
+    if (calc_settings.engine == NB_ENGINE_FMM)
+    {
+        printf("\tfast multipole method with opening angle %lf and "
+            "expansions of order %lu;\n", calc_settings.theta,
+            calc_settings.fmm_order);
+        _print_collision_info();
+        return;
+    }
+
+    if (calc_settings.engine == NB_ENGINE_PM)
+    {
+        printf("\tparticle-mesh of %lu x %lu cells with \"%s\" scheme and "
+            "%s boundaries;\n", calc_settings.pm_grid, calc_settings.pm_grid,
+            nb_pm_scheme_name(calc_settings.pm_scheme),
+            calc_settings.pm_periodic ? "periodic" : "isolated");
+        _print_collision_info();
+        return;
+    }
+
+    printf("\t\"%s\" all-pairs kernel;\n",
+        nb_kernel_name(calc_settings.kernel));
+
+    if (calc_settings.kernel == NB_KERNEL_DIRECT &&
+        calc_settings.tile_i != 0)
+    {
+        printf("\ttiles of %lu bodies \"i\" by %lu bodies \"j\";\n",
+            calc_settings.tile_i, calc_settings.tile_j);
+    }
+
+    if (calc_settings.simd == NB_SIMD_NONE)
+        printf("\tscalar kernel;\n");
+    else
+        printf("\tvectorized kernel with \"%s\" instruction set;\n",
+            nb_simd_name(calc_settings.simd));
+
+    if (calc_settings.kernel == NB_KERNEL_DIRECT && calc_settings.rsqrt)
+        printf("\tinverse distances by reciprocal square root;\n");
+
+    printf("\t\"%s\" schedule of rows between threads;\n",
+        nb_schedule_name(calc_settings.schedule));
+}
+
+// Collisions of approximating engines are found apart from forces
+void _print_collision_info()
+{
+    if (calc_settings.skin > 0.0)
+    {
+        printf("\tlists of neighbours of collisions with skin %lf;\n",
+            calc_settings.skin);
+    }
+    else
+        printf("\tspatial hash of collisions at each step;\n");
+}
+
+void _print_threads_info()
+{
+    const size_t threads = (size_t)omp_get_max_threads();
+    nb_topology topology;
+
+    printf("To run in parallel mode, the following are used:\n");
+    printf("\tup to %lu threads of OpenMP;\n", threads);
+
+    if (nb_numa_topology(&topology))
+    {
+        printf("\t%lu logical processors in %lu physical cores, %lu "
+            "packages and %lu NUMA nodes;\n", topology.cpus,
+            topology.cores, topology.packages, topology.nodes);
+    }
+
+    if (nb_numa_thread_cpu(0) < 0)
+    {
+        printf("\tthreads, which are not pinned to processors;\n");
+        return;
+    }
+
+    printf("\tthreads pinned to processors");
+    for (size_t t = 0; t < threads && nb_numa_thread_cpu(t) >= 0; t++)
+        printf(" %d", nb_numa_thread_cpu(t));
+    printf(";\n");
+}
+
+// Model an ensemble of systems: the input is a directory of systems, a
+// list of files of systems or a system, which variations are modeled. The
+// output is a directory of systems.
+int _run_ensemble(const arguments_t *const args, nb_format format)
+{
+    nb_ensemble ensemble;
+    double start, finish;
+    size_t failed;
+
+    if (args->input == NULL || args->output == NULL)
+    {
+        printf("Error: input and output of ensemble must be specified.\n");
+        return -1;
+    }
+
+    if (args->trajectory != NULL)
+    {
+        printf("Error: trajectory is not written by ensembles.\n");
+        return -1;
+    }
+
+    if (args->spread < 0.0 || args->spread >= 1.0)
+    {
+        printf("Error: spread of variations must be from 0 to 1.\n");
+        return -1;
+    }
+
+    if (!nb_ensemble_init(&ensemble, args->input, args->output,
+        args->variations, args->spread))
+    {
+        printf("Error: failed to collect systems of ensemble from \"%s\" "
+            "to \"%s\".\n", args->input, args->output);
+        return -1;
+    }
+
+    ensemble.format = format;
+
+    _print_nums_types_info();
+    _print_calc_info();
+
+    if (args->variations != 0)
+    {
+        printf("The ensemble of %lu variations of system with spread %lf "
+            "is being modeled", ensemble.count, ensemble.spread);
+    }
+    else
+        printf("The ensemble of %lu systems is being modeled",
+            ensemble.count);
+
+    if (args->s && !args->m)
+        printf(" in sequential mode...\n");
+    else
+        printf(" by up to %d threads...\n", omp_get_max_threads());
+
+    start = omp_get_wtime();
+    failed = nb_ensemble_run(&ensemble, args->time, args->delta,
+        !args->s || args->m);
+    finish = omp_get_wtime();
+
+    printf("The simulation of the ensemble is completed: %lu systems are "
+        "modeled, %lu failed.\n", ensemble.count - failed, failed);
+    printf("Simulation time: %.3f sec.\n", finish - start);
+
+    nb_ensemble_destroy(&ensemble);
+    return (failed == 0) ? 0 : -1;
+}
+
+// Conversion of the input file to the output file of other format. The
+// system is not modeled, so the forces of file are kept as they are.
+int _convert(const arguments_t *const args, nb_format format)
+{
+    nb_system system;
+
+    if (args->input == NULL || args->output == NULL)
+    {
+        printf("Error: input and output files of conversion must be "
+            "specified.\n");
+        return -1;
+    }
+
+    nb_system_init_default(&system);
+    if (errno == ENOMEM)
+    {
+        printf("Critical error: failed to initializing system.\n");
+        return -1;
+    }
+
+    if (!menu_load_system(&system, args->input) ||
+        !menu_save_system(&system, args->output, format))
+    {
+        nb_system_destroy(&system);
+        return -1;
+    }
+
+    printf("The system of %lu bodies is converted to format \"%s\".\n",
+        system.count, nb_format_name(format));
+
+    nb_system_destroy(&system);
+    return 0;
+}
+
+// Conversion of the input trajectory of any mode to the output trajectory
+// of the mode. Frames are decoded and coded one by one.
+int _convert_trajectory(const arguments_t *const args,
+    nb_trajectory_mode mode)
+{
+    const double megabyte = 1024.0 * 1024.0;
+    nb_trajectory input, output;
+    nb_system system;
+    FILE* input_file;
+    FILE* output_file;
+    bool is_done;
+
+    if (args->input == NULL || args->output == NULL)
+    {
+        printf("Error: input and output files of conversion must be "
+            "specified.\n");
+        return -1;
+    }
+
+    input_file = fopen(args->input, "rb");
+    if (input_file == NULL)
+    {
+        printf("Error: failed to open file \"%s\".\n", args->input);
+        return -1;
+    }
+
+    output_file = fopen(args->output, "wb");
+    if (output_file == NULL)
+    {
+        printf("Error: failed to create file \"%s\".\n", args->output);
+        fclose(input_file);
+        return -1;
+    }
+
+    nb_system_init_default(&system);
+    if (errno == ENOMEM)
+    {
+        printf("Critical error: failed to initializing system.\n");
+        fclose(input_file);
+        fclose(output_file);
+        return -1;
+    }
+
+    is_done = nb_trajectory_init_write(&output, output_file, mode,
+        args->max_error, args->chunk);
+    is_done = nb_trajectory_init_read(&input, input_file) && is_done;
+
+    while (is_done && nb_trajectory_read(&input, &system))
+        is_done = nb_trajectory_write(&output, &system, input.step);
+
+    is_done = is_done && input.is_end && nb_trajectory_finish(&output);
+    is_done = (fclose(output_file) == 0) && is_done;
+    fclose(input_file);
+
+    if (is_done)
+    {
+        printf("The trajectory of %lu frames is converted to mode \"%s\": "
+            "%.3f MB, %.3f MB in \".nb\" format.\n", output.frames,
+            nb_trajectory_mode_name(mode), output.bytes / megabyte,
+            output.raw_bytes / megabyte);
+    }
+    else
+    {
+        printf("Error: failed to convert trajectory \"%s\" at frame %lu.\n",
+            args->input, input.frames);
+    }
+
+    nb_trajectory_destroy(&input);
+    nb_trajectory_destroy(&output);
+    nb_system_destroy(&system);
+    return is_done ? 0 : -1;
+}
+
+// Extraction of the frame of the input trajectory, which time is the
+// nearest one to "--at", to the output file of the format or to the screen
+int _extract_frame(arguments_t *const args, nb_format format)
+{
+    nb_system system;
+
+    if (args->input == NULL)
+    {
+        printf("Error: input trajectory must be specified.\n");
+        return -1;
+    }
+
+    nb_system_init_default(&system);
+    if (errno == ENOMEM)
+    {
+        printf("Critical error: failed to initializing system.\n");
+        return -1;
+    }
+
+    if (!menu_load_frame(&system, args->input, args->at, args->bodies) ||
+        (args->output != NULL &&
+        !menu_save_system(&system, args->output, format)) ||
+        (args->output == NULL && !_print_system(&system, args, true)))
+    {
+        nb_system_destroy(&system);
+        return -1;
+    }
+
+    nb_system_destroy(&system);
+    return 0;
+}
+
+#ifdef NB_MPI
+// Run of the system from the input file to the output file by several
+// processes of MPI. Files are read and written by rank 0, information is
+// printed by it too.
+int _run_mpi(arguments_t *const args, nb_format format)
+{
+    const int rank = nb_mpi_rank();
+    nb_system system;
+    int is_loaded = true;
+    double start, finish;
+    bool is_done;
+
+    if (args->h || args->input == NULL || args->output == NULL)
+    {
+        if (rank == 0)
+            printf("Error: several processes of MPI only run the system "
+                "from the input file to the output file.\n");
+        return -1;
+    }
+
+    if (calc_settings.integrator != NB_INTEGRATOR_EULER ||
+        calc_settings.tolerance > 0.0 ||
+        calc_settings.engine != NB_ENGINE_DIRECT ||
+        calc_settings.kernel != NB_KERNEL_DIRECT ||
+        calc_settings.tile_i != 0)
+    {
+        if (rank == 0)
+            printf("Error: several processes of MPI only support \"euler\" "
+                "scheme with fixed steps and \"direct\" kernel without "
+                "tiles.\n");
+        return -1;
+    }
+
+    nb_system_init_default(&system);
+    if (errno == ENOMEM)
+    {
+        printf("Critical error: failed to initializing system.\n");
+        return -1;
+    }
+
+    if (rank == 0)
+    {
+        is_loaded = menu_load_system(&system, args->input);
+
+        if (is_loaded)
+        {
+            _print_nums_types_info();
+            _print_calc_info();
+            _print_threads_info();
+
+            if (!args->q)
+                _print_system(&system, args, true);
+        }
+    }
+
+    MPI_Bcast(&is_loaded, 1, MPI_INT, 0, MPI_COMM_WORLD);
+    if (!is_loaded)
+    {
+        nb_system_destroy(&system);
+        return -1;
+    }
+
+    if (rank == 0)
+    {
+        printf("The system is being modeled by %d processes of MPI...\n",
+            nb_mpi_size());
+        if (!args->s)
+            printf("Up to %d threads are used by each process.\n",
+                omp_get_max_threads());
+    }
+
+    MPI_Barrier(MPI_COMM_WORLD);
+    start = MPI_Wtime();
+    is_done = nb_mpi_run(&system, nb_system_steps(args->time, args->delta),
+        args->delta, !args->s);
+    finish = MPI_Wtime();
+
+    if (rank != 0)
+    {
+        nb_system_destroy(&system);
+        return is_done ? 0 : -1;
+    }
+
+    if (!is_done)
+    {
+        printf("Error: there is not enough memory to model the system.\n");
+        nb_system_destroy(&system);
+        return -1;
+    }
+
+    printf("The simulation of the system is completed.\n");
+    printf("Simulation time: %.3f sec.\n", finish - start);
+
+    if (!args->q)
+        _print_system(&system, args, false);
+
+    if (!menu_save_system(&system, args->output, format))
+    {
+        nb_system_destroy(&system);
+        return -1;
+    }
+
+    nb_system_destroy(&system);
+    return 0;
+}
+#endif
@@ -1,8 +1,28 @@
 #include "controller.h"
 
+#ifdef NB_MPI
+#include <errno.h>
+
+#include <mpi.h>
+#endif
+
 
 int main(int argc, char** argv) 
 {
+#ifdef NB_MPI
+    int provided;
+
+    // only the master thread of each process calls MPI
+    MPI_Init_thread(&argc, &argv, MPI_THREAD_FUNNELED, &provided);
+    // the program checks "errno" after its calls, the library may leave it
+    errno = 0;
+#endif
+
     int status = controller(argc, argv);
+
+#ifdef NB_MPI
+    MPI_Finalize();
+#endif
+
     return status;
 }
@@ -9,12 +9,31 @@
 
 #include <omp.h>
 
+#include "nb_simd.h"
+#include "nb_block.h"
+#include "nb_adaptive.h"
+#include "nb_balance.h"
+#include "nb_neighbour.h"
+#include "nb_snapshot.h"
+
 
 static void _menu_print();
 static void _menu_settings_loop(nb_rand_settings *const settings);
 static void _menu_print_settings(const nb_rand_settings *const settings);
+static void _menu_calc_settings_loop(nb_calc_settings *const settings);
+static void _menu_print_calc_settings();
 static void _menu_compare_systems(const nb_system *const system1,
     const nb_system *const system2);
+static bool _menu_run_steps(nb_system *const system, nb_float end_time,
+    nb_float dt, bool parallel, nb_snapshot *const snapshot,
+    nb_adaptive_stats *const stats);
+static nb_snapshot* _menu_open_trajectory(menu_run_t run);
+static void _menu_close_trajectory(nb_snapshot *const snapshot,
+    double timework);
+static void _menu_print_run_stats(const nb_system *const system,
+    size_t num_iter, bool is_done, const nb_adaptive_stats *const stats);
+static void _menu_print_neighbour_stats(const nb_system *const system);
+static void _menu_print_busy_times(const nb_system *const system);
 static void _menu_add_body(nb_system *const system);
 static void _menu_remove_body(nb_system *const system);
 static nb_int _menu_input_int();
@@ -96,7 +115,8 @@ void menu_loop(nb_system *const system)
         {
             nb_float end_time, dt;
             nb_uint choose;
-            menu_run_t run = {false, false};
+            menu_run_t run = {false, false, NULL, 0, NB_TRAJECTORY_NONE,
+                0.0, 0};
 
             printf("Enter the end time of modeling:\n");
             while (true)
@@ -165,22 +185,57 @@ void menu_loop(nb_system *const system)
         case 6:
         {
             char filename[PATH_MAX];
+            FILE* file;
+            bool is_trajectory;
 
             printf("Enter the path to file with extension\".nb\":\n");
             _menu_input_str(filename, PATH_MAX);
 
-            menu_load_system(system, filename);
+            // frames of compressed trajectories are loaded by time
+            file = fopen(filename, "rb");
+            is_trajectory = file != NULL && nb_trajectory_is_compressed(file);
+            if (file != NULL)
+                fclose(file);
+
+            if (is_trajectory)
+            {
+                char bodies[PATH_MAX];
+                nb_float time;
+
+                printf("Enter the time of frame of trajectory:\n");
+                time = _menu_input_float();
+
+                printf("Enter the indices of bodies, e.g. \"0,5-9\" (empty "
+                    "for all bodies):\n");
+                _menu_input_str(bodies, PATH_MAX);
+
+                menu_load_frame(system, filename, time,
+                    (bodies[0] != '\0') ? bodies : NULL);
+            }
+            else
+                menu_load_system(system, filename);
 
             break;
         }
         case 7:
         {
             char filename[PATH_MAX];
+            char name[32];
+            nb_format format;
 
             printf("Enter the path to file with extension\".nb\":\n");
             _menu_input_str(filename, PATH_MAX);
 
-            menu_save_system(system, filename);
+            printf("Enter the format of file (legacy, v2, v2-lean):\n");
+            _menu_input_str(name, sizeof(name));
+
+            if (!nb_format_parse(name, &format))
+            {
+                printf("Error: unknown format \"%s\".\n", name);
+                break;
+            }
+
+            menu_save_system(system, filename, format);
 
             break;
         }
@@ -209,6 +264,11 @@ void menu_loop(nb_system *const system)
             break;
         }
         case 10:
+        {
+            _menu_calc_settings_loop(&calc_settings);
+            break;
+        }
+        case 11:
         {
             printf("Exiting the program...\n");
             is_exit = true;
@@ -285,36 +345,48 @@ void menu_run_system(nb_system *const system, nb_float end_time,
 {
     int max_threads = omp_get_max_threads();
     double timework;
-    size_t num_iter = end_time / dt;
+    size_t num_iter = nb_system_steps(end_time, dt);
+    nb_adaptive_stats stats;
+    nb_snapshot* snapshot;
+    bool is_done;
 
     if (run.seq && !run.openmp)
     {
         clock_t start, finish;
 
+        snapshot = _menu_open_trajectory(run);
         printf("The system is being modeled in sequential mode...\n");
 
         start = clock();
-        for (size_t i = 0; i < num_iter; i++)
-            nb_system_run(system, dt, false);
+        is_done = _menu_run_steps(system, end_time, dt, false, snapshot,
+            &stats);
         finish = clock();
         timework = (finish - start) / (double)CLOCKS_PER_SEC;
         printf("The simulation of the system is completed.\n");
         printf("Simulation time: %.3f sec.\n", timework);
+        _menu_print_run_stats(system, num_iter, is_done, &stats);
+        _menu_print_neighbour_stats(system);
+        _menu_close_trajectory(snapshot, timework);
     }
     else if (!run.seq && run.openmp)
     {
         double start, finish;
 
+        snapshot = _menu_open_trajectory(run);
         printf("The system is being modeled in parallel mode...\n");
         printf("Up to %d threads are used.\n", max_threads);
 
         start = omp_get_wtime();
-        for (size_t i = 0; i < num_iter; i++)
-            nb_system_run(system, dt, true);
+        is_done = _menu_run_steps(system, end_time, dt, true, snapshot,
+            &stats);
         finish = omp_get_wtime();
         timework = finish - start;
         printf("The simulation of the system is completed.\n");
         printf("Simulation time: %.3f sec.\n", timework);
+        _menu_print_run_stats(system, num_iter, is_done, &stats);
+        _menu_print_neighbour_stats(system);
+        _menu_print_busy_times(system);
+        _menu_close_trajectory(snapshot, timework);
     }
     else if (run.seq && run.openmp)
     {
@@ -331,31 +403,189 @@ void menu_run_system(nb_system *const system, nb_float end_time,
 
         printf("The system is being modeled in sequential mode...\n");
         seq_start = clock();
-        for (size_t i = 0; i < num_iter; i++)
-            nb_system_run(system, dt, false);
+        is_done = _menu_run_steps(system, end_time, dt, false, NULL,
+            &stats);
         seq_finish = clock();
         timework = (seq_finish - seq_start) / (double)CLOCKS_PER_SEC;
         printf("The simulation of the system is completed.\n");
         printf("Simulation time: %.3f sec.\n", timework);
+        _menu_print_run_stats(system, num_iter, is_done, &stats);
+        _menu_print_neighbour_stats(system);
         
+        // the trajectory is written by the parallel run
+        snapshot = _menu_open_trajectory(run);
         printf("The system is being modeled in parallel mode...\n");
         printf("Up to %d threads are used.\n", max_threads);
         par_start = omp_get_wtime();
-        for (size_t i = 0; i < num_iter; i++)
-            nb_system_run(&copy, dt, true);
+        is_done = _menu_run_steps(&copy, end_time, dt, true, snapshot,
+            &stats);
         par_finish = omp_get_wtime();
         timework = par_finish - par_start;
         printf("The simulation of the system is completed.\n");
         printf("Simulation time: %.3f sec.\n", timework);
+        _menu_print_run_stats(&copy, num_iter, is_done, &stats);
+        _menu_print_neighbour_stats(&copy);
+        _menu_print_busy_times(&copy);
+        _menu_close_trajectory(snapshot, timework);
 
         _menu_compare_systems(system, &copy);
+        nb_system_destroy(&copy);
+    }
+}
+
+// Run the system by "end_time / dt" fixed steps or by adaptive steps, if
+// the tolerance is set. Snapshots are put to "snapshot" by fixed steps
+// only. Returns false, if the adaptive run failed to allocate memory.
+bool _menu_run_steps(nb_system *const system, nb_float end_time,
+    nb_float dt, bool parallel, nb_snapshot *const snapshot,
+    nb_adaptive_stats *const stats)
+{
+    if (calc_settings.tolerance > 0.0)
+        return nb_adaptive_run(system, end_time, dt, parallel, stats);
+
+    nb_system_run_snapshots(system, nb_system_steps(end_time, dt), dt,
+        parallel, snapshot);
+    return true;
+}
+
+// Start the writer of snapshots of the run, if the trajectory file is set
+nb_snapshot* _menu_open_trajectory(menu_run_t run)
+{
+    nb_snapshot* snapshot;
+
+    if (run.trajectory == NULL)
+        return NULL;
+
+    snapshot = nb_snapshot_open(run.trajectory, run.every, run.mode,
+        run.max_error, run.chunk);
+    if (snapshot == NULL)
+    {
+        printf("Error: failed to create trajectory file \"%s\", the run "
+            "goes on without snapshots.\n", run.trajectory);
+    }
+
+    return snapshot;
+}
+
+// Wait for the writer and print the cadence of snapshots, the speed of
+// writing (by the busy time of writer and by the time of run) and the
+// ratio of compression
+void _menu_close_trajectory(nb_snapshot *const snapshot, double timework)
+{
+    const double megabyte = 1024.0 * 1024.0;
+    nb_snapshot_stats stats;
+
+    if (snapshot == NULL)
+        return;
+
+    nb_snapshot_close(snapshot, &stats);
+
+    if (stats.is_failed)
+        printf("Error: failed to write snapshots to trajectory file.\n");
+
+    printf("Snapshots every %lu steps: %lu written, %lu dropped (the "
+        "writer was busy), %.3f MB.\n", stats.every, stats.written,
+        stats.dropped, stats.bytes / megabyte);
+
+    if (stats.busy > 0.0 && timework > 0.0)
+    {
+        printf("Writing speed: %.1f MB/sec. of writer, %.1f MB/sec. of "
+            "run.\n", stats.bytes / megabyte / stats.busy,
+            stats.bytes / megabyte / timework);
+    }
+
+    if (stats.bytes > 0 && stats.raw_bytes != stats.bytes)
+    {
+        printf("Compression: %.3f MB of snapshots in \".nb\" format, the "
+            "ratio is %.2f.\n", stats.raw_bytes / megabyte,
+            (double)stats.raw_bytes / stats.bytes);
+    }
+}
+
+// Print the counts of adaptive steps or the counts of updates of bodies by
+// block time steps, a shared step would update all bodies at each block
+// time
+void _menu_print_run_stats(const nb_system *const system, size_t num_iter,
+    bool is_done, const nb_adaptive_stats *const stats)
+{
+    size_t blocks, updates;
+
+    if (!is_done)
+    {
+        printf("Error: failed to allocate memory for adaptive steps.\n");
+        return;
+    }
+
+    if (calc_settings.tolerance > 0.0)
+    {
+        printf("Adaptive steps: %lu accepted, %lu rejected, accepted "
+            "steps from %lf to %lf.\n", stats->accepted, stats->rejected,
+            stats->dt_min, stats->dt_max);
+        return;
+    }
+
+    if (calc_settings.integrator != NB_INTEGRATOR_BLOCK ||
+        !nb_block_stats(system, &blocks, &updates) || updates == 0)
+    {
+        return;
+    }
+
+    printf("Block time steps: %lu blocks in %lu steps, %lu updates of "
+        "bodies (%.1f times less than by shared steps).\n", blocks,
+        num_iter, updates, (double)blocks * system->count / updates);
+}
+
+// Print the counts of builds of lists of neighbours and their sizes of the
+// last build, lists are used by the approximating engines only
+void _menu_print_neighbour_stats(const nb_system *const system)
+{
+    const nb_neighbour *const lists =
+        (const nb_neighbour*)system->_neighbour_buf;
+
+    if (lists == NULL || lists->passes == 0)
+        return;
+
+    printf("Lists of neighbours: %lu builds in %lu collision passes, %lu "
+        "pairs (%.1f per body, at most %lu).\n", lists->builds,
+        lists->passes, lists->pairs,
+        (lists->count > 0) ? (double)lists->pairs / lists->count : 0.0,
+        lists->max_list);
+}
+
+// Print busy times of threads in the force loop of the run, the
+// difference of the longest and the mean times is the imbalance of rows
+void _menu_print_busy_times(const nb_system *const system)
+{
+    const nb_balance *const balance =
+        (const nb_balance*)system->_balance_buf;
+    const size_t threads = (size_t)omp_get_max_threads();
+    double total = 0.0, longest = 0.0;
+
+    // steps of adaptive runs are done by copies of system
+    if (balance == NULL || calc_settings.tolerance > 0.0)
+        return;
+
+    for (size_t t = 0; t < threads && t < balance->threads; t++)
+    {
+        total += balance->busy[t];
+        if (balance->busy[t] > longest)
+            longest = balance->busy[t];
     }
+
+    if (total <= 0.0)
+        return;
+
+    printf("Busy time of threads in the force loop (sec.):");
+    for (size_t t = 0; t < threads && t < balance->threads; t++)
+        printf(" %.3f", balance->busy[t]);
+    printf(".\nThe longest time is %.3f times the mean.\n",
+        longest * threads / total);
 }
 
 bool menu_load_system(nb_system *const system, const char *const filename)
 {
     FILE* file;
-    bool status;
+    bool status, is_read;
     bool is_critical_err = false;
 
     file = fopen(filename, "rb");
@@ -367,7 +597,14 @@ bool menu_load_system(nb_system *const system, const char *const filename)
     }
 
     printf("Reading the data from this file...\n");
-    if (!nb_system_read(system, file))
+
+    // the columns of files of columnar format are used in place
+    if (nb_format_is_v2(file))
+        is_read = nb_format_map_v2(system, filename);
+    else
+        is_read = nb_system_read(system, file);
+
+    if (!is_read)
     {
         int err = errno;
 
@@ -401,8 +638,80 @@ bool menu_load_system(nb_system *const system, const char *const filename)
         return status;
 }
 
+// Load the frame of trajectory file, which time is the nearest one to
+// "time", as the system. Only the bodies of the list "bodies" (e.g.
+// "0,5-9") are kept, unless it is NULL.
+bool menu_load_frame(nb_system *const system, const char *const filename,
+    nb_float time, const char *const bodies)
+{
+    nb_trajectory trajectory;
+    FILE* file;
+    size_t frame = 0;
+    bool status;
+
+    file = fopen(filename, "rb");
+
+    if (file == NULL)
+    {
+        printf("Error: failed to open this file.\n");
+        return false;
+    }
+
+    printf("Reading the index of this trajectory...\n");
+    status = nb_trajectory_init_read(&trajectory, file) &&
+        nb_trajectory_load_index(&trajectory);
+
+    if (!status)
+        printf("Error: failed to read the index of this trajectory.\n");
+    else if (trajectory.index_count == 0)
+    {
+        printf("Error: the trajectory has no frames.\n");
+        status = false;
+    }
+    else
+    {
+        frame = nb_trajectory_find(&trajectory, time);
+        status = nb_trajectory_read_frame(&trajectory, frame, system);
+
+        // the system is empty after a failed frame
+        if (!status)
+        {
+            printf("Error: failed to read frame %lu of this trajectory.\n",
+                frame);
+            errno = 0;
+
+            nb_system_clear(system);
+            if (errno == ENOMEM)
+            {
+                printf("Critical error: failed to initializing system.\n");
+                exit(EXIT_FAILURE);
+            }
+        }
+    }
+
+    if (status && bodies != NULL && !nb_trajectory_select(system, bodies))
+    {
+        printf("Error: wrong indices of bodies \"%s\", the system has %lu "
+            "bodies.\n", bodies, system->count);
+        status = false;
+    }
+
+    if (status)
+    {
+        printf("The frame %lu of %lu (time %lf, step %lu) was successfully "
+            "read, %lu bodies.\n", frame, trajectory.index_count,
+            trajectory.index[frame].time, trajectory.index[frame].step,
+            system->count);
+    }
+
+    nb_trajectory_destroy(&trajectory);
+    fclose(file);
+
+    return status;
+}
+
 bool menu_save_system(const nb_system *const system,
-    const char *const filename)
+    const char *const filename, nb_format format)
 {
     FILE* file;
     bool status = true;
@@ -416,7 +725,7 @@ bool menu_save_system(const nb_system *const system,
     }
 
     printf("Writing the data to this file...\n");
-    if (!nb_system_write(system, file))
+    if (!nb_format_write(system, file, format))
     {
         printf("Error: failed to write data to this file.\n");
         status = false;
@@ -451,11 +760,13 @@ void _menu_print()
     printf("\t3: Add new body in system.\n");
     printf("\t4: Remove body from system by index.\n");
     printf("\t5: Run the system before time \"T\" with step \"dt\".\n");
-    printf("\t6: Load system from file with \".nb\" file extension.\n");
+    printf("\t6: Load system from file with \".nb\" file extension or "
+        "frame of trajectory.\n");
     printf("\t7: Save system to file with \".nb\" file extension.\n");
     printf("\t8: Print system to screen.\n");
     printf("\t9: Print system to file.\n");
-    printf("\t10: Exit.\n");
+    printf("\t10: Set parameters of calculation.\n");
+    printf("\t11: Exit.\n");
 }
 
 void _menu_settings_loop(nb_rand_settings *const settings)
@@ -577,6 +888,447 @@ void _menu_print_settings(const nb_rand_settings *const settings)
     printf("\t6: Exit.\n");
 }
 
+void _menu_calc_settings_loop(nb_calc_settings *const settings)
+{
+    bool is_exit = false;
+    nb_uint choose;
+
+    while (!is_exit)
+    {
+        _menu_print_calc_settings();
+
+        choose = _menu_input_uint();
+
+        switch (choose)
+        {
+        case 1:
+        {
+            printf("Choose the engine of calculation of forces:\n");
+            printf("\t1: %s (all pairs of bodies).\n",
+                nb_engine_name(NB_ENGINE_DIRECT));
+            printf("\t2: %s (quadtree approximation).\n",
+                nb_engine_name(NB_ENGINE_BARNES_HUT));
+            printf("\t3: %s (fast multipole method).\n",
+                nb_engine_name(NB_ENGINE_FMM));
+            printf("\t4: %s (particle-mesh with FFT).\n",
+                nb_engine_name(NB_ENGINE_PM));
+
+            choose = _menu_input_uint();
+
+            if (choose < 1 || choose > 4)
+                printf("Error: this menu item does not exist.\n");
+            // expansions of FMM engine do not converge for wider angles
+            else if (choose - 1 == NB_ENGINE_FMM && settings->theta >= 1.0)
+            {
+                printf("Error: opening angle of FMM engine must be less "
+                    "than 1, set the opening angle first.\n");
+            }
+            else
+                settings->engine = (nb_engine)(choose - 1);
+
+            break;
+        }
+        case 2:
+        {
+            nb_simd_level max_simd = nb_simd_detect();
+
+            printf("Choose the instruction set of force kernel:\n");
+            for (nb_uint i = NB_SIMD_NONE; i <= max_simd; i++)
+                printf("\t%u: %s.\n", i + 1, nb_simd_name(i));
+
+            choose = _menu_input_uint();
+
+            if (choose == 0 || choose - 1 > max_simd)
+                printf("Error: this menu item does not exist.\n");
+            else
+                settings->simd = (nb_simd_level)(choose - 1);
+
+            break;
+        }
+        case 3:
+        {
+            printf("Choose the kernel of calculation of forces:\n");
+            printf("\t1: %s (each pair of bodies is visited twice).\n",
+                nb_kernel_name(NB_KERNEL_DIRECT));
+            printf("\t2: %s (each pair of bodies is visited once).\n",
+                nb_kernel_name(NB_KERNEL_SYMMETRIC));
+
+            choose = _menu_input_uint();
+
+            if (choose == 1)
+                settings->kernel = NB_KERNEL_DIRECT;
+            else if (choose == 2)
+            {
+                settings->kernel = NB_KERNEL_SYMMETRIC;
+                break;
+            }
+            else
+            {
+                printf("Error: this menu item does not exist.\n");
+                break;
+            }
+
+            printf("Calculate inverse distances by reciprocal square "
+                "root?\n");
+            printf("\t1: Yes (estimate refined by Newton iterations).\n");
+            printf("\t2: No (square root and division).\n");
+
+            choose = _menu_input_uint();
+
+            if (choose >= 1 && choose <= 2)
+                settings->rsqrt = choose == 1;
+            else
+                printf("Error: this menu item does not exist.\n");
+
+            break;
+        }
+        case 4:
+        {
+            nb_uint tile_i, tile_j;
+
+            printf("Enter the count of bodies \"i\" in tile "
+                "(0 - without tiles):\n");
+            while (true)
+            {
+                tile_i = _menu_input_uint();
+
+                if (tile_i > NB_TILE_MAX)
+                {
+                    printf("Error: count of bodies in tile must not be "
+                        "greater than %d.\n", NB_TILE_MAX);
+                }
+                else
+                    break;
+            }
+
+            if (tile_i == 0)
+            {
+                settings->tile_i = 0;
+                settings->tile_j = 0;
+                break;
+            }
+
+            printf("Enter the count of bodies \"j\" in tile:\n");
+            while (true)
+            {
+                tile_j = _menu_input_uint();
+
+                if (tile_j == 0)
+                    printf("Error: count of bodies must be greater than "
+                        "zero.\n");
+                else
+                    break;
+            }
+
+            settings->tile_i = tile_i;
+            settings->tile_j = tile_j;
+
+            break;
+        }
+        case 5:
+        {
+            nb_float theta;
+
+            printf("Enter the opening angle of Barnes-Hut and FMM "
+                "engines:\n");
+            while (true)
+            {
+                theta = _menu_input_float();
+
+                if (theta <= 0.0)
+                    printf("Error: opening angle must be greater than "
+                        "zero.\n");
+                else if (theta >= 1.0 && settings->engine == NB_ENGINE_FMM)
+                    printf("Error: opening angle of FMM engine must be less "
+                        "than 1.\n");
+                else
+                    break;
+            }
+
+            printf("Use quadrupole moments of cells?\n");
+            printf("\t1: Yes.\n");
+            printf("\t2: No.\n");
+
+            choose = _menu_input_uint();
+
+            if (choose >= 1 && choose <= 2)
+            {
+                settings->theta = theta;
+                settings->quadrupole = choose == 1;
+            }
+            else
+                printf("Error: this menu item does not exist.\n");
+
+            break;
+        }
+        case 6:
+        {
+            nb_uint order;
+
+            printf("Enter the order of expansions of FMM engine:\n");
+            while (true)
+            {
+                order = _menu_input_uint();
+
+                if (order == 0 || order > NB_FMM_ORDER_MAX)
+                    printf("Error: order of expansions must be from 1 "
+                        "to %d.\n", NB_FMM_ORDER_MAX);
+                else
+                    break;
+            }
+
+            settings->fmm_order = order;
+            break;
+        }
+        case 7:
+        {
+            nb_uint grid;
+            nb_pm_scheme scheme;
+
+            printf("Enter the count of cells of mesh along axis "
+                "(a power of two):\n");
+            while (true)
+            {
+                grid = _menu_input_uint();
+
+                if (grid < NB_PM_GRID_MIN || grid > NB_PM_GRID_MAX ||
+                    (grid & (grid - 1)) != 0)
+                {
+                    printf("Error: count of cells of mesh must be a power "
+                        "of two from %d to %d.\n", NB_PM_GRID_MIN,
+                        NB_PM_GRID_MAX);
+                }
+                else
+                    break;
+            }
+
+            printf("Choose the assignment scheme of masses:\n");
+            printf("\t1: %s (cloud in cell).\n", nb_pm_scheme_name(NB_PM_CIC));
+            printf("\t2: %s (triangular shaped cloud).\n",
+                nb_pm_scheme_name(NB_PM_TSC));
+
+            choose = _menu_input_uint();
+
+            if (choose < 1 || choose > 2)
+            {
+                printf("Error: this menu item does not exist.\n");
+                break;
+            }
+
+            scheme = (nb_pm_scheme)(choose - 1);
+
+            printf("Choose the boundaries of mesh:\n");
+            printf("\t1: Isolated.\n");
+            printf("\t2: Periodic.\n");
+
+            choose = _menu_input_uint();
+
+            if (choose >= 1 && choose <= 2)
+            {
+                settings->pm_grid = grid;
+                settings->pm_scheme = scheme;
+                settings->pm_periodic = choose == 2;
+            }
+            else
+                printf("Error: this menu item does not exist.\n");
+
+            break;
+        }
+        case 8:
+        {
+            printf("Choose the integrator of equations of motion:\n");
+            printf("\t1: %s (first order, averaged speed).\n",
+                nb_integrator_name(NB_INTEGRATOR_EULER));
+            printf("\t2: %s (second order, kick-drift-kick).\n",
+                nb_integrator_name(NB_INTEGRATOR_LEAPFROG));
+            printf("\t3: %s (fourth order, 3 forces per step).\n",
+                nb_integrator_name(NB_INTEGRATOR_FOREST_RUTH));
+            printf("\t4: %s (sixth order, 7 forces per step).\n",
+                nb_integrator_name(NB_INTEGRATOR_YOSHIDA6));
+            printf("\t5: %s (fourth order, 4 forces per step).\n",
+                nb_integrator_name(NB_INTEGRATOR_PEFRL));
+            printf("\t6: %s (fourth order, forces and jerks).\n",
+                nb_integrator_name(NB_INTEGRATOR_HERMITE));
+            printf("\t7: %s (fourth order, individual time steps).\n",
+                nb_integrator_name(NB_INTEGRATOR_BLOCK));
+
+            choose = _menu_input_uint();
+
+            if (choose < 1 || choose > 7)
+            {
+                printf("Error: this menu item does not exist.\n");
+                break;
+            }
+
+            settings->integrator = (nb_integrator)(choose - 1);
+
+            if (settings->integrator == NB_INTEGRATOR_BLOCK)
+            {
+                nb_float eta;
+
+                printf("Enter the accuracy parameter of block time "
+                    "steps:\n");
+                while (true)
+                {
+                    eta = _menu_input_float();
+
+                    if (eta <= 0.0)
+                        printf("Error: accuracy parameter must be greater "
+                            "than zero.\n");
+                    else
+                        break;
+                }
+
+                settings->block_eta = eta;
+            }
+
+            break;
+        }
+        case 9:
+        {
+            nb_float tolerance;
+
+            printf("Enter the tolerance of adaptive time steps (0 for "
+                "fixed steps):\n");
+            while (true)
+            {
+                tolerance = _menu_input_float();
+
+                if (tolerance < 0.0)
+                    printf("Error: tolerance must not be negative.\n");
+                else
+                    break;
+            }
+
+            settings->tolerance = tolerance;
+            break;
+        }
+        case 10:
+        {
+            printf("Choose the schedule of rows between threads:\n");
+            printf("\t1: %s (equal counts of rows).\n",
+                nb_schedule_name(NB_SCHEDULE_STATIC));
+            printf("\t2: %s (decreasing chunks of rows).\n",
+                nb_schedule_name(NB_SCHEDULE_GUIDED));
+            printf("\t3: %s (chunks of %d rows taken by free threads).\n",
+                nb_schedule_name(NB_SCHEDULE_DYNAMIC), NB_SCHEDULE_CHUNK);
+            printf("\t4: %s (equal times of rows of the previous step).\n",
+                nb_schedule_name(NB_SCHEDULE_BALANCED));
+
+            choose = _menu_input_uint();
+
+            if (choose >= 1 && choose <= 4)
+                settings->schedule = (nb_schedule)(choose - 1);
+            else
+                printf("Error: this menu item does not exist.\n");
+
+            break;
+        }
+        case 11:
+        {
+            nb_float skin;
+
+            printf("Enter the skin of lists of neighbours of collisions "
+                "(0 - spatial hash at each step):\n");
+            while (true)
+            {
+                skin = _menu_input_float();
+
+                if (skin < 0.0)
+                    printf("Error: skin must not be negative.\n");
+                else
+                    break;
+            }
+
+            settings->skin = skin;
+            break;
+        }
+        case 12:
+        {
+            printf("Integrator of equations of motion: %s.\n",
+                nb_integrator_name(settings->integrator));
+            printf("Accuracy parameter of block time steps: %lf.\n",
+                settings->block_eta);
+            if (settings->tolerance > 0.0)
+            {
+                printf("Tolerance of adaptive time steps: %lf.\n",
+                    settings->tolerance);
+            }
+            else
+                printf("Tolerance of adaptive time steps: fixed steps.\n");
+            printf("Engine of calculation of forces: %s.\n",
+                nb_engine_name(settings->engine));
+            printf("Instruction set of force kernel: %s.\n",
+                nb_simd_name(settings->simd));
+            printf("Kernel of calculation of forces: %s.\n",
+                nb_kernel_name(settings->kernel));
+            printf("Schedule of rows between threads: %s.\n",
+                nb_schedule_name(settings->schedule));
+            printf("Inverse distances of direct kernel: %s.\n",
+                settings->rsqrt ? "reciprocal square root" :
+                "square root and division");
+            if (settings->tile_i != 0)
+            {
+                printf("Tiles of direct kernel: %lu x %lu bodies.\n",
+                    settings->tile_i, settings->tile_j);
+            }
+            else
+                printf("Tiles of direct kernel: not used.\n");
+            printf("Opening angle of Barnes-Hut and FMM engines: %lf.\n",
+                settings->theta);
+            printf("Moments of cells of Barnes-Hut engine: %s.\n",
+                settings->quadrupole ? "quadrupole" : "monopole");
+            printf("Order of expansions of FMM engine: %lu.\n",
+                settings->fmm_order);
+            printf("Particle-mesh: %lu x %lu cells, \"%s\" scheme, "
+                "%s boundaries.\n", settings->pm_grid, settings->pm_grid,
+                nb_pm_scheme_name(settings->pm_scheme),
+                settings->pm_periodic ? "periodic" : "isolated");
+            if (settings->skin > 0.0)
+            {
+                printf("Skin of lists of neighbours of collisions: %lf.\n",
+                    settings->skin);
+            }
+            else
+                printf("Skin of lists of neighbours of collisions: not "
+                    "used.\n");
+
+            break;
+        }
+        case 13:
+        {
+            is_exit = true;
+            break;
+        }
+        default:
+        {
+            printf("Error: this menu item does not exist.\n");
+            break;
+        }
+        }
+
+        printf("\n");
+    }
+}
+
+void _menu_print_calc_settings()
+{
+    printf("Settings of calculation:\n");
+    printf("\t1: Set engine of calculation of forces.\n");
+    printf("\t2: Set instruction set of force kernel.\n");
+    printf("\t3: Set kernel of calculation of forces.\n");
+    printf("\t4: Set sizes of tiles of direct kernel.\n");
+    printf("\t5: Set opening angle and moments of cells.\n");
+    printf("\t6: Set order of expansions of FMM engine.\n");
+    printf("\t7: Set parameters of particle-mesh engine.\n");
+    printf("\t8: Set integrator of equations of motion.\n");
+    printf("\t9: Set tolerance of adaptive time steps.\n");
+    printf("\t10: Set schedule of rows between threads.\n");
+    printf("\t11: Set skin of lists of neighbours of collisions.\n");
+    printf("\t12: Print settings.\n");
+    printf("\t13: Exit.\n");
+}
+
 void _menu_add_body(nb_system *const system)
 {
     nb_body body;
@@ -634,8 +1386,8 @@ void _menu_compare_systems(const nb_system *const system1,
     nb_vector2_init_default(&ae_force);
     nb_vector2_init_default(&re_force);
 
-    nb_body* body1;
-    nb_body* body2;
+    nb_body body1;
+    nb_body body2;
     nb_vector2 vec;
 
     printf("Comparison system 2 relative to system1:\n");
@@ -647,28 +1399,28 @@ void _menu_compare_systems(const nb_system *const system1,
 
     for (size_t i = 0; i < system1->count; i++)
     {
-        body1 = &system1->bodies[i];
-        body2 = &system2->bodies[i];
+        nb_system_get_body(system1, i, &body1);
+        nb_system_get_body(system2, i, &body2);
 
-        vec = nb_vector2_sub(&body1->coords, &body2->coords);
+        vec = nb_vector2_sub(&body1.coords, &body2.coords);
         vec.x = fabsl(vec.x), vec.y = fabsl(vec.y);
         ae_coords = nb_vector2_add(&ae_coords, &vec);
-        vec.x = vec.x / fabsl(body1->coords.x) * 100;
-        vec.y = vec.y / fabsl(body1->coords.y) * 100;
+        vec.x = vec.x / fabsl(body1.coords.x) * 100;
+        vec.y = vec.y / fabsl(body1.coords.y) * 100;
         re_coords = nb_vector2_add(&re_coords, &vec);
 
-        vec = nb_vector2_sub(&body1->speed, &body2->speed);
+        vec = nb_vector2_sub(&body1.speed, &body2.speed);
         vec.x = fabsl(vec.x), vec.y = fabsl(vec.y);
         ae_speed = nb_vector2_add(&ae_speed, &vec);
-        vec.x = vec.x / fabsl(body1->speed.x) * 100;
-        vec.y = vec.y / fabsl(body1->speed.y) * 100;
+        vec.x = vec.x / fabsl(body1.speed.x) * 100;
+        vec.y = vec.y / fabsl(body1.speed.y) * 100;
         re_speed = nb_vector2_add(&re_speed, &vec);
 
-        vec = nb_vector2_sub(&body1->force, &body2->force);
+        vec = nb_vector2_sub(&body1.force, &body2.force);
         vec.x = fabsl(vec.x), vec.y = fabsl(vec.y);
         ae_force = nb_vector2_add(&ae_force, &vec);
-        vec.x = vec.x / fabsl(body1->force.x) * 100;
-        vec.y = vec.y / fabsl(body1->force.y) * 100;
+        vec.x = vec.x / fabsl(body1.force.x) * 100;
+        vec.y = vec.y / fabsl(body1.force.y) * 100;
         re_force = nb_vector2_add(&re_force, &vec);
     }
 
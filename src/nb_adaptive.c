@@ -0,0 +1,217 @@
+#include "nb_adaptive.h"
+#include "nb_block.h"
+#include "nb_collision.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <errno.h>
+
+
+// bounds of change of step after one attempt and safety factor of new step
+#define NB_ADAPTIVE_SHRINK_MAX 0.2
+#define NB_ADAPTIVE_GROW_MAX 5.0
+#define NB_ADAPTIVE_SAFETY 0.9
+// the smallest step is the initial step divided by this value, steps at
+// the smallest step are accepted whatever the error is
+#define NB_ADAPTIVE_DT_MIN_RATIO 1048576.0
+
+
+static void _nb_adaptive_load(nb_system *const system,
+    const nb_system *const source);
+static nb_float _nb_adaptive_error(const nb_system *const start,
+    const nb_system *const full, const nb_system *const half,
+    const nb_row_acc *const start_accs, const nb_row_acc *const end_accs);
+static void _nb_adaptive_swap(nb_system *const a, nb_system *const b);
+
+
+// Orders of integrators in order of "nb_integrator"
+static const unsigned _orders[] = {1, 2, 4, 6, 4, 4, 4};
+
+
+// Run the system during "end_time" by step doubling: each step "h" is
+// compared with two steps "h / 2" of the chosen integrator, the result of
+// the half steps is accepted, if the difference is within the tolerance
+// of calculation settings. The step is changed by the estimated error,
+// the first step is "dt", the last step ends exactly at "end_time".
+// Collisions change speeds by a jump, which does not shrink with the
+// step, so bodies collided at the start or the end of step are not
+// measured. Returns false, if memory allocation failed.
+bool nb_adaptive_run(nb_system *const system, nb_float end_time,
+    nb_float dt, bool parallel, nb_adaptive_stats *const stats)
+{
+    const nb_float power = 1.0 / (_orders[calc_settings.integrator] + 1);
+    const nb_float dt_min = dt / NB_ADAPTIVE_DT_MIN_RATIO;
+    const nb_float t_end = system->time + end_time;
+    nb_system full, half;
+    nb_row_acc* start_accs;  // collisions at the start and end of step
+    nb_row_acc* end_accs;
+    nb_float h = dt;
+    bool is_failed = false;
+
+    stats->accepted = 0;
+    stats->rejected = 0;
+    stats->dt_min = 0.0;
+    stats->dt_max = 0.0;
+
+    nb_system_copy(&full, system);
+    if (errno != 0)
+        return false;
+
+    nb_system_copy(&half, system);
+    if (errno != 0)
+    {
+        nb_system_destroy(&full);
+        return false;
+    }
+
+    start_accs = (nb_row_acc*)malloc(sizeof(nb_row_acc) * system->count);
+    end_accs = (nb_row_acc*)malloc(sizeof(nb_row_acc) * system->count);
+
+    if (start_accs == NULL || end_accs == NULL ||
+        !nb_collision_pass(system, start_accs, parallel))
+    {
+        is_failed = true;
+    }
+    else
+        nb_system_run_init(system, parallel);
+
+    while (!is_failed && system->time < t_end)
+    {
+        bool is_last = false;
+        nb_float err, factor, time;
+        nb_row_acc* accs;
+
+        if (h >= t_end - system->time)
+        {
+            h = t_end - system->time;
+            is_last = true;
+        }
+
+        _nb_adaptive_load(&full, system);
+        _nb_adaptive_load(&half, system);
+
+        nb_system_run(&full, h, parallel);
+        nb_system_run(&half, h / 2, parallel);
+        nb_system_run(&half, h / 2, parallel);
+
+        if (!nb_collision_pass(&half, end_accs, parallel))
+        {
+            is_failed = true;
+            break;
+        }
+
+        err = _nb_adaptive_error(system, &full, &half, start_accs,
+            end_accs);
+
+        if (err <= 1.0 || h <= dt_min)
+        {
+            if (stats->accepted == 0 || h < stats->dt_min)
+                stats->dt_min = h;
+            if (h > stats->dt_max)
+                stats->dt_max = h;
+
+            // the half steps become the system, the old bodies are the
+            // memory of the next attempt
+            time = is_last ? t_end : system->time + h;
+            _nb_adaptive_swap(system, &half);
+            system->time = time;
+            stats->accepted++;
+
+            accs = start_accs;
+            start_accs = end_accs;
+            end_accs = accs;
+        }
+        else
+            stats->rejected++;
+
+        factor = (err > 0.0) ?
+            NB_ADAPTIVE_SAFETY * pow(err, -power) : NB_ADAPTIVE_GROW_MAX;
+        if (factor < NB_ADAPTIVE_SHRINK_MAX)
+            factor = NB_ADAPTIVE_SHRINK_MAX;
+        else if (factor > NB_ADAPTIVE_GROW_MAX)
+            factor = NB_ADAPTIVE_GROW_MAX;
+
+        // the step before the end is not a measure of the next step
+        if (!is_last || err > 1.0)
+            h *= factor;
+        if (h < dt_min)
+            h = dt_min;
+    }
+
+    free(start_accs);
+    free(end_accs);
+    nb_system_destroy(&full);
+    nb_system_destroy(&half);
+    return !is_failed;
+}
+
+// Copy bodies of "source" to "system" of the same capacity. The state of
+// individual steps belongs to the old coordinates, so it is reset, forces
+// of the last step are kept for schemes, which start by them.
+void _nb_adaptive_load(nb_system *const system,
+    const nb_system *const source)
+{
+    const size_t size = sizeof(nb_float) * source->count;
+
+    memcpy(system->cx, source->cx, size);
+    memcpy(system->cy, source->cy, size);
+    memcpy(system->sx, source->sx, size);
+    memcpy(system->sy, source->sy, size);
+    memcpy(system->fx, source->fx, size);
+    memcpy(system->fy, source->fy, size);
+    memcpy(system->mass, source->mass, size);
+    memcpy(system->radius, source->radius, size);
+
+    system->count = source->count;
+    system->time = source->time;
+    nb_block_destroy(system);
+}
+
+// Error of step relative to the tolerance: the largest difference of
+// coordinates (speeds) of the full and half steps divided by the largest
+// change of coordinates (speeds) during the step. Collided bodies are
+// skipped.
+nb_float _nb_adaptive_error(const nb_system *const start,
+    const nb_system *const full, const nb_system *const half,
+    const nb_row_acc *const start_accs, const nb_row_acc *const end_accs)
+{
+    nb_float diff_c = 0.0, diff_s = 0.0;
+    nb_float move_c = 0.0, move_s = 0.0;
+    nb_float err = 0.0;
+
+    for (size_t i = 0; i < start->count; i++)
+    {
+        if (start_accs[i].is_collided || end_accs[i].is_collided)
+            continue;
+
+        nb_float dx = half->cx[i] - full->cx[i];
+        nb_float dy = half->cy[i] - full->cy[i];
+        nb_float dsx = half->sx[i] - full->sx[i];
+        nb_float dsy = half->sy[i] - full->sy[i];
+        nb_float mx = half->cx[i] - start->cx[i];
+        nb_float my = half->cy[i] - start->cy[i];
+        nb_float msx = half->sx[i] - start->sx[i];
+        nb_float msy = half->sy[i] - start->sy[i];
+
+        diff_c = fmax(diff_c, dx * dx + dy * dy);
+        diff_s = fmax(diff_s, dsx * dsx + dsy * dsy);
+        move_c = fmax(move_c, mx * mx + my * my);
+        move_s = fmax(move_s, msx * msx + msy * msy);
+    }
+
+    if (move_c > 0.0)
+        err = NB_SQRT(diff_c / move_c);
+    if (move_s > 0.0)
+        err = fmax(err, NB_SQRT(diff_s / move_s));
+
+    return err / calc_settings.tolerance;
+}
+
+void _nb_adaptive_swap(nb_system *const a, nb_system *const b)
+{
+    nb_system temp = *a;
+
+    *a = *b;
+    *b = temp;
+}
@@ -0,0 +1,124 @@
+#include "nb_balance.h"
+
+#include <stdlib.h>
+
+#include <omp.h>
+
+
+// Get the balance state of system for its count of bodies. It is created
+// on the first request, so copies of system get their own states. Returns
+// NULL, if memory allocation failed.
+nb_balance* nb_balance_get(nb_system *const system)
+{
+    nb_balance* balance = (nb_balance*)system->_balance_buf;
+    const size_t threads = (size_t)omp_get_max_threads();
+
+    if (balance != NULL && balance->count == system->count &&
+        balance->threads >= threads)
+    {
+        return balance;
+    }
+
+    nb_balance_destroy(system);
+
+    balance = (nb_balance*)calloc(1, sizeof(nb_balance));
+    if (balance == NULL)
+        return NULL;
+
+    system->_balance_buf = balance;
+    balance->count = system->count;
+    balance->threads = threads;
+    balance->cost[0] = (double*)malloc(sizeof(double) * system->count);
+    balance->cost[1] = (double*)malloc(sizeof(double) * system->count);
+    balance->busy = (double*)calloc(threads, sizeof(double));
+
+    if (balance->cost[0] == NULL || balance->cost[1] == NULL ||
+        balance->busy == NULL)
+    {
+        nb_balance_destroy(system);
+        return NULL;
+    }
+
+    return balance;
+}
+
+// Reset busy times of threads at the start of run. Measured times of rows
+// are kept, the bodies may be the same.
+void nb_balance_reset(nb_system *const system)
+{
+    nb_balance *const balance = (nb_balance*)system->_balance_buf;
+
+    if (balance == NULL)
+        return;
+
+    for (size_t t = 0; t < balance->threads; t++)
+        balance->busy[t] = 0.0;
+}
+
+// Get the rows of "thread" of "threads" at the balanced pass "pass": rows
+// are split into ranges of equal cost by the times of the previous pass.
+// At the first pass the cost of a row is taken from the model: equal for
+// all rows or decreasing with the index of row, if "is_triangular" (rows of
+// the symmetric kernel visit pairs (i, j) with j > i).
+void nb_balance_range(const nb_balance *const balance, size_t pass,
+    bool is_triangular, size_t thread, size_t threads, size_t *const begin,
+    size_t *const end)
+{
+    const size_t count = balance->count;
+    const double *const cost = balance->cost[(pass + 1) % 2];
+    double total = 0.0, sum = 0.0;
+    double first, last;
+    size_t i = 0;
+
+    if (pass == 0)
+    {
+        if (!is_triangular)
+        {
+            *begin = count * thread / threads;
+            *end = count * (thread + 1) / threads;
+            return;
+        }
+
+        // cost of row "i" is count - i, the sum of costs before row "k" is
+        // k * count - k * (k - 1) / 2
+        total = (double)count * (count + 1) / 2;
+        first = total * thread / threads;
+        last = total * (thread + 1) / threads;
+
+        while (i < count && sum + (count - i) / 2.0 <= first)
+            sum += count - i++;
+        *begin = (thread == 0) ? 0 : i;
+        while (i < count && sum + (count - i) / 2.0 <= last)
+            sum += count - i++;
+        *end = (thread + 1 == threads) ? count : i;
+        return;
+    }
+
+    for (size_t k = 0; k < count; k++)
+        total += cost[k];
+
+    first = total * thread / threads;
+    last = total * (thread + 1) / threads;
+
+    // a row belongs to the thread, which contains the middle of its cost
+    while (i < count && sum + cost[i] / 2 <= first)
+        sum += cost[i++];
+    *begin = (thread == 0) ? 0 : i;
+    while (i < count && sum + cost[i] / 2 <= last)
+        sum += cost[i++];
+    *end = (thread + 1 == threads) ? count : i;
+}
+
+void nb_balance_destroy(nb_system *const system)
+{
+    nb_balance *const balance = (nb_balance*)system->_balance_buf;
+
+    if (balance == NULL)
+        return;
+
+    free(balance->cost[0]);
+    free(balance->cost[1]);
+    free(balance->busy);
+    free(balance);
+    system->_balance_buf = NULL;
+}
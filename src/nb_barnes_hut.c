@@ -0,0 +1,215 @@
+#include "nb_barnes_hut.h"
+
+#include <stdlib.h>
+#include <math.h>
+
+#include <omp.h>
+
+#include "nb_quadtree.h"
+#include "nb_neighbour.h"
+
+
+// maximum count of bodies in the leaf of tree
+#define NB_BH_LEAF_MAX 8
+
+
+// Quadrupole moment of cell about its center of mass
+typedef struct _bh_quad
+{
+    nb_float qxx, qxy, qyy;
+} _bh_quad;
+
+
+static _bh_quad* _bh_quadrupoles(const nb_quadtree *const tree,
+    const nb_system *const system);
+static void _bh_forces(const nb_quadtree *const tree,
+    const _bh_quad *const quads, const nb_system *const system, size_t i,
+    nb_row_acc *const acc);
+
+
+bool nb_barnes_hut_forces(nb_system *const system, bool parallel)
+{
+    const size_t count = system->count;
+    nb_quadtree tree;
+    nb_row_acc* accs;
+    _bh_quad* quads = NULL;
+
+    accs = (nb_row_acc*)malloc(sizeof(nb_row_acc) * count);
+    if (accs == NULL)
+        return false;
+
+    if (!nb_neighbour_pass(system, accs, parallel) ||
+        !nb_quadtree_build(&tree, system, NB_BH_LEAF_MAX))
+    {
+        free(accs);
+        return false;
+    }
+
+    if (calc_settings.quadrupole)
+    {
+        quads = _bh_quadrupoles(&tree, system);
+        if (quads == NULL)
+        {
+            nb_quadtree_destroy(&tree);
+            free(accs);
+            return false;
+        }
+    }
+
+    // Bodies are walked in order of cells of tree, so neighbouring
+    // iterations use the same cells
+    #pragma omp parallel for schedule(dynamic, 64) if (parallel)
+    for (size_t k = 0; k < count; k++)
+    {
+        size_t i = tree.perm[k];
+        nb_row_acc acc = accs[i];
+
+        _bh_forces(&tree, quads, system, i, &acc);
+        nb_calc_set_row(system, i, &acc);
+    }
+
+    free(quads);
+    nb_quadtree_destroy(&tree);
+    free(accs);
+    return true;
+}
+
+// Calculate quadrupole moments of all cells. Children are placed after
+// their parent, so the reverse order of cells goes from leaves to root.
+_bh_quad* _bh_quadrupoles(const nb_quadtree *const tree,
+    const nb_system *const system)
+{
+    _bh_quad* quads = (_bh_quad*)malloc(sizeof(_bh_quad) * tree->count);
+
+    if (quads == NULL)
+        return NULL;
+
+    for (size_t index = tree->count; index-- > 0;)
+    {
+        const nb_quad_node *const node = &tree->nodes[index];
+        nb_float qxx = 0.0, qxy = 0.0, qyy = 0.0;
+
+        if (node->is_leaf)
+        {
+            for (size_t k = node->first; k < node->first + node->count; k++)
+            {
+                size_t i = tree->perm[k];
+                nb_float dx = system->cx[i] - node->mx;
+                nb_float dy = system->cy[i] - node->my;
+                nb_float r2 = dx * dx + dy * dy;
+
+                qxx += system->mass[i] * (3 * dx * dx - r2);
+                qxy += system->mass[i] * 3 * dx * dy;
+                qyy += system->mass[i] * (3 * dy * dy - r2);
+            }
+        }
+        else
+        {
+            // Shift quadrupole moments of children to the center of mass
+            for (size_t q = 0; q < 4; q++)
+            {
+                const nb_quad_node* child;
+
+                if (node->child[q] == 0)
+                    continue;
+
+                child = &tree->nodes[node->child[q]];
+
+                nb_float dx = child->mx - node->mx;
+                nb_float dy = child->my - node->my;
+                nb_float r2 = dx * dx + dy * dy;
+
+                qxx += quads[node->child[q]].qxx +
+                    child->mass * (3 * dx * dx - r2);
+                qxy += quads[node->child[q]].qxy + child->mass * 3 * dx * dy;
+                qyy += quads[node->child[q]].qyy +
+                    child->mass * (3 * dy * dy - r2);
+            }
+        }
+
+        quads[index].qxx = qxx;
+        quads[index].qxy = qxy;
+        quads[index].qyy = qyy;
+    }
+
+    return quads;
+}
+
+// Calculate total force acting on body "i". A cell, which is seen from
+// the body at the angle less than "theta", is replaced by its moments.
+void _bh_forces(const nb_quadtree *const tree, const _bh_quad *const quads,
+    const nb_system *const system, size_t i, nb_row_acc *const acc)
+{
+    const nb_float theta2 = calc_settings.theta * calc_settings.theta;
+    const nb_float x_i = system->cx[i], y_i = system->cy[i];
+    const nb_float g_mass_i = gravity_const * system->mass[i];
+
+    size_t stack[NB_QUAD_STACK_MAX];
+    size_t top = 0;
+
+    stack[top++] = 0;
+    while (top > 0)
+    {
+        const size_t index = stack[--top];
+        const nb_quad_node *const node = &tree->nodes[index];
+        nb_float dx = node->mx - x_i;
+        nb_float dy = node->my - y_i;
+        nb_float d2 = dx * dx + dy * dy;
+        nb_float size = 2 * node->half;
+
+        // is body "i" outside of the cell
+        bool is_outside = fabs(x_i - node->x) > node->half ||
+            fabs(y_i - node->y) > node->half;
+
+        if (is_outside && size * size < theta2 * d2)
+        {
+            nb_float distance = NB_SQRT(d2);
+            nb_float inv_d3 = 1.0 / (d2 * distance);
+            nb_float scalar = g_mass_i * node->mass * inv_d3;
+
+            acc->fx += dx * scalar;
+            acc->fy += dy * scalar;
+
+            if (quads != NULL)
+            {
+                // r = -d is the vector from center of mass to body "i"
+                const _bh_quad *const quad = &quads[index];
+                nb_float inv_d5 = inv_d3 / d2;
+                nb_float qr_x = -(quad->qxx * dx + quad->qxy * dy);
+                nb_float qr_y = -(quad->qxy * dx + quad->qyy * dy);
+                nb_float rqr = -(dx * qr_x + dy * qr_y);
+                nb_float scal = 2.5 * rqr * inv_d5 / d2;
+
+                acc->fx += g_mass_i * (qr_x * inv_d5 + scal * dx);
+                acc->fy += g_mass_i * (qr_y * inv_d5 + scal * dy);
+            }
+        }
+        else if (node->is_leaf)
+        {
+            for (size_t k = node->first; k < node->first + node->count; k++)
+            {
+                size_t j = tree->perm[k];
+
+                if (j == i)
+                    continue;
+
+                nb_float dx_j = system->cx[j] - x_i;
+                nb_float dy_j = system->cy[j] - y_i;
+                nb_float distance = NB_SQRT(dx_j * dx_j + dy_j * dy_j);
+                nb_float scalar = g_mass_i * system->mass[j] /
+                    (distance * distance * distance);
+
+                acc->fx += dx_j * scalar;
+                acc->fy += dy_j * scalar;
+            }
+        }
+        else
+        {
+            for (size_t q = 0; q < 4; q++)
+            {
+                if (node->child[q] != 0)
+                    stack[top++] = node->child[q];
+            }
+        }
+    }
+}
@@ -0,0 +1,371 @@
+#include "nb_block.h"
+
+#include <stdlib.h>
+#include <stdint.h>
+#include <math.h>
+
+#include <omp.h>
+
+
+// Individual times and steps of bodies. Times are counted in ticks from
+// the start of the current step of run, which consists of
+// 2^NB_BLOCK_LEVELS ticks. Coordinates and speeds of body "i" in the
+// system are given at its own time.
+typedef struct _nb_block_state
+{
+    size_t count;        // count of bodies, for which the state is built
+    nb_float delta;      // step of run (the largest step of body)
+    uint64_t* t;         // times of bodies
+    uint64_t* dt;        // steps of bodies (powers of two)
+    nb_float* ax;        // accelerations at times of bodies
+    nb_float* ay;
+    nb_float* jx;        // jerks (derivatives of accelerations)
+    nb_float* jy;
+    nb_float* px;        // coordinates and speeds of bodies predicted to
+    nb_float* py;        // the time of current block
+    nb_float* pvx;
+    nb_float* pvy;
+    size_t* active;      // bodies of current block
+    size_t blocks;       // count of blocks since the start of run
+    size_t updates;      // count of updates of bodies since the start of run
+} _nb_block_state;
+
+
+static _nb_block_state* _nb_block_prepare(nb_system *const system,
+    nb_float dt, bool parallel);
+static void _nb_block_predict(const nb_system *const system,
+    _nb_block_state *const state, size_t i, nb_float tau);
+static void _nb_block_correct(nb_system *const system,
+    _nb_block_state *const state, size_t i, uint64_t t_block, nb_float tick);
+static void _nb_block_forces(const nb_system *const system,
+    const _nb_block_state *const state, size_t i, nb_row_acc *const acc,
+    nb_float *const jx, nb_float *const jy);
+static uint64_t _nb_block_new_step(const _nb_block_state *const state,
+    size_t i, uint64_t t, nb_float tick);
+
+
+// Reset the state of block time steps, so it is built again at the next
+// step from the current coordinates of bodies
+void nb_block_init(nb_system *const system)
+{
+    nb_block_destroy(system);
+}
+
+// One step of run by individual time steps of Hermite scheme. Each body
+// moves by its own step, which is "dt" divided by a power of two. At each
+// block time only bodies, whose steps end at this time, are corrected by
+// the forces of all bodies predicted to this time. With the "hermite"
+// integrator all bodies share the step "dt", so each step is one block.
+// Returns false, if memory allocation failed.
+bool nb_block_step(nb_system *const system, nb_float dt, bool parallel)
+{
+    const uint64_t end = (uint64_t)1 << NB_BLOCK_LEVELS;
+    const nb_float tick = dt / end;
+    const size_t count = system->count;
+    _nb_block_state* state;
+    uint64_t t_block = 0;
+
+    if (count == 0)
+        return true;
+
+    state = _nb_block_prepare(system, dt, parallel);
+    if (state == NULL)
+        return false;
+
+    while (t_block < end)
+    {
+        size_t active_count = 0;
+
+        // the next block time is the earliest end of steps of bodies
+        t_block = end;
+        for (size_t i = 0; i < count; i++)
+        {
+            if (state->t[i] + state->dt[i] < t_block)
+                t_block = state->t[i] + state->dt[i];
+        }
+
+        for (size_t i = 0; i < count; i++)
+        {
+            if (state->t[i] + state->dt[i] == t_block)
+                state->active[active_count++] = i;
+        }
+
+        #pragma omp parallel for schedule(static) if (parallel)
+        for (size_t i = 0; i < count; i++)
+        {
+            _nb_block_predict(system, state, i,
+                (t_block - state->t[i]) * tick);
+        }
+
+        #pragma omp parallel for schedule(dynamic, 16) if (parallel)
+        for (size_t k = 0; k < active_count; k++)
+        {
+            _nb_block_correct(system, state, state->active[k], t_block,
+                tick);
+        }
+
+        state->blocks++;
+        state->updates += active_count;
+    }
+
+    // all bodies have reached the end of step of run
+    for (size_t i = 0; i < count; i++)
+        state->t[i] = 0;
+
+    system->time += dt;
+    return true;
+}
+
+// Get the counts of blocks and updates of bodies since the start of run.
+// Returns false, if there were no steps.
+bool nb_block_stats(const nb_system *const system, size_t *const blocks,
+    size_t *const updates)
+{
+    const _nb_block_state *const state =
+        (const _nb_block_state*)system->_step_buf;
+
+    if (state == NULL)
+        return false;
+
+    *blocks = state->blocks;
+    *updates = state->updates;
+    return true;
+}
+
+void nb_block_destroy(nb_system *const system)
+{
+    _nb_block_state *const state = (_nb_block_state*)system->_step_buf;
+
+    if (state == NULL)
+        return;
+
+    free(state->t);
+    free(state->dt);
+    free(state->ax);
+    free(state->ay);
+    free(state->jx);
+    free(state->jy);
+    free(state->px);
+    free(state->py);
+    free(state->pvx);
+    free(state->pvy);
+    free(state->active);
+    free(state);
+    system->_step_buf = NULL;
+}
+
+// Get the state of system for steps of run "dt". If there is no state or
+// it was built for other bodies or step, then it is built again: the
+// accelerations and jerks are calculated at the current coordinates.
+_nb_block_state* _nb_block_prepare(nb_system *const system, nb_float dt,
+    bool parallel)
+{
+    const size_t count = system->count;
+    const nb_float tick = dt / ((uint64_t)1 << NB_BLOCK_LEVELS);
+    _nb_block_state* state = (_nb_block_state*)system->_step_buf;
+
+    if (state != NULL && state->count == count && state->delta == dt)
+        return state;
+
+    nb_block_destroy(system);
+
+    state = (_nb_block_state*)calloc(1, sizeof(_nb_block_state));
+    if (state == NULL)
+        return NULL;
+
+    system->_step_buf = state;
+    state->count = count;
+    state->delta = dt;
+    state->t = (uint64_t*)calloc(count, sizeof(uint64_t));
+    state->dt = (uint64_t*)malloc(sizeof(uint64_t) * count);
+    state->ax = (nb_float*)malloc(sizeof(nb_float) * count);
+    state->ay = (nb_float*)malloc(sizeof(nb_float) * count);
+    state->jx = (nb_float*)malloc(sizeof(nb_float) * count);
+    state->jy = (nb_float*)malloc(sizeof(nb_float) * count);
+    state->px = (nb_float*)malloc(sizeof(nb_float) * count);
+    state->py = (nb_float*)malloc(sizeof(nb_float) * count);
+    state->pvx = (nb_float*)malloc(sizeof(nb_float) * count);
+    state->pvy = (nb_float*)malloc(sizeof(nb_float) * count);
+    state->active = (size_t*)malloc(sizeof(size_t) * count);
+
+    if (state->t == NULL || state->dt == NULL || state->ax == NULL ||
+        state->ay == NULL || state->jx == NULL || state->jy == NULL ||
+        state->px == NULL || state->py == NULL || state->pvx == NULL ||
+        state->pvy == NULL || state->active == NULL)
+    {
+        nb_block_destroy(system);
+        return NULL;
+    }
+
+    for (size_t i = 0; i < count; i++)
+    {
+        state->px[i] = system->cx[i];
+        state->py[i] = system->cy[i];
+        state->pvx[i] = system->sx[i];
+        state->pvy[i] = system->sy[i];
+    }
+
+    // Speeds after collisions are not applied here, as in the first step
+    // of the other schemes
+    #pragma omp parallel for schedule(static) if (parallel)
+    for (size_t i = 0; i < count; i++)
+    {
+        nb_row_acc acc = {0.0, 0.0, 0.0, 0.0, 0.0, false};
+
+        _nb_block_forces(system, state, i, &acc, &state->jx[i],
+            &state->jy[i]);
+
+        state->ax[i] = acc.fx;
+        state->ay[i] = acc.fy;
+        state->dt[i] = (uint64_t)1 << NB_BLOCK_LEVELS;
+        state->dt[i] = _nb_block_new_step(state, i, 0, tick);
+        system->fx[i] = system->mass[i] * acc.fx;
+        system->fy[i] = system->mass[i] * acc.fy;
+    }
+
+    return state;
+}
+
+// Predict coordinates and speed of body "i" through time "tau" from its
+// acceleration and jerk
+void _nb_block_predict(const nb_system *const system,
+    _nb_block_state *const state, size_t i, nb_float tau)
+{
+    const nb_float ax = state->ax[i], ay = state->ay[i];
+    const nb_float jx = state->jx[i], jy = state->jy[i];
+
+    state->px[i] = system->cx[i] +
+        tau * (system->sx[i] + tau / 2 * (ax + tau / 3 * jx));
+    state->py[i] = system->cy[i] +
+        tau * (system->sy[i] + tau / 2 * (ay + tau / 3 * jy));
+    state->pvx[i] = system->sx[i] + tau * (ax + tau / 2 * jx);
+    state->pvy[i] = system->sy[i] + tau * (ay + tau / 2 * jy);
+}
+
+// Correct coordinates and speed of body "i" at the block time "t_block" by
+// its new acceleration and jerk, apply probably collisions and choose its
+// next step
+void _nb_block_correct(nb_system *const system,
+    _nb_block_state *const state, size_t i, uint64_t t_block, nb_float tick)
+{
+    const nb_float tau = (t_block - state->t[i]) * tick;
+    nb_row_acc acc = {0.0, 0.0, 0.0, 0.0, 0.0, false};
+    nb_float jx, jy, sx, sy;
+
+    _nb_block_forces(system, state, i, &acc, &jx, &jy);
+
+    sx = system->sx[i] + tau / 2 * (state->ax[i] + acc.fx) +
+        tau * tau / 12 * (state->jx[i] - jx);
+    sy = system->sy[i] + tau / 2 * (state->ay[i] + acc.fy) +
+        tau * tau / 12 * (state->jy[i] - jy);
+
+    system->cx[i] += tau / 2 * (system->sx[i] + sx) +
+        tau * tau / 12 * (state->ax[i] - acc.fx);
+    system->cy[i] += tau / 2 * (system->sy[i] + sy) +
+        tau * tau / 12 * (state->ay[i] - acc.fy);
+
+    // Calculate speed for body "i" after collisions
+    if (acc.is_collided)
+    {
+        nb_float mass = system->mass[i];
+        nb_float scal1 = (mass - acc.t_mass) / (mass + acc.t_mass);
+        nb_float scal2 = 2.0 / (mass + acc.t_mass);
+
+        sx = scal1 * sx + scal2 * acc.t_impulse_x;
+        sy = scal1 * sy + scal2 * acc.t_impulse_y;
+    }
+
+    system->sx[i] = sx;
+    system->sy[i] = sy;
+    system->fx[i] = system->mass[i] * acc.fx;
+    system->fy[i] = system->mass[i] * acc.fy;
+
+    state->ax[i] = acc.fx;
+    state->ay[i] = acc.fy;
+    state->jx[i] = jx;
+    state->jy[i] = jy;
+    state->t[i] = t_block;
+    state->dt[i] = _nb_block_new_step(state, i, t_block, tick);
+}
+
+// Calculate acceleration (in "acc->fx" and "acc->fy") and jerk of body "i"
+// and check its collisions by the predicted coordinates and speeds
+void _nb_block_forces(const nb_system *const system,
+    const _nb_block_state *const state, size_t i, nb_row_acc *const acc,
+    nb_float *const jx, nb_float *const jy)
+{
+    const size_t count = system->count;
+    const nb_float *const px = state->px;
+    const nb_float *const py = state->py;
+    const nb_float *const pvx = state->pvx;
+    const nb_float *const pvy = state->pvy;
+    const nb_float *const mass = system->mass;
+    const nb_float *const rad = system->radius;
+
+    nb_float ax = 0.0, ay = 0.0;
+    nb_float jerk_x = 0.0, jerk_y = 0.0;
+
+    for (size_t j = 0; j < count; j++)
+    {
+        if (j == i)
+            continue;
+
+        nb_float dx = px[j] - px[i];
+        nb_float dy = py[j] - py[i];
+        nb_float dvx = pvx[j] - pvx[i];
+        nb_float dvy = pvy[j] - pvy[i];
+        nb_float square = dx * dx + dy * dy;
+        nb_float distance = NB_SQRT(square);
+
+        if (distance <= rad[i] + rad[j])
+        {
+            acc->is_collided = true;
+            acc->t_mass += mass[j];
+            acc->t_impulse_x += pvx[j] * mass[j];
+            acc->t_impulse_y += pvy[j] * mass[j];
+        }
+
+        nb_float scalar = gravity_const * mass[j] /
+            (square * distance);
+        nb_float rv = 3 * (dx * dvx + dy * dvy) / square;
+
+        ax += dx * scalar;
+        ay += dy * scalar;
+        jerk_x += (dvx - rv * dx) * scalar;
+        jerk_y += (dvy - rv * dy) * scalar;
+    }
+
+    acc->fx = ax;
+    acc->fy = ay;
+    *jx = jerk_x;
+    *jy = jerk_y;
+}
+
+// Choose the next step of body "i" at time "t" by the criterion
+// dt = eta * |a| / |j|. The step is the largest power of two not greater
+// than the criterion. It can grow at most twice and only at the time,
+// which is a multiple of the new step, so the steps stay in blocks.
+uint64_t _nb_block_new_step(const _nb_block_state *const state, size_t i,
+    uint64_t t, nb_float tick)
+{
+    const uint64_t end = (uint64_t)1 << NB_BLOCK_LEVELS;
+    nb_float a, j;
+    nb_float limit;  // criterion in ticks
+    uint64_t step = state->dt[i];
+
+    // all bodies share the step of run
+    if (calc_settings.integrator == NB_INTEGRATOR_HERMITE)
+        return end;
+
+    a = NB_SQRT(state->ax[i] * state->ax[i] + state->ay[i] * state->ay[i]);
+    j = NB_SQRT(state->jx[i] * state->jx[i] + state->jy[i] * state->jy[i]);
+    limit = (j > 0.0) ? calc_settings.block_eta * a / j / tick : HUGE_VAL;
+
+    if (2 * step <= end && t % (2 * step) == 0 && 2 * step <= limit)
+        return 2 * step;
+
+    while (step > 1 && step > limit)
+        step /= 2;
+
+    return step;
+}
@@ -1,218 +1,273 @@
 #include "nb_calculation.h"
 
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
 #include <math.h>
+#include <errno.h>
 
 #include <omp.h>
 
+#include "nb_simd.h"
+#include "nb_balance.h"
+#include "nb_barnes_hut.h"
+#include "nb_fmm.h"
+#include "nb_pm.h"
 
-// move "ptr" by "count" bytes to the right
-#define move_ptr(ptr, count) ((void*)(ptr) + (count))
+
+// Indices of accumulators of the symmetric kernel for each body
+enum
+{
+    _PAIR_FX,        // "x" component of force
+    _PAIR_FY,        // "y" component of force
+    _PAIR_MASS,      // total mass of collided bodies
+    _PAIR_IMPULSE_X, // "x" component of total impulse of collided bodies
+    _PAIR_IMPULSE_Y, // "y" component of total impulse of collided bodies
+    _PAIR_COLLIDED,  // number of collided bodies
+    _PAIR_COUNT
+};
+
+// Accumulators of the symmetric kernel, which are kept between calculations
+// of forces of the system
+typedef struct _nb_calc_pair_buf
+{
+    size_t count;    // count of bodies
+    size_t threads;  // count of sets of accumulators (one per thread)
+    bool is_failed;  // the memory of the sets can not be allocated
+    nb_float* acc;   // sets of accumulators one after another
+} _nb_calc_pair_buf;
+
+
+static void _nb_calc_forces_singlethread(nb_system *const system);
+static void _nb_calc_forces_multithreading(nb_system *const system);
+static void _nb_calc_forces(nb_system *const system, size_t i);
+static void _nb_calc_forces_tile(nb_system *const system, size_t block);
+static void _nb_calc_rows_balanced(nb_system *const system,
+    nb_balance *const balance, bool is_symmetric, size_t thread,
+    size_t threads_count, nb_float *const acc);
+static void _nb_calc_step(const nb_system *const cur,
+    const nb_system *const next, size_t i, nb_float dt);
+static nb_float* _nb_calc_pair_acc(nb_system *const system,
+    size_t threads);
+static void _nb_calc_pairs(const nb_system *const system, size_t i,
+    nb_float *const acc);
+static void _nb_calc_pairs_sum(nb_system *const system, size_t i,
+    const nb_float *const acc, size_t acc_count);
 
 
 const nb_float gravity_const = 6.6743015e-11;
 
+nb_calc_settings calc_settings = 
+{
+    NB_INTEGRATOR_EULER, NB_BLOCK_ETA_DEFAULT, 0.0,
+    NB_ENGINE_DIRECT,
+    NB_SIMD_NONE,
+    NB_KERNEL_DIRECT,
+    false, NB_SCHEDULE_STATIC,
+    0, 0,
+    0.5, false,
+    NB_FMM_ORDER_DEFAULT,
+    NB_PM_GRID_DEFAULT, NB_PM_TSC, false,
+    0.0
+};
+
+
+static const char *const _integrator_names[] = {"euler", "leapfrog",
+    "forest-ruth", "yoshida6", "pefrl", "hermite", "block"};
+static const char *const _engine_names[] = {"direct", "barnes-hut", "fmm",
+    "pm"};
+static const char *const _kernel_names[] = {"direct", "symmetric"};
+static const char *const _schedule_names[] = {"static", "guided",
+    "dynamic", "balanced"};
+static const char *const _pm_scheme_names[] = {"cic", "tsc"};
+
+
+const char* nb_integrator_name(nb_integrator integrator)
+{
+    return _integrator_names[integrator];
+}
 
-void nb_euler_singlethread(nb_system *const system, nb_float dt)
+bool nb_integrator_parse(const char *const name,
+    nb_integrator *const integrator)
 {
-    const size_t offset = sizeof(nb_body); // offset to pointers
-    nb_body* bodies = system->bodies;      // vector of bodies
-    size_t count = system->count;          // count of bodies
+    for (size_t i = 0; i < sizeof(_integrator_names) / sizeof(char*); i++)
+    {
+        if (strcmp(name, _integrator_names[i]) == 0)
+        {
+            *integrator = (nb_integrator)i;
+            return true;
+        }
+    }
 
-    // if there are no bodies in the system, then we do nothing    
-    if (count == 0)
-        return;
+    return false;
+}
 
-    // const pointers to array of different components of bodies in system
-    nb_float *const cx = &bodies[0].coords.x;  // "x" coordinates
-    nb_float *const cy = &bodies[0].coords.y;  // "y" coordinates
-    nb_float *const sx = &bodies[0].speed.x;   // "x" component of speed
-    nb_float *const sy = &bodies[0].speed.y;   // "y" component of speed
-    nb_float *const fx = &bodies[0].force.x;   // "x" component of force
-    nb_float *const fy = &bodies[0].force.y;   // "y" component of force
-    nb_float *const mass = &bodies[0].mass;    // mass
-    nb_float *const rad = &bodies[0].radius;   // radius
+const char* nb_engine_name(nb_engine engine)
+{
+    return _engine_names[engine];
+}
 
-    // values of speed after probably collisions
-    nb_float* const sx_new = (nb_float*)system->_calc_buf;
-    nb_float* const sy_new = (nb_float*)system->_calc_buf + count;
-
-    // components of "i" body
-    nb_float* cx_i;
-    nb_float* cy_i;
-    nb_float* sx_i;
-    nb_float* sy_i;
-    nb_float* fx_i;
-    nb_float* fy_i;
-    nb_float* mass_i;
-    nb_float* rad_i;
-
-    // components of "j" body
-    nb_float* cx_j; 
-    nb_float* cy_j;
-    nb_float* sx_j;
-    nb_float* sy_j;
-    nb_float* fx_j;
-    nb_float* fy_j;
-    nb_float* mass_j;
-    nb_float* rad_j;
-
-    // Initializing all total forces for all bodies to 0
-    fx_i = fx;
-    fy_i = fy;
-    for (size_t i = 0; i < count; i++)
+bool nb_engine_parse(const char *const name, nb_engine *const engine)
+{
+    for (size_t i = 0; i < sizeof(_engine_names) / sizeof(char*); i++)
     {
-        *fx_i = 0;
-        *fy_i = 0; 
-
-        fx_i = move_ptr(fx_i, offset);
-        fy_i = move_ptr(fy_i, offset);
+        if (strcmp(name, _engine_names[i]) == 0)
+        {
+            *engine = (nb_engine)i;
+            return true;
+        }
     }
 
-    // Calculate forces for all bodies in system and check probably collisions
-    cx_i = cx;
-    cy_i = cy;
-    sx_i = sx;
-    sy_i = sy;
-    fx_i = fx;
-    fy_i = fy;
-    mass_i = mass;
-    rad_i = rad;
-    for (size_t i = 0; i < count; i++)
-    {
-        // total mass of other bodies, which colided with body "i"
-        nb_float t_mass = 0.0;
-        // total impulse of other bodies, which colided with body "j"
-        nb_float t_impulse_x = 0.0;
-        nb_float t_impulse_y = 0.0;
-        
-        // did the body "i" collide with anyone body
-        bool is_collided = false;
-
-        cx_j = cx; 
-        cy_j = cy;
-        sx_j = sx;
-        sy_j = sy;
-        fx_j = fx;
-        fy_j = fy;
-        mass_j = mass;
-        rad_j = rad;
-
-        // Calculate forces between body "i" and all bodies "j", when j != i
-        for (size_t j = 0; j < count; j++)
-        {
-            if (j == i)
-            {
-                cx_j = move_ptr(cx_j, offset);
-                cy_j = move_ptr(cy_j, offset);
-                sx_j = move_ptr(sx_j, offset);
-                sy_j = move_ptr(sy_j, offset);
-                fx_j = move_ptr(fx_j, offset);
-                fy_j = move_ptr(fy_j, offset);
-                mass_j = move_ptr(mass_j, offset);
-                rad_j = move_ptr(rad_j, offset);
-
-                continue;
-            }
+    return false;
+}
 
-            nb_float dx = (*cx_j) - (*cx_i);
-            nb_float dy = (*cy_j) - (*cy_i);
-
-            // distance between bodies "i" and "j"
-            nb_float distance = (nb_float)sqrtl(dx * dx + dy * dy);
-            
-            // if the bodies collided
-            if (distance <= (*rad_i) + (*rad_j))
-            { 
-                is_collided |= true;
-                t_mass += (*mass_j);
-                t_impulse_x += (*sx_j) * (*mass_j);
-                t_impulse_y += (*sy_j) * (*mass_j);
-            }
 
-            // (dx * dx + dy * dy) ^ (3 / 2)
-            nb_float temp = distance * distance * distance;            
+const char* nb_kernel_name(nb_kernel kernel)
+{
+    return _kernel_names[kernel];
+}
 
-            // scalar part of force
-            nb_float scalar = gravity_const * (*mass_i) * (*mass_j) / temp;
+bool nb_kernel_parse(const char *const name, nb_kernel *const kernel)
+{
+    for (size_t i = 0; i < sizeof(_kernel_names) / sizeof(char*); i++)
+    {
+        if (strcmp(name, _kernel_names[i]) == 0)
+        {
+            *kernel = (nb_kernel)i;
+            return true;
+        }
+    }
 
-            // components of force
-            nb_float fx_c = dx * scalar;
-            nb_float fy_c = dy * scalar;
+    return false;
+}
 
-            // The force acting on the body "i" relative to the body "j"
-            *fx_i += fx_c;
-            *fy_i += fy_c;
+const char* nb_schedule_name(nb_schedule schedule)
+{
+    return _schedule_names[schedule];
+}
 
-            cx_j = move_ptr(cx_j, offset);
-            cy_j = move_ptr(cy_j, offset);
-            sx_j = move_ptr(sx_j, offset);
-            sy_j = move_ptr(sy_j, offset);
-            fx_j = move_ptr(fx_j, offset);
-            fy_j = move_ptr(fy_j, offset);
-            mass_j = move_ptr(mass_j, offset);
-            rad_j = move_ptr(rad_j, offset);
+bool nb_schedule_parse(const char *const name, nb_schedule *const schedule)
+{
+    for (size_t i = 0; i < sizeof(_schedule_names) / sizeof(char*); i++)
+    {
+        if (strcmp(name, _schedule_names[i]) == 0)
+        {
+            *schedule = (nb_schedule)i;
+            return true;
         }
+    }
 
-        // Calculate speed for body "i" after collisions
-        if (is_collided)
-        {
-            nb_float scal1 = ((*mass_i) - t_mass) / ((*mass_i) + t_mass);
-            nb_float scal2 = 2.0 / ((*mass_i) + t_mass);
+    return false;
+}
 
-            sx_new[i] = scal1 * (*sx_i) + scal2 * t_impulse_x;
-            sy_new[i] = scal1 * (*sy_i) + scal2 * t_impulse_y;
-        }
-        // Or record current speed values if there no collisions
-        else
+// Set the schedule of loops with "schedule(runtime)" by the settings. The
+// balanced schedule does not use these loops, but if memory for times of
+// rows can not be allocated, then the static schedule is used instead.
+void nb_schedule_apply()
+{
+    if (calc_settings.schedule == NB_SCHEDULE_GUIDED)
+        omp_set_schedule(omp_sched_guided, 0);
+    else if (calc_settings.schedule == NB_SCHEDULE_DYNAMIC)
+        omp_set_schedule(omp_sched_dynamic, NB_SCHEDULE_CHUNK);
+    else
+        omp_set_schedule(omp_sched_static, 0);
+}
+
+const char* nb_pm_scheme_name(nb_pm_scheme scheme)
+{
+    return _pm_scheme_names[scheme];
+}
+
+bool nb_pm_scheme_parse(const char *const name, nb_pm_scheme *const scheme)
+{
+    for (size_t i = 0; i < sizeof(_pm_scheme_names) / sizeof(char*); i++)
+    {
+        if (strcmp(name, _pm_scheme_names[i]) == 0)
         {
-            sx_new[i] = (*sx_i);
-            sy_new[i] = (*sy_i);
+            *scheme = (nb_pm_scheme)i;
+            return true;
         }
+    }
+
+    return false;
+}
 
-        cx_i = move_ptr(cx_i, offset);
-        cy_i = move_ptr(cy_i, offset);
-        sx_i = move_ptr(sx_i, offset);
-        sy_i = move_ptr(sy_i, offset);
-        fx_i = move_ptr(fx_i, offset);
-        fy_i = move_ptr(fy_i, offset);
-        mass_i = move_ptr(mass_i, offset);
-        rad_i = move_ptr(rad_i, offset);
+void nb_calc_set_row(nb_system *const system, size_t i,
+    const nb_row_acc *const acc)
+{
+    // values of speed after probably collisions
+    nb_float* const sx_new = (nb_float*)system->_calc_buf;
+    nb_float* const sy_new = (nb_float*)system->_calc_buf + system->count;
+
+    nb_float *const sx = system->sx;
+    nb_float *const sy = system->sy;
+    nb_float *const mass = system->mass;
+
+    system->fx[i] = acc->fx;
+    system->fy[i] = acc->fy;
+
+    // Calculate speed for body "i" after collisions
+    if (acc->is_collided)
+    {
+        nb_float scal1 = (mass[i] - acc->t_mass) / (mass[i] + acc->t_mass);
+        nb_float scal2 = 2.0 / (mass[i] + acc->t_mass);
+
+        sx_new[i] = scal1 * sx[i] + scal2 * acc->t_impulse_x;
+        sy_new[i] = scal1 * sy[i] + scal2 * acc->t_impulse_y;
     }
+    // Or record current speed values if there no collisions
+    else
+    {
+        sx_new[i] = sx[i];
+        sy_new[i] = sy[i];
+    }
+}
 
-    // Calculate new speed and new coordinates for all bodies
-    cx_i = cx;
-    cy_i = cy;
-    sx_i = sx;
-    sy_i = sy;
-    fx_i = fx;
-    fy_i = fy;
-    mass_i = mass;
-    for (size_t i = 0; i < count; i++)
+void nb_calc_forces(nb_system *const system, bool parallel)
+{
+    if (system->count == 0)
+        return;
+
+    // if the tree can not be built, then forces are calculated directly
+    if (calc_settings.engine == NB_ENGINE_BARNES_HUT &&
+        nb_barnes_hut_forces(system, parallel))
+    {
+        return;
+    }
+
+    if (calc_settings.engine == NB_ENGINE_FMM &&
+        nb_fmm_forces(system, parallel))
     {
-        // Set new speed after probably collision  
-        *sx_i = sx_new[i];
-        *sy_i = sy_new[i];
-
-        // Values of speed at current time moment
-        nb_float prev_sx_i = *sx_i;
-        nb_float prev_sy_i = *sy_i;
-
-        // Calculate new speed for body "i" through time "dt"
-        *sx_i += dt * (*fx_i) / (*mass_i);
-        *sy_i += dt * (*fy_i) / (*mass_i);
-
-        // Calculate new coordinates for body "i" 
-        *cx_i += dt * prev_sx_i + ((*sx_i) - prev_sx_i) * dt / 2;
-        *cy_i += dt * prev_sy_i + ((*sy_i) - prev_sy_i) * dt / 2;
-
-        cx_i = move_ptr(cx_i, offset);
-        cy_i = move_ptr(cy_i, offset);
-        sx_i = move_ptr(sx_i, offset);
-        sy_i = move_ptr(sy_i, offset);
-        fx_i = move_ptr(fx_i, offset);
-        fy_i = move_ptr(fy_i, offset);
-        mass_i = move_ptr(mass_i, offset);
+        return;
     }
+
+    if (calc_settings.engine == NB_ENGINE_PM &&
+        nb_pm_forces(system, parallel))
+    {
+        return;
+    }
+
+    if (parallel)
+        _nb_calc_forces_multithreading(system);
+    else
+        _nb_calc_forces_singlethread(system);
+}
+
+void nb_euler_singlethread(nb_system *const system, nb_float dt)
+{
+    size_t count = system->count;  // count of bodies
+
+    // if there are no bodies in the system, then we do nothing    
+    if (count == 0)
+        return;
+
+    // Calculate forces for all bodies in system and check probably collisions
+    nb_calc_forces(system, false);
+
+    // Calculate new speed and new coordinates for all bodies
+    for (size_t i = 0; i < count; i++)
+        nb_calc_move(system, i, dt);
     
     system->time += dt;
 }
@@ -221,226 +276,574 @@ void nb_euler_multithreading(nb_system *const system, nb_float dt)
 {
     const size_t max_threads = (size_t)omp_get_max_threads();
 
-    const size_t offset = sizeof(nb_body); // offset to pointers
-    nb_body* bodies = system->bodies;      // vector of bodies
-    size_t count = system->count;          // count of bodies
+    size_t count = system->count;  // count of bodies
 
     // if there are no bodies in the system, then we do nothing    
     if (count == 0)
         return;
 
-    // const pointers to array of different components of bodies in system
-    nb_float *const cx = &bodies[0].coords.x;  // "x" coordinates
-    nb_float *const cy = &bodies[0].coords.y;  // "y" coordinates
-    nb_float *const sx = &bodies[0].speed.x;   // "x" component of speed
-    nb_float *const sy = &bodies[0].speed.y;   // "y" component of speed
-    nb_float *const fx = &bodies[0].force.x;   // "x" component of force
-    nb_float *const fy = &bodies[0].force.y;   // "y" component of force
-    nb_float *const mass = &bodies[0].mass;    // mass
-    nb_float *const rad = &bodies[0].radius;   // radius
+    // Calculate forces for all bodies in system and check probably collisions
+    nb_calc_forces(system, true);
 
-    // values of speed after probably collisions
-    nb_float* const sx_new = (nb_float*)system->_calc_buf;
-    nb_float* const sy_new = (nb_float*)system->_calc_buf + count;
-
-    // components of "i" body
-    nb_float* cx_i;
-    nb_float* cy_i;
-    nb_float* sx_i;
-    nb_float* sy_i;
-    nb_float* fx_i;
-    nb_float* fy_i;
-    nb_float* mass_i;
-    nb_float* rad_i;
-
-    // components of "j" body
-    nb_float* cx_j; 
-    nb_float* cy_j;
-    nb_float* sx_j;
-    nb_float* sy_j;
-    nb_float* fx_j;
-    nb_float* fy_j;
-    nb_float* mass_j;
-    nb_float* rad_j;
-
-    #pragma omp parallel private(cx_i, cy_i, sx_i, sy_i, fx_i, fy_i, mass_i, \
-                                 rad_i, cx_j, cy_j, sx_j, sy_j, fx_j, fy_j, \
-                                 mass_j, rad_j) \
-                         shared(count, dt) \
-                         if (count > max_threads)
+    // Calculate new speed and new coordinates for all bodies
+    #pragma omp parallel for schedule(static) if (count > max_threads)
+    for (size_t i = 0; i < count; i++)
+    {
+        nb_calc_move(system, i, dt);
+
+        #ifdef NB_CALCULATION_DEBUG
+        if (i == 0)
+        {
+            printf("Was the second \"for\" block parallelized: %s.\n", \
+                omp_in_parallel() ? "true" : "false");
+        }
+        #endif
+    }
+    
+    system->time += dt;
+}
+
+// Run "steps" steps of the Euler scheme with the direct kernel in one
+// parallel region, so the team of threads is created once per run. New
+// coordinates and speeds are written to the second set of columns, and
+// the sets are swapped after each step, so a step needs one barrier: all
+// bodies must be moved before they are read by the next step. Returns
+// false, if the settings need other engines or kernels, or memory
+// allocation failed.
+bool nb_euler_run(nb_system *const system, size_t steps, nb_float dt,
+    bool parallel)
+{
+    const size_t max_threads = (size_t)omp_get_max_threads();
+    const size_t count = system->count;
+    nb_system views[2];  // bodies at even and odd steps
+    nb_float* columns;
+    nb_balance* balance;
+    bool is_balanced;
+
+    if (calc_settings.engine != NB_ENGINE_DIRECT ||
+        calc_settings.kernel != NB_KERNEL_DIRECT ||
+        calc_settings.tile_i != 0)
+    {
+        return false;
+    }
+
+    // if there are no bodies in the system, then we do nothing
+    if (count == 0)
+        return true;
+
+    columns = (nb_float*)malloc(sizeof(nb_float) * 4 * count);
+    if (columns == NULL)
+        return false;
+
+    balance = parallel ? nb_balance_get(system) : NULL;
+    is_balanced = balance != NULL &&
+        calc_settings.schedule == NB_SCHEDULE_BALANCED;
+
+    views[0] = *system;
+    views[1] = *system;
+    views[1].cx = columns;
+    views[1].cy = columns + count;
+    views[1].sx = columns + count * 2;
+    views[1].sy = columns + count * 3;
+
+    #pragma omp parallel if (parallel && count > max_threads)
     {
         const size_t threads_count = (size_t)omp_get_num_threads();
+        const size_t thread = (size_t)omp_get_thread_num();
 
-        // Initializing all total forces for all bodies to 0
-        #pragma omp for schedule(static, count / threads_count)
-        for (size_t i = 0; i < count; i++)
+        for (size_t step = 0; step < steps; step++)
         {
-            fx_i = move_ptr(fx, offset * i);
-            fy_i = move_ptr(fy, offset * i);
+            const nb_system *const cur = &views[step % 2];
+            const nb_system *const next = &views[(step + 1) % 2];
+            double start = omp_get_wtime();
+
+            if (is_balanced)
+            {
+                const size_t pass = balance->passes + step;
+                double *const cost = balance->cost[pass % 2];
+                size_t begin, end;
 
-            *fx_i = 0;
-            *fy_i = 0; 
+                nb_balance_range(balance, pass, false, thread,
+                    threads_count, &begin, &end);
 
-            #ifdef NB_CALCULATION_DEBUG
-            if (i == 0)
+                for (size_t i = begin; i < end; i++)
+                {
+                    double row_start = omp_get_wtime();
+
+                    _nb_calc_step(cur, next, i, dt);
+                    cost[i] = omp_get_wtime() - row_start;
+                }
+            }
+            else
             {
-                printf("Was the first \"for\" block parallelized: "
-                    "%s.\n", omp_in_parallel() ? "true" : "false");
+                #pragma omp for schedule(runtime) nowait
+                for (size_t i = 0; i < count; i++)
+                    _nb_calc_step(cur, next, i, dt);
             }
-            #endif
+
+            if (balance != NULL)
+                balance->busy[thread] += omp_get_wtime() - start;
+
+            #pragma omp barrier
         }
+    }
+
+    if (is_balanced)
+        balance->passes += steps;
+
+    if (steps % 2 == 1)
+    {
+        memcpy(system->cx, views[1].cx, sizeof(nb_float) * count);
+        memcpy(system->cy, views[1].cy, sizeof(nb_float) * count);
+        memcpy(system->sx, views[1].sx, sizeof(nb_float) * count);
+        memcpy(system->sy, views[1].sy, sizeof(nb_float) * count);
+    }
+
+    free(columns);
+
+    for (size_t step = 0; step < steps; step++)
+        system->time += dt;
+
+    return true;
+}
+
+// Calculate forces for all bodies by the chosen all-pairs kernel in one
+// thread
+void _nb_calc_forces_singlethread(nb_system *const system)
+{
+    size_t count = system->count;  // count of bodies
+    nb_float* acc = NULL;          // accumulators of symmetric kernel
+
+    if (calc_settings.kernel == NB_KERNEL_SYMMETRIC)
+        acc = _nb_calc_pair_acc(system, 1);
+
+    if (acc != NULL)
+    {
+        memset(acc, 0, sizeof(nb_float) * _PAIR_COUNT * count);
 
-        // Calculate forces for all bodies in system 
-        // and check probably collisions
-        #pragma omp for schedule(static, count / threads_count)
         for (size_t i = 0; i < count; i++)
-        {
-            cx_i = move_ptr(cx, offset * i);
-            cy_i = move_ptr(cy, offset * i);
-            sx_i = move_ptr(sx, offset * i);
-            sy_i = move_ptr(sy, offset * i);
-            fx_i = move_ptr(fx, offset * i);
-            fy_i = move_ptr(fy, offset * i);
-            mass_i = move_ptr(mass, offset * i);
-            rad_i = move_ptr(rad, offset * i);
-
-            // total mass of other bodies, which colided with body "i"
-            nb_float t_mass = 0.0;
-            // total impulse of other bodies, which colided with body "j"
-            nb_float t_impulse_x = 0.0;
-            nb_float t_impulse_y = 0.0;
-            
-            // did the body "i" collide with anyone body
-            bool is_collided = false;
-
-            cx_j = cx; 
-            cy_j = cy;
-            sx_j = sx;
-            sy_j = sy;
-            fx_j = fx;
-            fy_j = fy;
-            mass_j = mass;
-            rad_j = rad;
-
-            // Calculate forces between body "i" and all bodies "j", 
-            // when j != i
-            for (size_t j = 0; j < count; j++)
-            {
-                if (j == i)
-                {
-                    cx_j = move_ptr(cx_j, offset);
-                    cy_j = move_ptr(cy_j, offset);
-                    sx_j = move_ptr(sx_j, offset);
-                    sy_j = move_ptr(sy_j, offset);
-                    fx_j = move_ptr(fx_j, offset);
-                    fy_j = move_ptr(fy_j, offset);
-                    mass_j = move_ptr(mass_j, offset);
-                    rad_j = move_ptr(rad_j, offset);
-
-                    continue;
-                }
+            _nb_calc_pairs(system, i, acc);
 
-                nb_float dx = (*cx_j) - (*cx_i);
-                nb_float dy = (*cy_j) - (*cy_i);
-
-                // distance between bodies "i" and "j"
-                nb_float distance = (nb_float)sqrtl(dx * dx + dy * dy);
-                
-                // if the bodies collided
-                if (distance <= (*rad_i) + (*rad_j))
-                { 
-                    is_collided |= true;
-                    t_mass += (*mass_j);
-                    t_impulse_x += (*sx_j) * (*mass_j);
-                    t_impulse_y += (*sy_j) * (*mass_j);
-                }
+        for (size_t i = 0; i < count; i++)
+            _nb_calc_pairs_sum(system, i, acc, 1);
+    }
+    else if (calc_settings.tile_i != 0)
+    {
+        size_t blocks = (count + calc_settings.tile_i - 1) /
+            calc_settings.tile_i;
 
-                // (dx * dx + dy * dy) ^ (3 / 2)
-                nb_float temp = distance * distance * distance;            
+        for (size_t b = 0; b < blocks; b++)
+            _nb_calc_forces_tile(system, b);
+    }
+    else
+    {
+        for (size_t i = 0; i < count; i++)
+            _nb_calc_forces(system, i);
+    }
+}
 
-                // scalar part of force
-                nb_float scalar = gravity_const * (*mass_i) * (*mass_j) / temp;
+// Calculate forces for all bodies by the chosen all-pairs kernel in
+// multiple threads
+void _nb_calc_forces_multithreading(nb_system *const system)
+{
+    const size_t max_threads = (size_t)omp_get_max_threads();
+    nb_balance *const balance = nb_balance_get(system);
+    const bool is_balanced = balance != NULL &&
+        calc_settings.schedule == NB_SCHEDULE_BALANCED;
 
-                // components of force
-                nb_float fx_c = dx * scalar;
-                nb_float fy_c = dy * scalar;
+    size_t count = system->count;  // count of bodies
+    nb_float* acc = NULL;          // accumulators of symmetric kernel
 
-                // The force acting on the body "i" relative to the body "j"
-                *fx_i += fx_c;
-                *fy_i += fy_c;
+    // Each thread gets its own set of accumulators, which are summed after
+    // all pairs were visited, so no atomic operations are needed
+    if (calc_settings.kernel == NB_KERNEL_SYMMETRIC)
+        acc = _nb_calc_pair_acc(system, max_threads);
 
-                cx_j = move_ptr(cx_j, offset);
-                cy_j = move_ptr(cy_j, offset);
-                sx_j = move_ptr(sx_j, offset);
-                sy_j = move_ptr(sy_j, offset);
-                fx_j = move_ptr(fx_j, offset);
-                fy_j = move_ptr(fy_j, offset);
-                mass_j = move_ptr(mass_j, offset);
-                rad_j = move_ptr(rad_j, offset);
-            }
+    #pragma omp parallel shared(count, acc) if (count > max_threads)
+    {
+        const size_t threads_count = (size_t)omp_get_num_threads();
+        const size_t thread = (size_t)omp_get_thread_num();
+        double start;
 
-            // Calculate speed for body "i" after collisions
-            if (is_collided)
-            {
-                nb_float scal1 = ((*mass_i) - t_mass) / ((*mass_i) + t_mass);
-                nb_float scal2 = 2.0 / ((*mass_i) + t_mass);
+        if (acc != NULL)
+        {
+            nb_float *const thread_acc = acc +
+                _PAIR_COUNT * count * thread;
+
+            memset(thread_acc, 0, sizeof(nb_float) * _PAIR_COUNT * count);
+            #pragma omp barrier
+
+            start = omp_get_wtime();
 
-                sx_new[i] = scal1 * (*sx_i) + scal2 * t_impulse_x;
-                sy_new[i] = scal1 * (*sy_i) + scal2 * t_impulse_y;
+            if (is_balanced)
+            {
+                _nb_calc_rows_balanced(system, balance, true, thread,
+                    threads_count, thread_acc);
+            }
+            // rows have different lengths, so they are dealt in turn
+            else if (calc_settings.schedule == NB_SCHEDULE_STATIC)
+            {
+                #pragma omp for schedule(static, 1) nowait
+                for (size_t i = 0; i < count; i++)
+                    _nb_calc_pairs(system, i, thread_acc);
             }
-            // Or record current speed values if there no collisions
             else
             {
-                sx_new[i] = (*sx_i);
-                sy_new[i] = (*sy_i);
+                #pragma omp for schedule(runtime) nowait
+                for (size_t i = 0; i < count; i++)
+                    _nb_calc_pairs(system, i, thread_acc);
             }
 
-            #ifdef NB_CALCULATION_DEBUG
-            if (i == 0)
+            if (balance != NULL)
+                balance->busy[thread] += omp_get_wtime() - start;
+
+            #pragma omp barrier
+
+            #pragma omp for schedule(static)
+            for (size_t i = 0; i < count; i++)
+                _nb_calc_pairs_sum(system, i, acc, threads_count);
+        }
+        else if (calc_settings.tile_i != 0)
+        {
+            size_t blocks = (count + calc_settings.tile_i - 1) /
+                calc_settings.tile_i;
+
+            // each thread takes whole blocks of bodies "i", so the block
+            // of bodies "j" is shared by all its rows in the cache
+            #pragma omp for schedule(static, 1)
+            for (size_t b = 0; b < blocks; b++)
+                _nb_calc_forces_tile(system, b);
+        }
+        else
+        {
+            start = omp_get_wtime();
+
+            if (is_balanced)
+            {
+                _nb_calc_rows_balanced(system, balance, false, thread,
+                    threads_count, NULL);
+            }
+            else
             {
-                printf("Was the second \"for\" block parallelized: %s.\n", \
-                    omp_in_parallel() ? "true" : "false");
+                #pragma omp for schedule(runtime) nowait
+                for (size_t i = 0; i < count; i++)
+                {
+                    _nb_calc_forces(system, i);
+
+                    #ifdef NB_CALCULATION_DEBUG
+                    if (i == 0)
+                    {
+                        printf("Was the first \"for\" block parallelized: "
+                            "%s.\n", omp_in_parallel() ? "true" : "false");
+                    }
+                    #endif
+                }
             }
-            #endif
+
+            if (balance != NULL)
+                balance->busy[thread] += omp_get_wtime() - start;
         }
+    }
 
-        // Calculate new speed and new coordinates for all bodies
-        #pragma omp for schedule(static, count / threads_count)
-        for (size_t i = 0; i < count; i++)
+    // tiles are not balanced, they keep the static schedule
+    if (is_balanced && (acc != NULL || calc_settings.tile_i == 0))
+        balance->passes++;
+}
+
+// Calculate the rows of "thread" of the balanced schedule and measure
+// their times: rows of the direct kernel or rows of the symmetric kernel
+// with accumulators "acc", if "is_symmetric"
+void _nb_calc_rows_balanced(nb_system *const system,
+    nb_balance *const balance, bool is_symmetric, size_t thread,
+    size_t threads_count, nb_float *const acc)
+{
+    double *const cost = balance->cost[balance->passes % 2];
+    size_t begin, end;
+
+    nb_balance_range(balance, balance->passes, is_symmetric, thread,
+        threads_count, &begin, &end);
+
+    for (size_t i = begin; i < end; i++)
+    {
+        double start = omp_get_wtime();
+
+        if (is_symmetric)
+            _nb_calc_pairs(system, i, acc);
+        else
+            _nb_calc_forces(system, i);
+
+        cost[i] = omp_get_wtime() - start;
+    }
+}
+
+// Calculate total force acting on body "i" and its speed after probably
+// collisions with other bodies
+void _nb_calc_forces(nb_system *const system, size_t i)
+{
+    nb_row_acc acc = {0.0, 0.0, 0.0, 0.0, 0.0, false};
+
+    // Calculate forces between body "i" and all bodies "j", when j != i
+    nb_simd_row(calc_settings.simd, calc_settings.rsqrt, system, i, 0,
+        system->count, &acc);
+
+    nb_calc_set_row(system, i, &acc);
+}
+
+// Calculate forces and speed after collisions for the block of bodies "i"
+// with number "block", passing through the bodies "j" by tiles, which stay
+// in the cache while all rows of the block are evaluated against them
+void _nb_calc_forces_tile(nb_system *const system, size_t block)
+{
+    const size_t count = system->count;
+    const size_t tile_i = calc_settings.tile_i;
+    const size_t tile_j = calc_settings.tile_j;
+    const size_t begin = block * tile_i;
+    const size_t end = (begin + tile_i < count) ? begin + tile_i : count;
+    nb_row_acc acc[NB_TILE_MAX];
+
+    for (size_t i = begin; i < end; i++)
+    {
+        nb_row_acc zero = {0.0, 0.0, 0.0, 0.0, 0.0, false};
+        acc[i - begin] = zero;
+    }
+
+    for (size_t j_begin = 0; j_begin < count; j_begin += tile_j)
+    {
+        size_t j_end = (j_begin + tile_j < count) ? j_begin + tile_j : count;
+
+        for (size_t i = begin; i < end; i++)
         {
-            cx_i = move_ptr(cx, offset * i);
-            cy_i = move_ptr(cy, offset * i);
-            sx_i = move_ptr(sx, offset * i);
-            sy_i = move_ptr(sy, offset * i);
-            fx_i = move_ptr(fx, offset * i);
-            fy_i = move_ptr(fy, offset * i);
-            mass_i = move_ptr(mass, offset * i);
-
-            // Set new speed after probably collision  
-            *sx_i = sx_new[i];
-            *sy_i = sy_new[i];
-
-            // Values of speed at current time moment
-            nb_float prev_sx_i = *sx_i;
-            nb_float prev_sy_i = *sy_i;
-
-            // Calculate new speed for body "i" through time "dt"
-            *sx_i += dt * (*fx_i) / (*mass_i);
-            *sy_i += dt * (*fy_i) / (*mass_i);
-
-            // Calculate new coordinates for body "i" 
-            *cx_i += dt * prev_sx_i + ((*sx_i) - prev_sx_i) * dt / 2;
-            *cy_i += dt * prev_sy_i + ((*sy_i) - prev_sy_i) * dt / 2;
-
-            #ifdef NB_CALCULATION_DEBUG
-            if (i == 0)
-            {
-                printf("Was the third \"for\" block parallelized: %s.\n", \
-                    omp_in_parallel() ? "true" : "false");
-            }
-            #endif
+            nb_simd_row(calc_settings.simd, calc_settings.rsqrt, system, i,
+                j_begin, j_end, &acc[i - begin]);
         }
     }
-    
-    system->time += dt;
+
+    for (size_t i = begin; i < end; i++)
+    {
+        nb_calc_set_row(system, i, &acc[i - begin]);
+    }
 }
+
+// Get "threads" sets of accumulators of the symmetric kernel for the
+// bodies of system. The sets are kept by the system and are allocated
+// again only when the count of bodies or threads grows. Returns NULL and
+// warns once, if the memory can not be allocated (the direct kernel is
+// used instead).
+nb_float* _nb_calc_pair_acc(nb_system *const system, size_t threads)
+{
+    _nb_calc_pair_buf* pairs = (_nb_calc_pair_buf*)system->_pair_buf;
+    const size_t count = system->count;
+
+    if (pairs != NULL && pairs->count == count && pairs->threads >= threads)
+        return pairs->acc;
+
+    // the failure is not repeated at each calculation of the same system
+    if (pairs != NULL && pairs->is_failed && pairs->count == count &&
+        pairs->threads == threads)
+    {
+        return NULL;
+    }
+
+    nb_calc_pairs_destroy(system);
+
+    pairs = (_nb_calc_pair_buf*)calloc(1, sizeof(_nb_calc_pair_buf));
+    if (pairs != NULL)
+    {
+        system->_pair_buf = pairs;
+        pairs->count = count;
+        pairs->threads = threads;
+
+        if (count <= SIZE_MAX / sizeof(nb_float) / _PAIR_COUNT / threads)
+        {
+            pairs->acc = (nb_float*)malloc(sizeof(nb_float) * _PAIR_COUNT *
+                count * threads);
+        }
+
+        if (pairs->acc != NULL)
+            return pairs->acc;
+
+        pairs->is_failed = true;
+    }
+
+    printf("Warning: failed to allocate memory of the symmetric kernel for "
+        "%lu bodies and %lu threads, the direct kernel is used.\n", count,
+        threads);
+    return NULL;
+}
+
+// Visit all pairs (i, j), when j > i, and apply equal and opposite forces
+// and collision impulses to the accumulators of both bodies. The loop is
+// vectorized by compiler, the widest variant is chosen at startup.
+#if defined(__GNUC__) && defined(__x86_64__)
+__attribute__((target_clones("avx512f", "avx2", "default")))
+#endif
+void _nb_calc_pairs(const nb_system *const system, size_t i,
+    nb_float *const acc)
+{
+    const size_t count = system->count;
+
+    const nb_float *const cx = system->cx;
+    const nb_float *const cy = system->cy;
+    const nb_float *const sx = system->sx;
+    const nb_float *const sy = system->sy;
+    const nb_float *const mass = system->mass;
+    const nb_float *const rad = system->radius;
+
+    nb_float *const acc_fx = acc + _PAIR_FX * count;
+    nb_float *const acc_fy = acc + _PAIR_FY * count;
+    nb_float *const acc_mass = acc + _PAIR_MASS * count;
+    nb_float *const acc_ix = acc + _PAIR_IMPULSE_X * count;
+    nb_float *const acc_iy = acc + _PAIR_IMPULSE_Y * count;
+    nb_float *const acc_col = acc + _PAIR_COLLIDED * count;
+
+    nb_float fx_i = 0.0, fy_i = 0.0;
+    nb_float t_mass_i = 0.0, collided_i = 0.0;
+    nb_float t_impulse_x_i = 0.0, t_impulse_y_i = 0.0;
+    const nb_float g_mass_i = gravity_const * mass[i];
+
+    #pragma omp simd reduction(+: fx_i, fy_i, t_mass_i, collided_i, \
+                                  t_impulse_x_i, t_impulse_y_i)
+    for (size_t j = i + 1; j < count; j++)
+    {
+        nb_float dx = cx[j] - cx[i];
+        nb_float dy = cy[j] - cy[i];
+
+        // distance between bodies "i" and "j"
+        nb_float distance = NB_SQRT(dx * dx + dy * dy);
+
+        // 1 if the bodies collided, otherwise 0 (without branch, so the
+        // loop can be vectorized by compiler)
+        nb_float hit = (distance <= rad[i] + rad[j]) ? 1.0 : 0.0;
+
+        t_mass_i += hit * mass[j];
+        t_impulse_x_i += hit * sx[j] * mass[j];
+        t_impulse_y_i += hit * sy[j] * mass[j];
+        collided_i += hit;
+
+        acc_mass[j] += hit * mass[i];
+        acc_ix[j] += hit * sx[i] * mass[i];
+        acc_iy[j] += hit * sy[i] * mass[i];
+        acc_col[j] += hit;
+
+        nb_float scalar = g_mass_i * mass[j] /
+            (distance * distance * distance);
+        nb_float fx_c = dx * scalar;
+        nb_float fy_c = dy * scalar;
+
+        fx_i += fx_c;
+        fy_i += fy_c;
+        acc_fx[j] -= fx_c;
+        acc_fy[j] -= fy_c;
+    }
+
+    acc_fx[i] += fx_i;
+    acc_fy[i] += fy_i;
+    acc_mass[i] += t_mass_i;
+    acc_ix[i] += t_impulse_x_i;
+    acc_iy[i] += t_impulse_y_i;
+    acc_col[i] += collided_i;
+}
+
+// Sum the accumulators of body "i" over "acc_count" sets of accumulators
+// and calculate its force and speed after probably collisions
+void _nb_calc_pairs_sum(nb_system *const system, size_t i,
+    const nb_float *const acc, size_t acc_count)
+{
+    const size_t count = system->count;
+    nb_float sum[_PAIR_COUNT] = {0.0};
+    nb_row_acc row_acc;
+
+    for (size_t t = 0; t < acc_count; t++)
+    {
+        const nb_float *const set = acc + _PAIR_COUNT * count * t;
+
+        for (size_t k = 0; k < _PAIR_COUNT; k++)
+            sum[k] += set[k * count + i];
+    }
+
+    row_acc.fx = sum[_PAIR_FX];
+    row_acc.fy = sum[_PAIR_FY];
+    row_acc.t_mass = sum[_PAIR_MASS];
+    row_acc.t_impulse_x = sum[_PAIR_IMPULSE_X];
+    row_acc.t_impulse_y = sum[_PAIR_IMPULSE_Y];
+    row_acc.is_collided = sum[_PAIR_COLLIDED] > 0.0;
+
+    nb_calc_set_row(system, i, &row_acc);
+}
+
+// Calculate force acting on body "i" of "cur" and its speed after probably
+// collisions, then write its new speed and coordinates through time "dt"
+// to "next". The arithmetic is the same as of "nb_calc_set_row" and
+// "nb_calc_move".
+void _nb_calc_step(const nb_system *const cur,
+    const nb_system *const next, size_t i, nb_float dt)
+{
+    nb_row_acc acc = {0.0, 0.0, 0.0, 0.0, 0.0, false};
+    const nb_float mass_i = cur->mass[i];
+    nb_float sx_i = cur->sx[i], sy_i = cur->sy[i];
+
+    nb_simd_row(calc_settings.simd, calc_settings.rsqrt, cur, i, 0,
+        cur->count, &acc);
+
+    cur->fx[i] = acc.fx;
+    cur->fy[i] = acc.fy;
+
+    // Calculate speed for body "i" after collisions
+    if (acc.is_collided)
+    {
+        nb_float scal1 = (mass_i - acc.t_mass) / (mass_i + acc.t_mass);
+        nb_float scal2 = 2.0 / (mass_i + acc.t_mass);
+
+        sx_i = scal1 * sx_i + scal2 * acc.t_impulse_x;
+        sy_i = scal1 * sy_i + scal2 * acc.t_impulse_y;
+    }
+
+    next->sx[i] = sx_i + dt * acc.fx / mass_i;
+    next->sy[i] = sy_i + dt * acc.fy / mass_i;
+
+    next->cx[i] = cur->cx[i] +
+        (dt * sx_i + (next->sx[i] - sx_i) * dt / 2);
+    next->cy[i] = cur->cy[i] +
+        (dt * sy_i + (next->sy[i] - sy_i) * dt / 2);
+}
+
+void nb_calc_pairs_destroy(nb_system *const system)
+{
+    _nb_calc_pair_buf *const pairs = (_nb_calc_pair_buf*)system->_pair_buf;
+
+    if (pairs == NULL)
+        return;
+
+    free(pairs->acc);
+    free(pairs);
+    system->_pair_buf = NULL;
+}
+
+// Calculate new speed and new coordinates for body "i" through time "dt"
+void nb_calc_move(nb_system *const system, size_t i, nb_float dt)
+{
+    nb_float* const sx_new = (nb_float*)system->_calc_buf;
+    nb_float* const sy_new = (nb_float*)system->_calc_buf + system->count;
+
+    nb_float *const cx = system->cx;
+    nb_float *const cy = system->cy;
+    nb_float *const sx = system->sx;
+    nb_float *const sy = system->sy;
+
+    // Set new speed after probably collision  
+    sx[i] = sx_new[i];
+    sy[i] = sy_new[i];
+
+    // Values of speed at current time moment
+    nb_float prev_sx_i = sx[i];
+    nb_float prev_sy_i = sy[i];
+
+    // Calculate new speed for body "i" through time "dt"
+    sx[i] += dt * system->fx[i] / system->mass[i];
+    sy[i] += dt * system->fy[i] / system->mass[i];
+
+    // Calculate new coordinates for body "i" 
+    cx[i] += dt * prev_sx_i + (sx[i] - prev_sx_i) * dt / 2;
+    cy[i] += dt * prev_sy_i + (sy[i] - prev_sy_i) * dt / 2;
+}
+
@@ -0,0 +1,399 @@
+#include "nb_collision.h"
+
+#include <stdlib.h>
+#include <stdint.h>
+#include <math.h>
+
+#include <omp.h>
+
+
+// maximum absolute index of cell (far bodies share the extreme cells)
+#define NB_COLLISION_CELL_MAX ((nb_float)((int64_t)1 << 60))
+// initial capacity of list of collided bodies of thread
+#define NB_COLLISION_LIST_MIN 64
+
+
+// Spatial hash of bodies. The size of cell is twice the maximum radius,
+// so collided bodies always lie in the same or neighbouring cells. Rows of
+// cells are hashed, and cells of a row go to consecutive buckets, so each
+// row of neighbouring cells is read from one piece of memory.
+typedef struct _nb_collision_grid
+{
+    nb_float cell;            // size of cell
+    unsigned shift;           // shift of hash to index of bucket
+    size_t mask;              // count of buckets minus one (power of two)
+    size_t* first;            // first slot of each bucket
+    size_t* bodies;           // bodies in slots sorted by buckets
+    int64_t* cell_x;          // cells of bodies in slots
+    int64_t* cell_y;
+    nb_float* x;              // coordinates and radii of bodies in slots
+    nb_float* y;
+    nb_float* radius;
+} _nb_collision_grid;
+
+// Collided bodies of one body, which are summed in order of indices
+typedef struct _nb_collision_list
+{
+    size_t* bodies;
+    size_t count;
+    size_t capacity;
+} _nb_collision_list;
+
+
+static bool _nb_collision_build(_nb_collision_grid *const grid,
+    const nb_system *const system, nb_float skin, bool parallel);
+static void _nb_collision_destroy(_nb_collision_grid *const grid);
+static bool _nb_collision_find(const _nb_collision_grid *const grid,
+    const nb_system *const system, size_t slot,
+    _nb_collision_list *const list, nb_row_acc *const acc);
+static size_t _nb_collision_near(const _nb_collision_grid *const grid,
+    size_t slot, nb_float skin, size_t *const bodies);
+static int _nb_collision_compare(const void* a, const void* b);
+static int64_t _nb_collision_cell(const _nb_collision_grid *const grid,
+    nb_float coord);
+static size_t _nb_collision_bucket(const _nb_collision_grid *const grid,
+    int64_t x, int64_t y);
+
+
+// Find collisions of all bodies by spatial hash. Each "accs[i]" receives
+// the collided bodies of body "i", forces are set to zero.
+bool nb_collision_pass(const nb_system *const system, nb_row_acc *const accs,
+    bool parallel)
+{
+    const size_t count = system->count;
+    _nb_collision_grid grid;
+    bool is_failed = false;
+
+    if (!_nb_collision_build(&grid, system, 0.0, parallel))
+        return false;
+
+    #pragma omp parallel if (parallel)
+    {
+        _nb_collision_list list = {NULL, 0, NB_COLLISION_LIST_MIN};
+
+        list.bodies = (size_t*)malloc(sizeof(size_t) * list.capacity);
+
+        // bodies are visited in order of slots, so neighbouring iterations
+        // read the same buckets
+        #pragma omp for schedule(dynamic, 256)
+        for (size_t k = 0; k < count; k++)
+        {
+            nb_row_acc acc = {0.0, 0.0, 0.0, 0.0, 0.0, false};
+
+            if (list.bodies == NULL ||
+                !_nb_collision_find(&grid, system, k, &list, &acc))
+            {
+                #pragma omp atomic write
+                is_failed = true;
+            }
+
+            accs[grid.bodies[k]] = acc;
+        }
+
+        free(list.bodies);
+    }
+
+    _nb_collision_destroy(&grid);
+    return !is_failed;
+}
+
+// Build lists of neighbours of all bodies by spatial hash: the list of
+// body "i" holds bodies "j" within "r_i + r_j + skin" in order of indices
+// in "bodies" from "first[i]" to "first[i + 1]". The memory of "bodies" is
+// reallocated, if its "capacity" is not enough. Returns false, if memory
+// allocation failed.
+bool nb_collision_neighbours(const nb_system *const system, nb_float skin,
+    size_t *const first, size_t **const bodies, size_t *const capacity,
+    bool parallel)
+{
+    const size_t count = system->count;
+    _nb_collision_grid grid;
+
+    if (!_nb_collision_build(&grid, system, skin, parallel))
+        return false;
+
+    // lists are counted at first, then they are filled at their places
+    #pragma omp parallel for schedule(dynamic, 256) if (parallel)
+    for (size_t k = 0; k < count; k++)
+        first[grid.bodies[k] + 1] = _nb_collision_near(&grid, k, skin, NULL);
+
+    first[0] = 0;
+    for (size_t i = 0; i < count; i++)
+        first[i + 1] += first[i];
+
+    if (first[count] > *capacity)
+    {
+        void* mem_p = realloc(*bodies, sizeof(size_t) * first[count]);
+
+        if (mem_p == NULL)
+        {
+            _nb_collision_destroy(&grid);
+            return false;
+        }
+
+        *bodies = (size_t*)mem_p;
+        *capacity = first[count];
+    }
+
+    #pragma omp parallel for schedule(dynamic, 256) if (parallel)
+    for (size_t k = 0; k < count; k++)
+    {
+        size_t i = grid.bodies[k];
+        size_t *const list = *bodies + first[i];
+        size_t list_count = _nb_collision_near(&grid, k, skin, list);
+
+        if (list_count > 1)
+            qsort(list, list_count, sizeof(size_t), _nb_collision_compare);
+    }
+
+    _nb_collision_destroy(&grid);
+    return true;
+}
+
+// Bin bodies of system into the hash table by counting sort, bodies of
+// each bucket stay in order of indices. The size of cell is enlarged by
+// "skin", if neighbours are searched.
+bool _nb_collision_build(_nb_collision_grid *const grid,
+    const nb_system *const system, nb_float skin, bool parallel)
+{
+    const size_t count = system->count;
+    nb_float max_rad = 0.0;
+    size_t* buckets;
+    unsigned bits = 1;
+
+    for (size_t i = 0; i < count; i++)
+    {
+        if (system->radius[i] > max_rad)
+            max_rad = system->radius[i];
+    }
+
+    // bodies without radius collide only at the same point
+    grid->cell = (max_rad > 0.0 || skin > 0.0) ? 2 * max_rad + skin : 1.0;
+
+    while (((size_t)1 << bits) < 2 * count)
+        bits++;
+    grid->mask = ((size_t)1 << bits) - 1;
+    grid->shift = 64 - bits;
+
+    grid->first = (size_t*)calloc(grid->mask + 2, sizeof(size_t));
+    grid->bodies = (size_t*)malloc(sizeof(size_t) * count);
+    grid->cell_x = (int64_t*)malloc(sizeof(int64_t) * count);
+    grid->cell_y = (int64_t*)malloc(sizeof(int64_t) * count);
+    grid->x = (nb_float*)malloc(sizeof(nb_float) * count);
+    grid->y = (nb_float*)malloc(sizeof(nb_float) * count);
+    grid->radius = (nb_float*)malloc(sizeof(nb_float) * count);
+    buckets = (size_t*)malloc(sizeof(size_t) * count);
+
+    if (grid->first == NULL || grid->bodies == NULL ||
+        grid->cell_x == NULL || grid->cell_y == NULL || grid->x == NULL ||
+        grid->y == NULL || grid->radius == NULL || buckets == NULL)
+    {
+        free(buckets);
+        _nb_collision_destroy(grid);
+        return false;
+    }
+
+    #pragma omp parallel for schedule(static) if (parallel)
+    for (size_t i = 0; i < count; i++)
+    {
+        buckets[i] = _nb_collision_bucket(grid,
+            _nb_collision_cell(grid, system->cx[i]),
+            _nb_collision_cell(grid, system->cy[i]));
+    }
+
+    for (size_t i = 0; i < count; i++)
+        grid->first[buckets[i] + 1]++;
+
+    for (size_t b = 0; b <= grid->mask; b++)
+        grid->first[b + 1] += grid->first[b];
+
+    // starts of buckets are advanced while placing bodies, then they are
+    // shifted back by one bucket
+    for (size_t i = 0; i < count; i++)
+        grid->bodies[grid->first[buckets[i]]++] = i;
+
+    for (size_t b = grid->mask + 1; b > 0; b--)
+        grid->first[b] = grid->first[b - 1];
+    grid->first[0] = 0;
+
+    #pragma omp parallel for schedule(static) if (parallel)
+    for (size_t k = 0; k < count; k++)
+    {
+        size_t i = grid->bodies[k];
+
+        grid->x[k] = system->cx[i];
+        grid->y[k] = system->cy[i];
+        grid->radius[k] = system->radius[i];
+        grid->cell_x[k] = _nb_collision_cell(grid, system->cx[i]);
+        grid->cell_y[k] = _nb_collision_cell(grid, system->cy[i]);
+    }
+
+    free(buckets);
+    return true;
+}
+
+void _nb_collision_destroy(_nb_collision_grid *const grid)
+{
+    free(grid->first);
+    free(grid->bodies);
+    free(grid->cell_x);
+    free(grid->cell_y);
+    free(grid->x);
+    free(grid->y);
+    free(grid->radius);
+    grid->first = NULL;
+    grid->bodies = NULL;
+    grid->cell_x = NULL;
+    grid->cell_y = NULL;
+    grid->x = NULL;
+    grid->y = NULL;
+    grid->radius = NULL;
+}
+
+// Find all bodies collided with the body in "slot" in its cell and 8
+// neighbouring cells. Collided bodies are summed in order of their
+// indices, as in the direct kernel. Returns false, if memory allocation
+// failed.
+bool _nb_collision_find(const _nb_collision_grid *const grid,
+    const nb_system *const system, size_t slot,
+    _nb_collision_list *const list, nb_row_acc *const acc)
+{
+    const nb_float x_i = grid->x[slot], y_i = grid->y[slot];
+    const nb_float rad_i = grid->radius[slot];
+
+    list->count = 0;
+
+    for (int64_t dy = -1; dy <= 1; dy++)
+    {
+        for (int64_t dx = -1; dx <= 1; dx++)
+        {
+            int64_t x = grid->cell_x[slot] + dx;
+            int64_t y = grid->cell_y[slot] + dy;
+            size_t bucket = _nb_collision_bucket(grid, x, y);
+
+            for (size_t k = grid->first[bucket];
+                k < grid->first[bucket + 1]; k++)
+            {
+                // the bucket is shared by other cells
+                if (k == slot || grid->cell_x[k] != x ||
+                    grid->cell_y[k] != y)
+                {
+                    continue;
+                }
+
+                nb_float dx_k = grid->x[k] - x_i;
+                nb_float dy_k = grid->y[k] - y_i;
+                nb_float distance = NB_SQRT(dx_k * dx_k + dy_k * dy_k);
+
+                if (distance > rad_i + grid->radius[k])
+                    continue;
+
+                if (list->count == list->capacity)
+                {
+                    size_t new_capacity = list->capacity * 2;
+                    void* mem_p = realloc(list->bodies,
+                        sizeof(size_t) * new_capacity);
+
+                    if (mem_p == NULL)
+                        return false;
+
+                    list->bodies = (size_t*)mem_p;
+                    list->capacity = new_capacity;
+                }
+
+                list->bodies[list->count++] = grid->bodies[k];
+            }
+        }
+    }
+
+    if (list->count > 1)
+    {
+        qsort(list->bodies, list->count, sizeof(size_t),
+            _nb_collision_compare);
+    }
+
+    for (size_t k = 0; k < list->count; k++)
+    {
+        size_t j = list->bodies[k];
+
+        acc->is_collided = true;
+        acc->t_mass += system->mass[j];
+        acc->t_impulse_x += system->sx[j] * system->mass[j];
+        acc->t_impulse_y += system->sy[j] * system->mass[j];
+    }
+
+    return true;
+}
+
+// Find all bodies within "r_i + r_j + skin" of the body in "slot" and
+// write them to "bodies" unless it is NULL. Returns the count of bodies.
+size_t _nb_collision_near(const _nb_collision_grid *const grid,
+    size_t slot, nb_float skin, size_t *const bodies)
+{
+    const nb_float x_i = grid->x[slot], y_i = grid->y[slot];
+    const nb_float rad_i = grid->radius[slot];
+    size_t count = 0;
+
+    for (int64_t dy = -1; dy <= 1; dy++)
+    {
+        for (int64_t dx = -1; dx <= 1; dx++)
+        {
+            int64_t x = grid->cell_x[slot] + dx;
+            int64_t y = grid->cell_y[slot] + dy;
+            size_t bucket = _nb_collision_bucket(grid, x, y);
+
+            for (size_t k = grid->first[bucket];
+                k < grid->first[bucket + 1]; k++)
+            {
+                if (k == slot || grid->cell_x[k] != x ||
+                    grid->cell_y[k] != y)
+                {
+                    continue;
+                }
+
+                nb_float dx_k = grid->x[k] - x_i;
+                nb_float dy_k = grid->y[k] - y_i;
+                nb_float distance = NB_SQRT(dx_k * dx_k + dy_k * dy_k);
+
+                if (distance > rad_i + grid->radius[k] + skin)
+                    continue;
+
+                if (bodies != NULL)
+                    bodies[count] = grid->bodies[k];
+                count++;
+            }
+        }
+    }
+
+    return count;
+}
+
+int _nb_collision_compare(const void* a, const void* b)
+{
+    size_t j_a = *(const size_t*)a, j_b = *(const size_t*)b;
+
+    return (j_a > j_b) - (j_a < j_b);
+}
+
+// Index of cell, which contains the coordinate
+int64_t _nb_collision_cell(const _nb_collision_grid *const grid,
+    nb_float coord)
+{
+    nb_float cell = floor(coord / grid->cell);
+
+    if (cell > NB_COLLISION_CELL_MAX)
+        cell = NB_COLLISION_CELL_MAX;
+    else if (cell < -NB_COLLISION_CELL_MAX)
+        cell = -NB_COLLISION_CELL_MAX;
+
+    return (int64_t)cell;
+}
+
+// Index of bucket of cell: multiplicative hash of row plus column
+size_t _nb_collision_bucket(const _nb_collision_grid *const grid,
+    int64_t x, int64_t y)
+{
+    uint64_t hash = (uint64_t)y * 0x9E3779B97F4A7C15ull;
+
+    return (size_t)((hash >> grid->shift) + (uint64_t)x) & grid->mask;
+}
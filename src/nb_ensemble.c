@@ -0,0 +1,416 @@
+// opendir, readdir and mkdir of POSIX
+#define _POSIX_C_SOURCE 200809L
+
+#include "nb_ensemble.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <errno.h>
+
+#include <dirent.h>
+#include <sys/stat.h>
+
+#include "nb_adaptive.h"
+
+
+// extension of files of systems
+#define NB_ENSEMBLE_EXT ".nb"
+// initial capacity of list of input systems
+#define NB_ENSEMBLE_LIST_MIN 64
+
+
+static bool _nb_ensemble_add(nb_ensemble *const ensemble,
+    size_t *const capacity, const char *const dir, const char *const name);
+static bool _nb_ensemble_read_dir(nb_ensemble *const ensemble, DIR* dir,
+    const char *const path);
+static bool _nb_ensemble_read_list(nb_ensemble *const ensemble,
+    const char *const path);
+static bool _nb_ensemble_check_names(const nb_ensemble *const ensemble);
+static const char* _nb_ensemble_name(const char *const path);
+static bool _nb_ensemble_load(const nb_ensemble *const ensemble, size_t k,
+    nb_system *const system);
+static void _nb_ensemble_vary(nb_system *const system, size_t k,
+    nb_float spread);
+static bool _nb_ensemble_save(const nb_ensemble *const ensemble, size_t k,
+    const nb_system *const system);
+static int _nb_ensemble_compare(const void* a, const void* b);
+static int _nb_ensemble_compare_names(const void* a, const void* b);
+static uint64_t _nb_ensemble_random(uint64_t *const state);
+
+
+// Collect the input systems: "variations" copies of the system in the file
+// "input", if "variations" is not zero, or all files of systems of the
+// directory "input", or the files listed in the text file "input" (one
+// path per line). The directory "output" is created, if it does not
+// exist. Returns false and sets "errno", if something failed.
+bool nb_ensemble_init(nb_ensemble *const ensemble, const char *const input,
+    const char *const output, size_t variations, nb_float spread)
+{
+    DIR* dir;
+    bool status;
+
+    ensemble->inputs = NULL;
+    ensemble->count = 0;
+    ensemble->variations = variations;
+    ensemble->spread = spread;
+    ensemble->output = output;
+    ensemble->format = NB_FORMAT_LEGACY;
+
+    if (mkdir(output, 0777) != 0 && errno != EEXIST)
+        return false;
+    errno = 0;
+
+    if (variations != 0)
+    {
+        size_t capacity = 0;
+
+        status = _nb_ensemble_add(ensemble, &capacity, NULL, input);
+        if (status)
+            ensemble->count = variations;
+    }
+    else if ((dir = opendir(input)) != NULL)
+    {
+        status = _nb_ensemble_read_dir(ensemble, dir, input);
+        closedir(dir);
+    }
+    else
+    {
+        errno = 0;
+        status = _nb_ensemble_read_list(ensemble, input);
+    }
+
+    // each system of files is written under the name of its input file
+    if (status && variations == 0)
+        status = _nb_ensemble_check_names(ensemble);
+
+    if (!status)
+    {
+        int err = errno;
+
+        nb_ensemble_destroy(ensemble);
+        errno = err;
+    }
+
+    return status;
+}
+
+// Model all systems from their times to "end_time" by steps "dt". Each
+// system is read, modeled and written by one thread, threads take systems
+// in turn. Returns the count of systems, which failed.
+size_t nb_ensemble_run(const nb_ensemble *const ensemble,
+    nb_float end_time, nb_float dt, bool parallel)
+{
+    const size_t count = ensemble->count;
+    size_t failed = 0;
+
+    #pragma omp parallel for schedule(dynamic, 1) reduction(+:failed) \
+        if (parallel)
+    for (size_t k = 0; k < count; k++)
+    {
+        nb_system system;
+        nb_adaptive_stats stats;
+        bool is_done;
+
+        errno = 0;
+        nb_system_init_default(&system);
+        if (errno != 0)
+        {
+            failed++;
+            continue;
+        }
+
+        is_done = _nb_ensemble_load(ensemble, k, &system);
+
+        if (is_done && calc_settings.tolerance > 0.0)
+            is_done = nb_adaptive_run(&system, end_time, dt, false, &stats);
+        else if (is_done)
+            nb_system_run_for(&system, end_time, dt, false);
+
+        is_done = is_done && _nb_ensemble_save(ensemble, k, &system);
+        nb_system_destroy(&system);
+
+        if (!is_done)
+            failed++;
+    }
+
+    return failed;
+}
+
+void nb_ensemble_destroy(nb_ensemble *const ensemble)
+{
+    // for variations there is only one path
+    size_t paths = (ensemble->variations != 0 && ensemble->count != 0) ?
+        1 : ensemble->count;
+
+    for (size_t k = 0; k < paths; k++)
+        free(ensemble->inputs[k]);
+
+    free(ensemble->inputs);
+    ensemble->inputs = NULL;
+    ensemble->count = 0;
+}
+
+// Add the path "dir/name" (or "name", if "dir" is NULL) to the inputs
+bool _nb_ensemble_add(nb_ensemble *const ensemble, size_t *const capacity,
+    const char *const dir, const char *const name)
+{
+    size_t size = strlen(name) + ((dir != NULL) ? strlen(dir) + 2 : 1);
+    char* path;
+
+    if (ensemble->count == *capacity)
+    {
+        size_t new_capacity = (*capacity != 0) ? 2 * *capacity :
+            NB_ENSEMBLE_LIST_MIN;
+        void* mem_p = realloc(ensemble->inputs,
+            sizeof(char*) * new_capacity);
+
+        if (mem_p == NULL)
+            return false;
+
+        ensemble->inputs = (char**)mem_p;
+        *capacity = new_capacity;
+    }
+
+    path = (char*)malloc(size);
+    if (path == NULL)
+        return false;
+
+    if (dir != NULL)
+        snprintf(path, size, "%s/%s", dir, name);
+    else
+        snprintf(path, size, "%s", name);
+
+    ensemble->inputs[ensemble->count++] = path;
+    return true;
+}
+
+// All files of systems of the directory in order of names
+bool _nb_ensemble_read_dir(nb_ensemble *const ensemble, DIR* dir,
+    const char *const path)
+{
+    const size_t ext_size = strlen(NB_ENSEMBLE_EXT);
+    size_t capacity = 0;
+    struct dirent* entry;
+
+    while ((entry = readdir(dir)) != NULL)
+    {
+        size_t size = strlen(entry->d_name);
+
+        if (size <= ext_size ||
+            strcmp(entry->d_name + size - ext_size, NB_ENSEMBLE_EXT) != 0)
+        {
+            continue;
+        }
+
+        if (!_nb_ensemble_add(ensemble, &capacity, path, entry->d_name))
+            return false;
+    }
+
+    if (ensemble->count > 1)
+    {
+        qsort(ensemble->inputs, ensemble->count, sizeof(char*),
+            _nb_ensemble_compare);
+    }
+
+    return true;
+}
+
+// Files listed in the text file, empty lines are skipped
+bool _nb_ensemble_read_list(nb_ensemble *const ensemble,
+    const char *const path)
+{
+    FILE* file = fopen(path, "rt");
+    char line[PATH_MAX];
+    size_t capacity = 0;
+    bool status = true;
+
+    if (file == NULL)
+        return false;
+
+    while (status && fgets(line, PATH_MAX, file) != NULL)
+    {
+        size_t size = strcspn(line, "\r\n");
+
+        line[size] = '\0';
+        if (size != 0)
+            status = _nb_ensemble_add(ensemble, &capacity, NULL, line);
+    }
+
+    if (ferror(file))
+        status = false;
+
+    fclose(file);
+    return status;
+}
+
+// Inputs of a list may have the same name in different directories, their
+// outputs would overwrite each other
+bool _nb_ensemble_check_names(const nb_ensemble *const ensemble)
+{
+    const char** names;
+    bool status = true;
+
+    if (ensemble->count < 2)
+        return true;
+
+    names = (const char**)malloc(sizeof(char*) * ensemble->count);
+    if (names == NULL)
+        return false;
+
+    for (size_t k = 0; k < ensemble->count; k++)
+        names[k] = ensemble->inputs[k];
+
+    qsort(names, ensemble->count, sizeof(char*), _nb_ensemble_compare_names);
+
+    for (size_t k = 1; k < ensemble->count && status; k++)
+    {
+        const char* name = _nb_ensemble_name(names[k]);
+
+        if (strcmp(_nb_ensemble_name(names[k - 1]), name) == 0)
+        {
+            printf("Error: systems \"%s\" and \"%s\" would be written to "
+                "the same file \"%s/%s\".\n", names[k - 1], names[k],
+                ensemble->output, name);
+            errno = EEXIST;
+            status = false;
+        }
+    }
+
+    free(names);
+    return status;
+}
+
+// Name of file of the path
+const char* _nb_ensemble_name(const char *const path)
+{
+    const char* name = strrchr(path, '/');
+
+    return (name != NULL) ? name + 1 : path;
+}
+
+// Read the system "k": the input file or the variation "k" of the input
+// system
+bool _nb_ensemble_load(const nb_ensemble *const ensemble, size_t k,
+    nb_system *const system)
+{
+    const char *const path =
+        ensemble->inputs[(ensemble->variations != 0) ? 0 : k];
+    FILE* file = fopen(path, "rb");
+    bool status;
+
+    if (file == NULL)
+    {
+        printf("Error: failed to open file \"%s\".\n", path);
+        return false;
+    }
+
+    errno = 0;
+    status = nb_system_read(system, file);
+    fclose(file);
+
+    if (!status)
+    {
+        printf("Error: failed to read data from file \"%s\".\n", path);
+        return false;
+    }
+
+    if (ensemble->variations != 0)
+        _nb_ensemble_vary(system, k, ensemble->spread);
+
+    return true;
+}
+
+// Scale coordinates and speeds of bodies by random factors from
+// "1 - spread" to "1 + spread". The random numbers depend only on "k", so
+// variations are the same for any count of threads and any run.
+void _nb_ensemble_vary(nb_system *const system, size_t k, nb_float spread)
+{
+    nb_float *const columns[] = {system->cx, system->cy, system->sx,
+        system->sy};
+    uint64_t state = (uint64_t)k;
+
+    // the first variation is the input system itself
+    if (k == 0)
+        return;
+
+    for (size_t c = 0; c < sizeof(columns) / sizeof(columns[0]); c++)
+    {
+        for (size_t i = 0; i < system->count; i++)
+        {
+            // uniform number from -1 to 1 by the upper 53 bits
+            nb_float u = (nb_float)(_nb_ensemble_random(&state) >> 11) /
+                (nb_float)((uint64_t)1 << 52) - 1.0;
+
+            columns[c][i] *= 1.0 + spread * u;
+        }
+    }
+}
+
+// Write the system "k" to the output directory under the name of its
+// input file, variations get their numbers
+bool _nb_ensemble_save(const nb_ensemble *const ensemble, size_t k,
+    const nb_system *const system)
+{
+    const char* input = ensemble->inputs[(ensemble->variations != 0) ? 0 : k];
+    const char* name = _nb_ensemble_name(input);
+    char path[PATH_MAX];
+    FILE* file;
+    bool status;
+
+    if (ensemble->variations != 0)
+    {
+        const size_t ext_size = strlen(NB_ENSEMBLE_EXT);
+        size_t size = strlen(name);
+        int digits = snprintf(NULL, 0, "%lu", ensemble->count - 1);
+
+        // the extension of input file is replaced by the number
+        if (size > ext_size &&
+            strcmp(name + size - ext_size, NB_ENSEMBLE_EXT) == 0)
+        {
+            size -= ext_size;
+        }
+
+        snprintf(path, PATH_MAX, "%s/%.*s-%0*lu%s", ensemble->output,
+            (int)size, name, digits, k, NB_ENSEMBLE_EXT);
+    }
+    else
+        snprintf(path, PATH_MAX, "%s/%s", ensemble->output, name);
+
+    file = fopen(path, "wb");
+    if (file == NULL)
+    {
+        printf("Error: failed to create file \"%s\".\n", path);
+        return false;
+    }
+
+    status = nb_format_write(system, file, ensemble->format);
+    fclose(file);
+
+    if (!status)
+        printf("Error: failed to write data to file \"%s\".\n", path);
+
+    return status;
+}
+
+int _nb_ensemble_compare(const void* a, const void* b)
+{
+    return strcmp(*(char *const *)a, *(char *const *)b);
+}
+
+int _nb_ensemble_compare_names(const void* a, const void* b)
+{
+    return strcmp(_nb_ensemble_name(*(char *const *)a),
+        _nb_ensemble_name(*(char *const *)b));
+}
+
+// Generator "splitmix64" of random numbers
+uint64_t _nb_ensemble_random(uint64_t *const state)
+{
+    uint64_t z = (*state += 0x9E3779B97F4A7C15ull);
+
+    z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ull;
+    z = (z ^ (z >> 27)) * 0x94D049BB133111EBull;
+    return z ^ (z >> 31);
+}
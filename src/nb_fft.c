@@ -0,0 +1,144 @@
+#include "nb_fft.h"
+
+#include <stdlib.h>
+#include <math.h>
+#include <errno.h>
+
+#include <omp.h>
+
+
+static void _nb_fft(nb_float *const re, nb_float *const im, size_t n,
+    const nb_float *const cos_t, const nb_float *const sin_t, bool inverse);
+
+
+// Fast Fourier transform of the square "n" x "n" array of complex numbers
+// in place (rows, then columns). "n" must be a power of two. The inverse
+// transform is divided by "n" * "n". Returns false, if memory allocation
+// failed.
+bool nb_fft_2d(nb_float *const re, nb_float *const im, size_t n,
+    bool inverse, bool parallel)
+{
+    const nb_float pi = 3.14159265358979323846264338327950288;
+    nb_float* table = (nb_float*)malloc(sizeof(nb_float) * n);
+    bool is_failed = false;
+
+    if (table == NULL)
+        return false;
+
+    // twiddle factors: cos(2 * pi * k / n) and sin(2 * pi * k / n)
+    nb_float *const cos_t = table;
+    nb_float *const sin_t = table + n / 2;
+
+    for (size_t k = 0; k < n / 2; k++)
+    {
+        cos_t[k] = cos(2 * pi * k / n);
+        sin_t[k] = sin(2 * pi * k / n);
+    }
+
+    #pragma omp parallel for schedule(static) if (parallel)
+    for (size_t row = 0; row < n; row++)
+        _nb_fft(re + row * n, im + row * n, n, cos_t, sin_t, inverse);
+
+    // columns are copied into contiguous buffers of threads
+    #pragma omp parallel if (parallel)
+    {
+        nb_float* col = (nb_float*)malloc(sizeof(nb_float) * 2 * n);
+
+        if (col == NULL)
+        {
+            #pragma omp atomic write
+            is_failed = true;
+        }
+
+        #pragma omp for schedule(static)
+        for (size_t c = 0; c < n; c++)
+        {
+            if (col == NULL)
+                continue;
+
+            for (size_t row = 0; row < n; row++)
+            {
+                col[row] = re[row * n + c];
+                col[n + row] = im[row * n + c];
+            }
+
+            _nb_fft(col, col + n, n, cos_t, sin_t, inverse);
+
+            for (size_t row = 0; row < n; row++)
+            {
+                re[row * n + c] = col[row];
+                im[row * n + c] = col[n + row];
+            }
+        }
+
+        free(col);
+    }
+
+    free(table);
+
+    if (is_failed)
+    {
+        errno = ENOMEM;
+        return false;
+    }
+
+    if (inverse)
+    {
+        const nb_float scale = 1.0 / ((nb_float)n * n);
+
+        #pragma omp parallel for schedule(static) if (parallel)
+        for (size_t k = 0; k < n * n; k++)
+        {
+            re[k] *= scale;
+            im[k] *= scale;
+        }
+    }
+
+    return true;
+}
+
+// Iterative radix-2 transform of "n" complex numbers in place
+void _nb_fft(nb_float *const re, nb_float *const im, size_t n,
+    const nb_float *const cos_t, const nb_float *const sin_t, bool inverse)
+{
+    const nb_float sign = inverse ? 1.0 : -1.0;
+
+    // permutation of elements by bit-reversed indices
+    for (size_t i = 1, j = 0; i < n; i++)
+    {
+        size_t bit = n >> 1;
+
+        for (; j & bit; bit >>= 1)
+            j ^= bit;
+        j ^= bit;
+
+        if (i < j)
+        {
+            nb_float temp = re[i]; re[i] = re[j]; re[j] = temp;
+            temp = im[i]; im[i] = im[j]; im[j] = temp;
+        }
+    }
+
+    for (size_t len = 2; len <= n; len <<= 1)
+    {
+        const size_t half = len / 2;
+        const size_t step = n / len;
+
+        for (size_t i = 0; i < n; i += len)
+        {
+            for (size_t k = 0; k < half; k++)
+            {
+                nb_float w_re = cos_t[k * step];
+                nb_float w_im = sign * sin_t[k * step];
+                size_t a = i + k, b = i + k + half;
+                nb_float v_re = re[b] * w_re - im[b] * w_im;
+                nb_float v_im = re[b] * w_im + im[b] * w_re;
+
+                re[b] = re[a] - v_re;
+                im[b] = im[a] - v_im;
+                re[a] += v_re;
+                im[a] += v_im;
+            }
+        }
+    }
+}
@@ -0,0 +1,562 @@
+#include "nb_fmm.h"
+
+#include <stdlib.h>
+#include <math.h>
+
+#include <omp.h>
+
+#include "nb_quadtree.h"
+#include "nb_neighbour.h"
+
+
+// maximum count of bodies in the leaf of tree
+#define NB_FMM_LEAF_MAX 32
+// count of coefficients of expansion of the maximum order
+#define NB_FMM_COEF_MAX \
+    ((NB_FMM_ORDER_MAX + 1) * (NB_FMM_ORDER_MAX + 2) / 2)
+// count of tasks of parallel passes per thread
+#define NB_FMM_TASKS_PER_THREAD 8
+
+// index of coefficient of term x^a * y^b in expansion
+#define _FMM_INDEX(a, b) (((a) + (b)) * ((a) + (b) + 1) / 2 + (b))
+
+
+// The potential of bodies is Phi(r) = sum(m_j / |r - r_j|) and the force is
+// F_i = G * m_i * grad(Phi(r_i)). Both expansions are Cartesian Taylor
+// series about the center of mass of cell, truncated at total order "p":
+//   multipole: M_(a,b) = sum(m_j * (-dx_j)^a * (-dy_j)^b),
+//   local:     Phi(c + t) = sum(L_(a,b) * tx^a * ty^b).
+typedef struct _fmm_context
+{
+    const nb_system* system;
+    nb_quadtree tree;
+    size_t order;             // order of expansions
+    size_t coef_count;        // count of coefficients of expansion
+    nb_float theta2;          // square of opening angle
+    nb_float* mult;           // multipole expansions of cells
+    nb_float* local;          // local expansions of cells
+    nb_float* rad;            // radii of cells about their centers of mass
+    nb_row_acc* accs;         // interactions of bodies in order of tree
+    nb_float binom[NB_FMM_ORDER_MAX + 1][NB_FMM_ORDER_MAX + 1];
+} _fmm_context;
+
+
+static bool _fmm_init(_fmm_context *const ctx, const nb_system *const system);
+static void _fmm_destroy(_fmm_context *const ctx);
+static size_t _fmm_frontier(const _fmm_context *const ctx,
+    size_t *const frontier, size_t *const next, size_t *const upper,
+    size_t *const upper_count, size_t tasks);
+static void _fmm_upward(_fmm_context *const ctx, size_t index);
+static void _fmm_moments(_fmm_context *const ctx, size_t index);
+static void _fmm_interact(_fmm_context *const ctx, size_t target,
+    size_t source);
+static void _fmm_m2l(_fmm_context *const ctx, size_t target, size_t source);
+static void _fmm_p2p(_fmm_context *const ctx, size_t target, size_t source);
+static void _fmm_downward(_fmm_context *const ctx, size_t index);
+static void _fmm_derivatives(size_t order, nb_float rx, nb_float ry,
+    nb_float *const deriv);
+
+
+// Calculate forces by the fast multipole method. The upward pass, the
+// interactions of cells and the downward pass are run by subtrees, which
+// are distributed between threads.
+bool nb_fmm_forces(nb_system *const system, bool parallel)
+{
+    const size_t count = system->count;
+    _fmm_context ctx;
+    nb_row_acc* collisions;
+    size_t* lists;
+    size_t *frontier, *upper;
+    size_t frontier_count, upper_count;
+    size_t tasks = 1;
+
+    if (!_fmm_init(&ctx, system))
+        return false;
+
+    lists = (size_t*)malloc(sizeof(size_t) * 3 * ctx.tree.count);
+    if (lists == NULL)
+    {
+        _fmm_destroy(&ctx);
+        return false;
+    }
+
+    collisions = (nb_row_acc*)malloc(sizeof(nb_row_acc) * count);
+    if (collisions == NULL || !nb_neighbour_pass(system, collisions, parallel))
+    {
+        free(collisions);
+        free(lists);
+        _fmm_destroy(&ctx);
+        return false;
+    }
+
+    if (parallel)
+        tasks = NB_FMM_TASKS_PER_THREAD * omp_get_max_threads();
+
+    frontier_count = _fmm_frontier(&ctx, lists, lists + ctx.tree.count,
+        lists + 2 * ctx.tree.count, &upper_count, tasks);
+    frontier = lists;
+    upper = lists + 2 * ctx.tree.count;
+
+    // Upward pass: subtrees of frontier in parallel, then the cells above
+    // the frontier from the deepest ones to root
+    #pragma omp parallel for schedule(dynamic, 1) if (parallel)
+    for (size_t k = 0; k < frontier_count; k++)
+        _fmm_upward(&ctx, frontier[k]);
+
+    for (size_t k = upper_count; k-- > 0;)
+        _fmm_moments(&ctx, upper[k]);
+
+    // Interactions and downward pass: each frontier cell receives
+    // the expansions and the bodies of its subtree only
+    #pragma omp parallel for schedule(dynamic, 1) if (parallel)
+    for (size_t k = 0; k < frontier_count; k++)
+    {
+        _fmm_interact(&ctx, frontier[k], 0);
+        _fmm_downward(&ctx, frontier[k]);
+    }
+
+    #pragma omp parallel for schedule(dynamic, 64) if (parallel)
+    for (size_t k = 0; k < count; k++)
+    {
+        size_t i = ctx.tree.perm[k];
+        nb_row_acc acc = collisions[i];
+        nb_float g_mass_i = gravity_const * system->mass[i];
+
+        acc.fx = g_mass_i * ctx.accs[k].fx;
+        acc.fy = g_mass_i * ctx.accs[k].fy;
+        nb_calc_set_row(system, i, &acc);
+    }
+
+    free(collisions);
+    free(lists);
+    _fmm_destroy(&ctx);
+    return true;
+}
+
+// Build the tree of system and allocate expansions of its cells
+bool _fmm_init(_fmm_context *const ctx, const nb_system *const system)
+{
+    ctx->system = system;
+    ctx->order = calc_settings.fmm_order;
+    ctx->coef_count = (ctx->order + 1) * (ctx->order + 2) / 2;
+    ctx->theta2 = calc_settings.theta * calc_settings.theta;
+
+    for (size_t n = 0; n <= ctx->order; n++)
+    {
+        ctx->binom[n][0] = ctx->binom[n][n] = 1.0;
+        for (size_t k = 1; k < n; k++)
+            ctx->binom[n][k] = ctx->binom[n - 1][k - 1] +
+                ctx->binom[n - 1][k];
+    }
+
+    if (!nb_quadtree_build(&ctx->tree, system, NB_FMM_LEAF_MAX))
+        return false;
+
+    ctx->mult = (nb_float*)malloc(sizeof(nb_float) * ctx->coef_count *
+        ctx->tree.count);
+    ctx->local = (nb_float*)calloc(ctx->coef_count * ctx->tree.count,
+        sizeof(nb_float));
+    ctx->rad = (nb_float*)malloc(sizeof(nb_float) * ctx->tree.count);
+    ctx->accs = (nb_row_acc*)calloc(system->count, sizeof(nb_row_acc));
+
+    if (ctx->mult == NULL || ctx->local == NULL || ctx->rad == NULL ||
+        ctx->accs == NULL)
+    {
+        _fmm_destroy(ctx);
+        return false;
+    }
+
+    return true;
+}
+
+void _fmm_destroy(_fmm_context *const ctx)
+{
+    free(ctx->mult);
+    free(ctx->local);
+    free(ctx->rad);
+    free(ctx->accs);
+    ctx->mult = NULL;
+    ctx->local = NULL;
+    ctx->rad = NULL;
+    ctx->accs = NULL;
+    nb_quadtree_destroy(&ctx->tree);
+}
+
+// Divide the tree by levels, until there are at least "tasks" independent
+// subtrees. Returns the count of roots of subtrees in "frontier", the cells
+// above them are placed into "upper" from root to leaves.
+size_t _fmm_frontier(const _fmm_context *const ctx, size_t *const frontier,
+    size_t *const next, size_t *const upper, size_t *const upper_count,
+    size_t tasks)
+{
+    size_t count = 1;
+
+    frontier[0] = 0;
+    *upper_count = 0;
+
+    while (count < tasks)
+    {
+        size_t next_count = 0;
+        bool is_divided = false;
+
+        for (size_t k = 0; k < count; k++)
+        {
+            const nb_quad_node *const node = &ctx->tree.nodes[frontier[k]];
+
+            if (node->is_leaf)
+            {
+                next[next_count++] = frontier[k];
+                continue;
+            }
+
+            upper[(*upper_count)++] = frontier[k];
+            is_divided = true;
+
+            for (size_t q = 0; q < 4; q++)
+            {
+                if (node->child[q] != 0)
+                    next[next_count++] = node->child[q];
+            }
+        }
+
+        if (!is_divided)
+            break;
+
+        for (size_t k = 0; k < next_count; k++)
+            frontier[k] = next[k];
+        count = next_count;
+    }
+
+    return count;
+}
+
+// Calculate multipole expansions of the subtree "index" from leaves to root
+void _fmm_upward(_fmm_context *const ctx, size_t index)
+{
+    const nb_quad_node *const node = &ctx->tree.nodes[index];
+
+    if (!node->is_leaf)
+    {
+        for (size_t q = 0; q < 4; q++)
+        {
+            if (node->child[q] != 0)
+                _fmm_upward(ctx, node->child[q]);
+        }
+    }
+
+    _fmm_moments(ctx, index);
+}
+
+// Calculate multipole expansion of the cell "index" from its bodies (P2M)
+// or from expansions of its children (M2M)
+void _fmm_moments(_fmm_context *const ctx, size_t index)
+{
+    const nb_system *const system = ctx->system;
+    const nb_quad_node *const node = &ctx->tree.nodes[index];
+    const size_t order = ctx->order;
+    nb_float *const mult = ctx->mult + index * ctx->coef_count;
+    nb_float pow_x[NB_FMM_ORDER_MAX + 1], pow_y[NB_FMM_ORDER_MAX + 1];
+    nb_float rad = 0.0;
+
+    for (size_t c = 0; c < ctx->coef_count; c++)
+        mult[c] = 0.0;
+
+    if (node->is_leaf)
+    {
+        for (size_t k = node->first; k < node->first + node->count; k++)
+        {
+            size_t i = ctx->tree.perm[k];
+            nb_float dx = system->cx[i] - node->mx;
+            nb_float dy = system->cy[i] - node->my;
+            nb_float distance = NB_SQRT(dx * dx + dy * dy);
+
+            if (distance > rad)
+                rad = distance;
+
+            pow_x[0] = pow_y[0] = 1.0;
+            for (size_t n = 1; n <= order; n++)
+            {
+                pow_x[n] = pow_x[n - 1] * -dx;
+                pow_y[n] = pow_y[n - 1] * -dy;
+            }
+
+            for (size_t n = 0; n <= order; n++)
+                for (size_t b = 0; b <= n; b++)
+                    mult[_FMM_INDEX(n - b, b)] +=
+                        system->mass[i] * pow_x[n - b] * pow_y[b];
+        }
+
+        ctx->rad[index] = rad;
+        return;
+    }
+
+    for (size_t q = 0; q < 4; q++)
+    {
+        const size_t child = node->child[q];
+        const nb_float* child_mult;
+
+        if (child == 0)
+            continue;
+
+        nb_float dx = ctx->tree.nodes[child].mx - node->mx;
+        nb_float dy = ctx->tree.nodes[child].my - node->my;
+        nb_float distance = NB_SQRT(dx * dx + dy * dy) + ctx->rad[child];
+
+        if (distance > rad)
+            rad = distance;
+
+        pow_x[0] = pow_y[0] = 1.0;
+        for (size_t n = 1; n <= order; n++)
+        {
+            pow_x[n] = pow_x[n - 1] * -dx;
+            pow_y[n] = pow_y[n - 1] * -dy;
+        }
+
+        // M_(a,b) += C(a,c) * C(b,e) * (-dx)^(a-c) * (-dy)^(b-e) * M'_(c,e)
+        child_mult = ctx->mult + child * ctx->coef_count;
+        for (size_t n = 0; n <= order; n++)
+        {
+            for (size_t b = 0; b <= n; b++)
+            {
+                size_t a = n - b;
+                nb_float sum = 0.0;
+
+                for (size_t c = 0; c <= a; c++)
+                    for (size_t e = 0; e <= b; e++)
+                        sum += ctx->binom[a][c] * ctx->binom[b][e] *
+                            pow_x[a - c] * pow_y[b - e] *
+                            child_mult[_FMM_INDEX(c, e)];
+
+                mult[_FMM_INDEX(a, b)] += sum;
+            }
+        }
+    }
+
+    ctx->rad[index] = rad;
+}
+
+// Dual tree walk: the cell "source" acts on the cell "target". Well
+// separated cells interact by expansions, the other ones are divided.
+void _fmm_interact(_fmm_context *const ctx, size_t target, size_t source)
+{
+    const nb_quad_node *const node_t = &ctx->tree.nodes[target];
+    const nb_quad_node *const node_s = &ctx->tree.nodes[source];
+    nb_float dx = node_t->mx - node_s->mx;
+    nb_float dy = node_t->my - node_s->my;
+    nb_float rad = ctx->rad[target] + ctx->rad[source];
+
+    if (rad * rad < ctx->theta2 * (dx * dx + dy * dy))
+    {
+        _fmm_m2l(ctx, target, source);
+    }
+    else if (node_t->is_leaf && node_s->is_leaf)
+    {
+        _fmm_p2p(ctx, target, source);
+    }
+    else if (node_s->is_leaf ||
+        (!node_t->is_leaf && ctx->rad[target] >= ctx->rad[source]))
+    {
+        for (size_t q = 0; q < 4; q++)
+        {
+            if (node_t->child[q] != 0)
+                _fmm_interact(ctx, node_t->child[q], source);
+        }
+    }
+    else
+    {
+        for (size_t q = 0; q < 4; q++)
+        {
+            if (node_s->child[q] != 0)
+                _fmm_interact(ctx, target, node_s->child[q]);
+        }
+    }
+}
+
+// Translate the multipole expansion of "source" into the local expansion
+// of "target": L_k += sum(C(k+l, k) * D_(k+l) * M_l), |k| + |l| <= p
+void _fmm_m2l(_fmm_context *const ctx, size_t target, size_t source)
+{
+    const size_t order = ctx->order;
+    const nb_float *const mult = ctx->mult + source * ctx->coef_count;
+    nb_float *const local = ctx->local + target * ctx->coef_count;
+    nb_float deriv[NB_FMM_COEF_MAX];
+
+    _fmm_derivatives(order,
+        ctx->tree.nodes[target].mx - ctx->tree.nodes[source].mx,
+        ctx->tree.nodes[target].my - ctx->tree.nodes[source].my, deriv);
+
+    for (size_t n = 0; n <= order; n++)
+    {
+        for (size_t b = 0; b <= n; b++)
+        {
+            size_t a = n - b;
+            nb_float sum = 0.0;
+
+            for (size_t m = 0; m <= order - n; m++)
+                for (size_t e = 0; e <= m; e++)
+                {
+                    size_t c = m - e;
+
+                    sum += ctx->binom[a + c][a] * ctx->binom[b + e][b] *
+                        deriv[_FMM_INDEX(a + c, b + e)] *
+                        mult[_FMM_INDEX(c, e)];
+                }
+
+            local[_FMM_INDEX(a, b)] += sum;
+        }
+    }
+}
+
+// Add the direct interactions of bodies of leaf "source" to the bodies
+// of leaf "target"
+void _fmm_p2p(_fmm_context *const ctx, size_t target, size_t source)
+{
+    const nb_system *const system = ctx->system;
+    const nb_quad_node *const node_t = &ctx->tree.nodes[target];
+    const nb_quad_node *const node_s = &ctx->tree.nodes[source];
+
+    for (size_t k = node_t->first; k < node_t->first + node_t->count; k++)
+    {
+        size_t i = ctx->tree.perm[k];
+        nb_float x_i = system->cx[i], y_i = system->cy[i];
+        nb_float fx = 0.0, fy = 0.0;
+
+        for (size_t l = node_s->first; l < node_s->first + node_s->count; l++)
+        {
+            size_t j = ctx->tree.perm[l];
+
+            if (j == i)
+                continue;
+
+            nb_float dx = system->cx[j] - x_i;
+            nb_float dy = system->cy[j] - y_i;
+            nb_float distance = NB_SQRT(dx * dx + dy * dy);
+            nb_float scalar = system->mass[j] /
+                (distance * distance * distance);
+
+            fx += dx * scalar;
+            fy += dy * scalar;
+        }
+
+        ctx->accs[k].fx += fx;
+        ctx->accs[k].fy += fy;
+    }
+}
+
+// Shift local expansions from the cell "index" to its children (L2L) and
+// evaluate the gradient of potential at bodies of leaves (L2P)
+void _fmm_downward(_fmm_context *const ctx, size_t index)
+{
+    const nb_system *const system = ctx->system;
+    const nb_quad_node *const node = &ctx->tree.nodes[index];
+    const size_t order = ctx->order;
+    const nb_float *const local = ctx->local + index * ctx->coef_count;
+    nb_float pow_x[NB_FMM_ORDER_MAX + 1], pow_y[NB_FMM_ORDER_MAX + 1];
+
+    if (node->is_leaf)
+    {
+        for (size_t k = node->first; k < node->first + node->count; k++)
+        {
+            size_t i = ctx->tree.perm[k];
+            nb_float gx = 0.0, gy = 0.0;
+
+            pow_x[0] = pow_y[0] = 1.0;
+            for (size_t n = 1; n < order; n++)
+            {
+                pow_x[n] = pow_x[n - 1] * (system->cx[i] - node->mx);
+                pow_y[n] = pow_y[n - 1] * (system->cy[i] - node->my);
+            }
+
+            for (size_t n = 1; n <= order; n++)
+                for (size_t b = 0; b <= n; b++)
+                {
+                    size_t a = n - b;
+                    nb_float coef = local[_FMM_INDEX(a, b)];
+
+                    if (a > 0)
+                        gx += a * coef * pow_x[a - 1] * pow_y[b];
+                    if (b > 0)
+                        gy += b * coef * pow_x[a] * pow_y[b - 1];
+                }
+
+            ctx->accs[k].fx += gx;
+            ctx->accs[k].fy += gy;
+        }
+
+        return;
+    }
+
+    for (size_t q = 0; q < 4; q++)
+    {
+        const size_t child = node->child[q];
+        nb_float* child_local;
+
+        if (child == 0)
+            continue;
+
+        nb_float dx = ctx->tree.nodes[child].mx - node->mx;
+        nb_float dy = ctx->tree.nodes[child].my - node->my;
+
+        pow_x[0] = pow_y[0] = 1.0;
+        for (size_t n = 1; n <= order; n++)
+        {
+            pow_x[n] = pow_x[n - 1] * dx;
+            pow_y[n] = pow_y[n - 1] * dy;
+        }
+
+        // L'_(a,b) += C(c,a) * C(e,b) * dx^(c-a) * dy^(e-b) * L_(c,e)
+        child_local = ctx->local + child * ctx->coef_count;
+        for (size_t n = 0; n <= order; n++)
+        {
+            for (size_t b = 0; b <= n; b++)
+            {
+                size_t a = n - b;
+                nb_float sum = 0.0;
+
+                for (size_t m = n; m <= order; m++)
+                    for (size_t e = b; e <= m - a; e++)
+                    {
+                        size_t c = m - e;
+
+                        sum += ctx->binom[c][a] * ctx->binom[e][b] *
+                            pow_x[c - a] * pow_y[e - b] *
+                            local[_FMM_INDEX(c, e)];
+                    }
+
+                child_local[_FMM_INDEX(a, b)] += sum;
+            }
+        }
+
+        _fmm_downward(ctx, child);
+    }
+}
+
+// Calculate Taylor coefficients D_(a,b) = d^(a+b)(1 / |r|) / dx^a dy^b /
+// (a! * b!) at the point (rx, ry) by recurrence on total order "n":
+//   n * r^2 * D_k = -(2n - 1) * (rx * D_(k-ex) + ry * D_(k-ey))
+//                   - (n - 1) * (D_(k-2ex) + D_(k-2ey))
+void _fmm_derivatives(size_t order, nb_float rx, nb_float ry,
+    nb_float *const deriv)
+{
+    nb_float r2 = rx * rx + ry * ry;
+    nb_float inv_r2 = 1.0 / r2;
+
+    deriv[0] = NB_SQRT(inv_r2);
+
+    for (size_t n = 1; n <= order; n++)
+    {
+        for (size_t b = 0; b <= n; b++)
+        {
+            size_t a = n - b;
+            nb_float first = 0.0, second = 0.0;
+
+            if (a > 0) first += rx * deriv[_FMM_INDEX(a - 1, b)];
+            if (b > 0) first += ry * deriv[_FMM_INDEX(a, b - 1)];
+            if (a > 1) second += deriv[_FMM_INDEX(a - 2, b)];
+            if (b > 1) second += deriv[_FMM_INDEX(a, b - 2)];
+
+            deriv[_FMM_INDEX(a, b)] = -((2.0 * n - 1) * first +
+                (n - 1.0) * second) * inv_r2 / n;
+        }
+    }
+}
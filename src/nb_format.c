@@ -0,0 +1,481 @@
+// mmap and file descriptors of POSIX
+#define _POSIX_C_SOURCE 200809L
+
+#include "nb_format.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <errno.h>
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+
+// flag of header: the file holds forces
+#define NB_FORMAT_FORCES 1u
+// written in the byte order of host, so other orders are detected
+#define NB_FORMAT_BYTE_ORDER 0x01020304u
+// count of columns in files with forces
+#define NB_FORMAT_COLUMNS 8
+
+
+// Header of file of columnar format. It is followed by the columns "cx",
+// "cy", "sx", "sy", "fx" and "fy" (if the file holds forces), "mass" and
+// "radius", each of "stride" numbers, and by the table of names: "count
+// + 1" offsets of names from the end of table and the names with zero
+// terminators.
+typedef struct _nb_format_header
+{
+    char magic[NB_FORMAT_MAGIC_SIZE];  // "\x89NB2\r\n\x1a\n"
+    uint32_t version;       // version of format
+    uint32_t float_size;    // size of numbers of columns and time
+    uint32_t flags;         // NB_FORMAT_* flags
+    uint32_t byte_order;    // NB_FORMAT_BYTE_ORDER
+    uint64_t count;         // count of bodies
+    uint64_t stride;        // count of numbers from column to column
+    uint64_t names_offset;  // offset of table of names from file start
+    uint64_t names_size;    // size of table of names
+    unsigned char time[16]; // time of system (first "float_size" bytes)
+    unsigned char reserved[56];  // pads the header to 128 bytes
+} _nb_format_header;
+
+// the columns after the header are aligned to NB_FORMAT_ALIGN bytes
+typedef char _nb_format_header_is_aligned[
+    (sizeof(_nb_format_header) % NB_FORMAT_ALIGN == 0) ? 1 : -1];
+
+// Mapping of file, which holds the columns of system
+typedef struct _nb_format_map
+{
+    void* base;         // start of mapping
+    size_t size;        // size of mapping
+    nb_float* forces;   // forces of system, if the file holds no forces
+} _nb_format_map;
+
+
+static const char _magic[NB_FORMAT_MAGIC_SIZE] = {
+    '\x89', 'N', 'B', '2', '\r', '\n', '\x1a', '\n'
+};
+static const char *const _format_names[] = {"legacy", "v2", "v2-lean"};
+
+
+static bool _nb_format_check(const _nb_format_header *const header,
+    uint64_t file_size);
+static size_t _nb_format_stride(size_t count);
+static void _nb_format_columns(nb_system *const system,
+    nb_float** columns[NB_FORMAT_COLUMNS]);
+static bool _nb_format_read_names(nb_system *const system, size_t count,
+    const uint64_t *const offsets, const char *const names, size_t size);
+
+
+const char* nb_format_name(nb_format format)
+{
+    return _format_names[format];
+}
+
+bool nb_format_parse(const char *const name, nb_format *const format)
+{
+    for (size_t i = 0; i < sizeof(_format_names) / sizeof(char*); i++)
+    {
+        if (strcmp(name, _format_names[i]) == 0)
+        {
+            *format = (nb_format)i;
+            return true;
+        }
+    }
+
+    return false;
+}
+
+// Does the stream start with the magic of columnar format? The position
+// of stream is restored. Streams, which can not be sought (pipes), are
+// not of columnar format, it is read by seeking.
+bool nb_format_is_v2(FILE* stream)
+{
+    const int error = errno;
+    char magic[sizeof(_magic)];
+    long position = ftell(stream);
+    bool is_v2;
+
+    // "errno" of failed "ftell" is not an error of reading
+    if (position < 0)
+    {
+        errno = error;
+        return false;
+    }
+
+    is_v2 = fread(magic, 1, sizeof(magic), stream) == sizeof(magic) &&
+        memcmp(magic, _magic, sizeof(magic)) == 0;
+    fseek(stream, position, SEEK_SET);
+
+    return is_v2;
+}
+
+// Read the system of columnar format from the stream, which is placed
+// after the magic. Returns false and sets "errno" to EINVAL, if the file
+// is of other precision or byte order or it is damaged.
+bool nb_format_read_v2(nb_system *const system, FILE* stream)
+{
+    const long start = ftell(stream) - (long)sizeof(_magic);
+    long end;
+    _nb_format_header header;
+    nb_float** columns[NB_FORMAT_COLUMNS];
+    uint64_t* offsets;
+    char* names;
+    size_t count, padding;
+    bool is_read;
+
+    // the header is checked by the rest of stream, so the count of bodies
+    // is bounded by the size of file
+    if (start < 0 || fseek(stream, 0, SEEK_END) != 0 ||
+        (end = ftell(stream)) < start ||
+        fseek(stream, start + (long)sizeof(_magic), SEEK_SET) != 0)
+    {
+        return false;
+    }
+
+    memcpy(header.magic, _magic, sizeof(_magic));
+    if (fread((char*)&header + sizeof(_magic), sizeof(header) -
+        sizeof(_magic), 1, stream) != 1)
+    {
+        return false;
+    }
+
+    if (!_nb_format_check(&header, (uint64_t)(end - start)))
+    {
+        errno = EINVAL;
+        return false;
+    }
+
+    count = (size_t)header.count;
+    system->count = 0;
+    memcpy(&system->time, header.time, sizeof(nb_float));
+
+    nb_system_reserve(system, count);
+    if (system->capacity < count)
+        return false;
+
+    _nb_format_columns(system, columns);
+    padding = (size_t)(header.stride - header.count);
+    is_read = true;
+
+    for (size_t k = 0; k < NB_FORMAT_COLUMNS && is_read; k++)
+    {
+        nb_float* column = *columns[k];
+
+        // forces are zero, if the file holds no forces
+        if ((k == 4 || k == 5) && !(header.flags & NB_FORMAT_FORCES))
+        {
+            memset(column, 0, sizeof(nb_float) * count);
+            continue;
+        }
+
+        is_read = fread(column, sizeof(nb_float), count, stream) == count &&
+            fseek(stream, (long)(padding * sizeof(nb_float)), SEEK_CUR) == 0;
+    }
+
+    if (!is_read)
+        return false;
+
+    offsets = (uint64_t*)malloc(sizeof(uint64_t) * (count + 1));
+    names = (char*)malloc((size_t)header.names_size + 1);
+
+    is_read = offsets != NULL && names != NULL &&
+        fseek(stream, start + (long)header.names_offset, SEEK_SET) == 0 &&
+        fread(names, 1, (size_t)header.names_size, stream) ==
+        header.names_size;
+
+    if (is_read)
+    {
+        memcpy(offsets, names, sizeof(uint64_t) * (count + 1));
+        is_read = _nb_format_read_names(system, count, offsets,
+            names + sizeof(uint64_t) * (count + 1), (size_t)header.names_size
+            - sizeof(uint64_t) * (count + 1));
+    }
+
+    free(offsets);
+    free(names);
+
+    if (!is_read)
+        return false;
+
+    system->count = count;
+    return true;
+}
+
+// Map the file of columnar format to memory and use its columns as the
+// columns of system in place. The mapping is private, so the changes of
+// system do not reach the file. Only names are copied. Returns false and
+// sets "errno", if the file can not be mapped.
+bool nb_format_map_v2(nb_system *const system, const char *const filename)
+{
+    const _nb_format_header* header;
+    _nb_format_map* map;
+    nb_float** columns[NB_FORMAT_COLUMNS];
+    struct stat status;
+    size_t count, column_size;
+    void* names;
+    nb_float* calc_buf;
+    nb_float time;
+    const char* base;
+    int file;
+
+    file = open(filename, O_RDONLY);
+    if (file < 0)
+        return false;
+
+    map = (_nb_format_map*)calloc(1, sizeof(_nb_format_map));
+    if (map == NULL || fstat(file, &status) != 0 ||
+        (size_t)status.st_size < sizeof(_nb_format_header))
+    {
+        errno = (map == NULL || errno != 0) ? errno : EINVAL;
+        free(map);
+        close(file);
+        return false;
+    }
+
+    map->size = (size_t)status.st_size;
+    map->base = mmap(NULL, map->size, PROT_READ | PROT_WRITE, MAP_PRIVATE,
+        file, 0);
+    close(file);
+
+    if (map->base == MAP_FAILED)
+    {
+        free(map);
+        return false;
+    }
+
+    base = (const char*)map->base;
+    header = (const _nb_format_header*)base;
+
+    if (memcmp(header->magic, _magic, sizeof(_magic)) != 0 ||
+        !_nb_format_check(header, map->size))
+    {
+        munmap(map->base, map->size);
+        free(map);
+        errno = EINVAL;
+        return false;
+    }
+
+    count = (size_t)header->count;
+    memcpy(&time, header->time, sizeof(nb_float));
+
+    // an empty system has nothing to map
+    if (count == 0)
+    {
+        munmap(map->base, map->size);
+        free(map);
+        nb_system_destroy(system);
+        nb_system_init_default(system);
+        system->time = time;
+        return true;
+    }
+
+    column_size = sizeof(nb_float) * (size_t)header->stride;
+
+    // the system needs its own names and buffer of calculation
+    names = malloc(NB_NAME_MAX * (count + 1));
+    calc_buf = (nb_float*)calloc(2 * (count + 1), sizeof(nb_float));
+    if (!(header->flags & NB_FORMAT_FORCES))
+        map->forces = (nb_float*)calloc(2 * (count + 1), sizeof(nb_float));
+
+    if (names == NULL || calc_buf == NULL ||
+        (!(header->flags & NB_FORMAT_FORCES) && map->forces == NULL))
+    {
+        free(names);
+        free(calc_buf);
+        free(map->forces);
+        munmap(map->base, map->size);
+        free(map);
+        return false;
+    }
+
+    nb_system_destroy(system);
+    system->_map_buf = map;
+    system->names = (char (*)[NB_NAME_MAX])names;
+    system->_calc_buf = calc_buf;
+
+    _nb_format_columns(system, columns);
+    base += sizeof(_nb_format_header);
+
+    for (size_t k = 0; k < NB_FORMAT_COLUMNS; k++)
+    {
+        if ((k == 4 || k == 5) && !(header->flags & NB_FORMAT_FORCES))
+        {
+            *columns[k] = map->forces + (k - 4) * (count + 1);
+            continue;
+        }
+
+        *columns[k] = (nb_float*)base;
+        base += column_size;
+    }
+
+    system->time = time;
+    system->capacity = count;
+
+    if (!_nb_format_read_names(system, count, (const uint64_t*)((const char*)
+        map->base + header->names_offset), (const char*)map->base +
+        header->names_offset + sizeof(uint64_t) * (count + 1),
+        (size_t)header->names_size - sizeof(uint64_t) * (count + 1)))
+    {
+        // the system is left empty
+        nb_system_destroy(system);
+        nb_system_init_default(system);
+        errno = EINVAL;
+        return false;
+    }
+
+    system->count = count;
+    return true;
+}
+
+// Release the mapping of file of system. The columns of system are left to
+// the caller.
+void nb_format_unmap(nb_system *const system)
+{
+    _nb_format_map *const map = (_nb_format_map*)system->_map_buf;
+
+    if (map == NULL)
+        return;
+
+    munmap(map->base, map->size);
+    free(map->forces);
+    free(map);
+    system->_map_buf = NULL;
+}
+
+// Write the system in the chosen format
+bool nb_format_write(const nb_system *const system, FILE* stream,
+    nb_format format)
+{
+    const bool is_forces = format == NB_FORMAT_V2;
+    const size_t count = system->count;
+    const size_t stride = _nb_format_stride(count);
+    const nb_float *const columns[NB_FORMAT_COLUMNS] = {
+        system->cx, system->cy, system->sx, system->sy,
+        system->fx, system->fy, system->mass, system->radius
+    };
+    const nb_float zeros[NB_FORMAT_ALIGN] = {0.0};
+    _nb_format_header header;
+    uint64_t offset = 0;
+    bool is_write = true;
+
+    if (format == NB_FORMAT_LEGACY)
+        return nb_system_write(system, stream);
+
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, _magic, sizeof(_magic));
+    header.version = NB_FORMAT_VERSION;
+    header.float_size = sizeof(nb_float);
+    header.flags = is_forces ? NB_FORMAT_FORCES : 0;
+    header.byte_order = NB_FORMAT_BYTE_ORDER;
+    header.count = count;
+    header.stride = stride;
+    header.names_offset = sizeof(header) + sizeof(nb_float) * stride *
+        (is_forces ? NB_FORMAT_COLUMNS : NB_FORMAT_COLUMNS - 2);
+    header.names_size = sizeof(uint64_t) * (count + 1);
+    for (size_t i = 0; i < count; i++)
+        header.names_size += strlen(system->names[i]) + 1;
+    memcpy(header.time, &system->time, sizeof(nb_float));
+
+    is_write &= fwrite(&header, sizeof(header), 1, stream) == 1;
+
+    for (size_t k = 0; k < NB_FORMAT_COLUMNS && is_write; k++)
+    {
+        if ((k == 4 || k == 5) && !is_forces)
+            continue;
+
+        is_write &= fwrite(columns[k], sizeof(nb_float), count, stream) ==
+            count;
+        is_write &= fwrite(zeros, sizeof(nb_float), stride - count, stream)
+            == stride - count;
+    }
+
+    for (size_t i = 0; i <= count && is_write; i++)
+    {
+        is_write &= fwrite(&offset, sizeof(uint64_t), 1, stream) == 1;
+        if (i < count)
+            offset += strlen(system->names[i]) + 1;
+    }
+
+    for (size_t i = 0; i < count && is_write; i++)
+    {
+        size_t size = strlen(system->names[i]) + 1;
+
+        is_write &= fwrite(system->names[i], 1, size, stream) == size;
+    }
+
+    return is_write;
+}
+
+// Check the header of file of "file_size" bytes: version, precision, byte
+// order and sizes of parts
+bool _nb_format_check(const _nb_format_header *const header,
+    uint64_t file_size)
+{
+    const uint64_t columns = (header->flags & NB_FORMAT_FORCES) ?
+        NB_FORMAT_COLUMNS : NB_FORMAT_COLUMNS - 2;
+
+    if (header->version != NB_FORMAT_VERSION ||
+        header->float_size != sizeof(nb_float) ||
+        header->byte_order != NB_FORMAT_BYTE_ORDER ||
+        header->count > SIZE_MAX / NB_NAME_MAX ||
+        header->stride != _nb_format_stride((size_t)header->count))
+    {
+        return false;
+    }
+
+    return header->names_offset == sizeof(_nb_format_header) +
+        sizeof(nb_float) * header->stride * columns &&
+        header->names_size >= sizeof(uint64_t) * (header->count + 1) &&
+        header->names_offset <= file_size &&
+        header->names_size <= file_size - header->names_offset;
+}
+
+// Count of numbers of column with padding to the alignment
+size_t _nb_format_stride(size_t count)
+{
+    const size_t numbers = NB_FORMAT_ALIGN / sizeof(nb_float);
+
+    return (count + numbers - 1) / numbers * numbers;
+}
+
+// Pointers to the columns of system in order of files
+void _nb_format_columns(nb_system *const system,
+    nb_float** columns[NB_FORMAT_COLUMNS])
+{
+    columns[0] = &system->cx;
+    columns[1] = &system->cy;
+    columns[2] = &system->sx;
+    columns[3] = &system->sy;
+    columns[4] = &system->fx;
+    columns[5] = &system->fy;
+    columns[6] = &system->mass;
+    columns[7] = &system->radius;
+}
+
+// Copy the names of system from the table of names. Returns false, if the
+// table is damaged.
+bool _nb_format_read_names(nb_system *const system, size_t count,
+    const uint64_t *const offsets, const char *const names, size_t size)
+{
+    for (size_t i = 0; i < count; i++)
+    {
+        uint64_t begin, end;
+
+        memcpy(&begin, &offsets[i], sizeof(uint64_t));
+        memcpy(&end, &offsets[i + 1], sizeof(uint64_t));
+
+        if (begin >= end || end > size || end - begin > NB_NAME_MAX ||
+            names[end - 1] != '\0')
+        {
+            return false;
+        }
+
+        memcpy(system->names[i], names + begin, (size_t)(end - begin));
+    }
+
+    return true;
+}
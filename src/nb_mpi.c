@@ -0,0 +1,291 @@
+#include "nb_mpi.h"
+
+#ifdef NB_MPI
+
+#include <stdlib.h>
+#include <stdint.h>
+
+#include <mpi.h>
+#include <omp.h>
+
+#include "nb_simd.h"
+
+
+// type of "nb_float" numbers in messages
+#if NB_FLOAT_PRECISION == 1
+#define NB_MPI_FLOAT MPI_FLOAT
+#elif NB_FLOAT_PRECISION == 2
+#define NB_MPI_FLOAT MPI_DOUBLE
+#else
+#define NB_MPI_FLOAT MPI_LONG_DOUBLE
+#endif
+
+// count of columns, which circulate around the ring
+#define NB_MPI_RING_COLUMNS 6
+// count of columns of the result of run
+#define NB_MPI_RESULT_COLUMNS 6
+
+
+// Bodies of one rank. Each circulating column holds the own bodies of rank
+// and two slots of blocks of bodies "j": the block of the current stage of
+// ring and the block, which is received from the previous rank meanwhile.
+typedef struct _nb_mpi_local
+{
+    nb_system view;      // own bodies, the columns go on with slots
+    size_t own;          // count of own bodies
+    size_t slot_size;    // size of slot (the largest slice of ranks)
+    nb_float* columns;   // memory of all columns
+    nb_row_acc* accs;    // sums of rows of own bodies
+} _nb_mpi_local;
+
+
+static bool _nb_mpi_alloc(_nb_mpi_local *const local, size_t own,
+    size_t slot_size);
+static void _nb_mpi_free(_nb_mpi_local *const local);
+static void _nb_mpi_step(_nb_mpi_local *const local, const int *const counts,
+    nb_float dt, bool parallel);
+static void _nb_mpi_slices(size_t count, int *const counts,
+    int *const displs);
+static nb_float** _nb_mpi_column(nb_system *const system, size_t k);
+
+
+// Columns of "nb_system" in order of "_nb_mpi_column": coordinates,
+// speeds, masses and radii circulate, coordinates, speeds and forces are
+// gathered after the run
+static const size_t _ring_columns[NB_MPI_RING_COLUMNS] = {0, 1, 2, 3, 6, 7};
+static const size_t _result_columns[NB_MPI_RESULT_COLUMNS] =
+    {0, 1, 2, 3, 4, 5};
+
+
+int nb_mpi_rank()
+{
+    int rank;
+
+    MPI_Comm_rank(MPI_COMM_WORLD, &rank);
+    return rank;
+}
+
+int nb_mpi_size()
+{
+    int size;
+
+    MPI_Comm_size(MPI_COMM_WORLD, &size);
+    return size;
+}
+
+// Run the system through "steps" steps "dt" of the Euler scheme by all
+// ranks. The system is given on rank 0, it is split into slices of bodies
+// of ranks, and the result is gathered back to rank 0. At each step blocks
+// of bodies "j" circulate around the ring of ranks, and the forces of own
+// bodies are calculated against the current block by threads of OpenMP,
+// while the next block is being received. Returns false on all ranks, if
+// memory allocation failed on any rank.
+bool nb_mpi_run(nb_system *const system, size_t steps, nb_float dt,
+    bool parallel)
+{
+    const int rank = nb_mpi_rank(), size = nb_mpi_size();
+    int* counts = (int*)malloc(sizeof(int) * size);
+    int* displs = (int*)malloc(sizeof(int) * size);
+    uint64_t count = system->count;
+    nb_float time = system->time;
+    _nb_mpi_local local;
+    int is_failed, any_failed;
+
+    MPI_Bcast(&count, 1, MPI_UINT64_T, 0, MPI_COMM_WORLD);
+    MPI_Bcast(&time, 1, NB_MPI_FLOAT, 0, MPI_COMM_WORLD);
+
+    is_failed = counts == NULL || displs == NULL;
+    if (!is_failed)
+    {
+        _nb_mpi_slices(count, counts, displs);
+        is_failed = !_nb_mpi_alloc(&local, counts[rank],
+            (count + size - 1) / size);
+    }
+
+    MPI_Allreduce(&is_failed, &any_failed, 1, MPI_INT, MPI_LOR,
+        MPI_COMM_WORLD);
+
+    if (any_failed)
+    {
+        if (!is_failed)
+            _nb_mpi_free(&local);
+        free(counts);
+        free(displs);
+        return false;
+    }
+
+    for (size_t k = 0; k < NB_MPI_RING_COLUMNS; k++)
+    {
+        const size_t column = _ring_columns[k];
+
+        MPI_Scatterv((rank == 0) ? *_nb_mpi_column(system, column) : NULL,
+            counts, displs, NB_MPI_FLOAT,
+            *_nb_mpi_column(&local.view, column), counts[rank],
+            NB_MPI_FLOAT, 0, MPI_COMM_WORLD);
+    }
+
+    // if there are no bodies in the system, then we do nothing
+    for (size_t step = 0; step < steps && count > 0; step++)
+    {
+        _nb_mpi_step(&local, counts, dt, parallel);
+        time += dt;
+    }
+
+    for (size_t k = 0; k < NB_MPI_RESULT_COLUMNS; k++)
+    {
+        const size_t column = _result_columns[k];
+
+        MPI_Gatherv(*_nb_mpi_column(&local.view, column), counts[rank],
+            NB_MPI_FLOAT, (rank == 0) ? *_nb_mpi_column(system, column) :
+            NULL, counts, displs, NB_MPI_FLOAT, 0, MPI_COMM_WORLD);
+    }
+
+    if (rank == 0)
+        system->time = time;
+
+    _nb_mpi_free(&local);
+    free(counts);
+    free(displs);
+    return true;
+}
+
+// Allocate columns of "own" bodies: circulating columns get two slots of
+// "slot_size" bodies after own bodies
+bool _nb_mpi_alloc(_nb_mpi_local *const local, size_t own,
+    size_t slot_size)
+{
+    const size_t ring_size = own + 2 * slot_size;
+    nb_float* memory;
+
+    local->own = own;
+    local->slot_size = slot_size;
+    local->columns = (nb_float*)malloc(sizeof(nb_float) *
+        (NB_MPI_RING_COLUMNS * ring_size + 4 * own + 1));
+    local->accs = (nb_row_acc*)malloc(sizeof(nb_row_acc) * (own + 1));
+
+    if (local->columns == NULL || local->accs == NULL)
+    {
+        _nb_mpi_free(local);
+        return false;
+    }
+
+    nb_system_init_default(&local->view);
+    memory = local->columns;
+
+    for (size_t k = 0; k < NB_MPI_RING_COLUMNS; k++)
+    {
+        *_nb_mpi_column(&local->view, _ring_columns[k]) = memory;
+        memory += ring_size;
+    }
+
+    local->view.fx = memory;
+    local->view.fy = memory + own;
+    local->view._calc_buf = memory + 2 * own;
+    local->view.count = own;
+    local->view.capacity = own;
+
+    return true;
+}
+
+void _nb_mpi_free(_nb_mpi_local *const local)
+{
+    free(local->columns);
+    free(local->accs);
+    local->columns = NULL;
+    local->accs = NULL;
+}
+
+// One step of the Euler scheme. At stage "s" of the ring the rank holds
+// the block of rank "rank - s": its own bodies at the first stage, then
+// the blocks in slots, which are alternated. The block of the current
+// stage is sent to the next rank, while the forces of own bodies are
+// calculated against it.
+void _nb_mpi_step(_nb_mpi_local *const local, const int *const counts,
+    nb_float dt, bool parallel)
+{
+    const int rank = nb_mpi_rank(), size = nb_mpi_size();
+    const int next = (rank + 1) % size, prev = (rank + size - 1) % size;
+    const size_t own = local->own;
+    nb_system *const view = &local->view;
+    size_t begin = 0;  // first body of the current block in columns
+
+    for (size_t i = 0; i < own; i++)
+    {
+        nb_row_acc zero = {0.0, 0.0, 0.0, 0.0, 0.0, false};
+        local->accs[i] = zero;
+    }
+
+    for (int stage = 0; stage < size; stage++)
+    {
+        const int block_rank = (rank - stage + size) % size;
+        const int next_rank = (block_rank + size - 1) % size;
+        const size_t end = begin + counts[block_rank];
+        const size_t next_begin = own + local->slot_size * (stage % 2);
+        MPI_Request requests[2 * NB_MPI_RING_COLUMNS];
+        int requests_count = 0;
+
+        // the last block is not sent, it has visited all ranks
+        if (stage + 1 < size)
+        {
+            for (size_t k = 0; k < NB_MPI_RING_COLUMNS; k++)
+            {
+                nb_float *const column =
+                    *_nb_mpi_column(view, _ring_columns[k]);
+
+                MPI_Irecv(column + next_begin, counts[next_rank],
+                    NB_MPI_FLOAT, prev, (int)k, MPI_COMM_WORLD,
+                    &requests[requests_count++]);
+                MPI_Isend(column + begin, counts[block_rank], NB_MPI_FLOAT,
+                    next, (int)k, MPI_COMM_WORLD,
+                    &requests[requests_count++]);
+            }
+        }
+
+        // bodies of other blocks have indices after own bodies, so body
+        // "i" is skipped only in its own block
+        #pragma omp parallel for schedule(runtime) if (parallel)
+        for (size_t i = 0; i < own; i++)
+        {
+            nb_simd_row(calc_settings.simd, calc_settings.rsqrt, view, i,
+                begin, end, &local->accs[i]);
+        }
+
+        MPI_Waitall(requests_count, requests, MPI_STATUSES_IGNORE);
+        begin = next_begin;
+    }
+
+    #pragma omp parallel for schedule(static) if (parallel)
+    for (size_t i = 0; i < own; i++)
+    {
+        nb_calc_set_row(view, i, &local->accs[i]);
+        nb_calc_move(view, i, dt);
+    }
+}
+
+// Split "count" bodies into slices of nearly equal size of ranks
+void _nb_mpi_slices(size_t count, int *const counts, int *const displs)
+{
+    const int size = nb_mpi_size();
+
+    for (int r = 0; r < size; r++)
+    {
+        size_t begin = count * r / size;
+        size_t end = count * (r + 1) / size;
+
+        counts[r] = (int)(end - begin);
+        displs[r] = (int)begin;
+    }
+}
+
+// Pointer to the column "k" of system in order of "nb_system"
+nb_float** _nb_mpi_column(nb_system *const system, size_t k)
+{
+    nb_float** columns[] = {
+        &system->cx, &system->cy, &system->sx, &system->sy,
+        &system->fx, &system->fy, &system->mass, &system->radius
+    };
+
+    return columns[k];
+}
+
+#endif
@@ -0,0 +1,182 @@
+#include "nb_neighbour.h"
+
+#include <stdlib.h>
+#include <math.h>
+
+#include "nb_collision.h"
+
+
+static nb_neighbour* _nb_neighbour_get(nb_system *const system);
+static bool _nb_neighbour_is_moved(const nb_neighbour *const lists,
+    const nb_system *const system, bool parallel);
+static bool _nb_neighbour_build(nb_neighbour *const lists,
+    const nb_system *const system, bool parallel);
+
+
+// Find collisions of all bodies as "nb_collision_pass" does, but only the
+// pairs of the lists of neighbours are tested. Lists are rebuilt, if some
+// body has moved more than half the skin since the last build. Without
+// the skin collisions are found by the spatial hash at each pass.
+bool nb_neighbour_pass(nb_system *const system, nb_row_acc *const accs,
+    bool parallel)
+{
+    const size_t count = system->count;
+    nb_neighbour* lists;
+
+    if (calc_settings.skin <= 0.0)
+        return nb_collision_pass(system, accs, parallel);
+
+    lists = _nb_neighbour_get(system);
+    if (lists == NULL)
+        return false;
+
+    if (!lists->is_valid || _nb_neighbour_is_moved(lists, system, parallel))
+    {
+        if (!_nb_neighbour_build(lists, system, parallel))
+            return false;
+    }
+
+    lists->passes++;
+
+    // collided bodies are summed in order of indices, as by the hash
+    #pragma omp parallel for schedule(dynamic, 256) if (parallel)
+    for (size_t i = 0; i < count; i++)
+    {
+        const nb_float x_i = system->cx[i], y_i = system->cy[i];
+        const nb_float rad_i = system->radius[i];
+        nb_row_acc acc = {0.0, 0.0, 0.0, 0.0, 0.0, false};
+
+        for (size_t k = lists->first[i]; k < lists->first[i + 1]; k++)
+        {
+            size_t j = lists->bodies[k];
+            nb_float dx = system->cx[j] - x_i;
+            nb_float dy = system->cy[j] - y_i;
+            nb_float distance = NB_SQRT(dx * dx + dy * dy);
+
+            if (distance > rad_i + system->radius[j])
+                continue;
+
+            acc.is_collided = true;
+            acc.t_mass += system->mass[j];
+            acc.t_impulse_x += system->sx[j] * system->mass[j];
+            acc.t_impulse_y += system->sy[j] * system->mass[j];
+        }
+
+        accs[i] = acc;
+    }
+
+    return true;
+}
+
+// Reset counts of builds and passes at the start of run. The bodies may be
+// changed between runs, so the lists are rebuilt at the first pass.
+void nb_neighbour_reset(nb_system *const system)
+{
+    nb_neighbour *const lists = (nb_neighbour*)system->_neighbour_buf;
+
+    if (lists == NULL)
+        return;
+
+    lists->is_valid = false;
+    lists->builds = 0;
+    lists->passes = 0;
+}
+
+void nb_neighbour_destroy(nb_system *const system)
+{
+    nb_neighbour *const lists = (nb_neighbour*)system->_neighbour_buf;
+
+    if (lists == NULL)
+        return;
+
+    free(lists->first);
+    free(lists->bodies);
+    free(lists->x);
+    free(lists->y);
+    free(lists);
+    system->_neighbour_buf = NULL;
+}
+
+// Get the lists of system for its count of bodies. They are created on the
+// first request, so copies of system get their own lists. Returns NULL, if
+// memory allocation failed.
+nb_neighbour* _nb_neighbour_get(nb_system *const system)
+{
+    nb_neighbour* lists = (nb_neighbour*)system->_neighbour_buf;
+
+    if (lists != NULL && lists->count == system->count)
+        return lists;
+
+    nb_neighbour_destroy(system);
+
+    lists = (nb_neighbour*)calloc(1, sizeof(nb_neighbour));
+    if (lists == NULL)
+        return NULL;
+
+    system->_neighbour_buf = lists;
+    lists->count = system->count;
+    lists->first = (size_t*)malloc(sizeof(size_t) * (system->count + 1));
+    lists->x = (nb_float*)malloc(sizeof(nb_float) * (system->count + 1));
+    lists->y = (nb_float*)malloc(sizeof(nb_float) * (system->count + 1));
+
+    if (lists->first == NULL || lists->x == NULL || lists->y == NULL)
+    {
+        nb_neighbour_destroy(system);
+        return NULL;
+    }
+
+    return lists;
+}
+
+// Has some body moved more than half the skin since the build of lists?
+// The skin may be changed between runs too.
+bool _nb_neighbour_is_moved(const nb_neighbour *const lists,
+    const nb_system *const system, bool parallel)
+{
+    const size_t count = system->count;
+    const nb_float half_skin = lists->skin / 2;
+    bool is_moved = lists->skin != calc_settings.skin;
+
+    #pragma omp parallel for schedule(static) reduction(||:is_moved) \
+        if (parallel)
+    for (size_t i = 0; i < count; i++)
+    {
+        nb_float dx = system->cx[i] - lists->x[i];
+        nb_float dy = system->cy[i] - lists->y[i];
+
+        is_moved = is_moved || dx * dx + dy * dy > half_skin * half_skin;
+    }
+
+    return is_moved;
+}
+
+bool _nb_neighbour_build(nb_neighbour *const lists,
+    const nb_system *const system, bool parallel)
+{
+    const size_t count = system->count;
+    size_t max_list = 0;
+
+    lists->is_valid = false;
+    lists->skin = calc_settings.skin;
+
+    if (!nb_collision_neighbours(system, lists->skin, lists->first,
+        &lists->bodies, &lists->capacity, parallel))
+    {
+        return false;
+    }
+
+    for (size_t i = 0; i < count; i++)
+    {
+        lists->x[i] = system->cx[i];
+        lists->y[i] = system->cy[i];
+
+        if (lists->first[i + 1] - lists->first[i] > max_list)
+            max_list = lists->first[i + 1] - lists->first[i];
+    }
+
+    lists->is_valid = true;
+    lists->builds++;
+    lists->pairs = lists->first[count];
+    lists->max_list = max_list;
+    return true;
+}
@@ -0,0 +1,247 @@
+// sched_setaffinity and CPU_* macros of Linux
+#define _GNU_SOURCE
+
+#include "nb_numa.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <omp.h>
+
+#if defined(__linux__)
+#include <sched.h>
+#include <dirent.h>
+#endif
+
+
+// maximum count of logical processors, which are considered
+#define NB_NUMA_CPUS_MAX 1024
+
+
+// Physical core: the first available logical processor of the core
+typedef struct _nb_numa_core
+{
+    int package;
+    int core;
+    int cpu;
+} _nb_numa_core;
+
+
+static size_t _nb_numa_cores(_nb_numa_core *const cores,
+    size_t *const cpus, size_t *const packages);
+static bool _nb_numa_read_int(int cpu, const char *const name,
+    int *const value);
+static int _nb_numa_compare(const void* a, const void* b);
+
+
+// processors of threads after pinning, -1 if threads are not pinned
+static int _thread_cpus[NB_NUMA_CPUS_MAX];
+static size_t _pinned_count = 0;
+
+
+// Get the topology of processors available to the program from "sysfs".
+// Returns false, if it is not known on this platform.
+bool nb_numa_topology(nb_topology *const topology)
+{
+#if defined(__linux__)
+    _nb_numa_core* cores;
+    DIR* dir;
+    struct dirent* entry;
+
+    cores = (_nb_numa_core*)malloc(sizeof(_nb_numa_core) *
+        NB_NUMA_CPUS_MAX);
+    if (cores == NULL)
+        return false;
+
+    topology->cores = _nb_numa_cores(cores, &topology->cpus,
+        &topology->packages);
+    free(cores);
+
+    if (topology->cores == 0)
+        return false;
+
+    // nodes are the directories "nodeN" of the system
+    topology->nodes = 0;
+    dir = opendir("/sys/devices/system/node");
+    if (dir != NULL)
+    {
+        while ((entry = readdir(dir)) != NULL)
+        {
+            int node;
+
+            if (sscanf(entry->d_name, "node%d", &node) == 1)
+                topology->nodes++;
+        }
+
+        closedir(dir);
+    }
+
+    if (topology->nodes == 0)
+        topology->nodes = 1;
+
+    return true;
+#else
+    (void)topology;
+    return false;
+#endif
+}
+
+// Pin each thread of OpenMP to its own physical core: thread "t" gets the
+// first logical processor of the core "t" (cores are ordered by packages),
+// SMT siblings are skipped. If there are more threads than cores, then
+// cores are dealt in turn. Threads of OpenMP are kept between parallel
+// regions, so they stay pinned. Returns false, if pinning is not supported
+// or failed.
+bool nb_numa_pin_threads()
+{
+#if defined(__linux__)
+    _nb_numa_core* cores;
+    size_t cores_count, cpus, packages;
+    bool is_failed = false;
+
+    cores = (_nb_numa_core*)malloc(sizeof(_nb_numa_core) *
+        NB_NUMA_CPUS_MAX);
+    if (cores == NULL)
+        return false;
+
+    cores_count = _nb_numa_cores(cores, &cpus, &packages);
+    if (cores_count == 0)
+    {
+        free(cores);
+        return false;
+    }
+
+    _pinned_count = 0;
+
+    #pragma omp parallel
+    {
+        const size_t thread = (size_t)omp_get_thread_num();
+        const int cpu = cores[thread % cores_count].cpu;
+        cpu_set_t set;
+
+        CPU_ZERO(&set);
+        CPU_SET(cpu, &set);
+
+        if (thread >= NB_NUMA_CPUS_MAX ||
+            sched_setaffinity(0, sizeof(cpu_set_t), &set) != 0)
+        {
+            #pragma omp atomic write
+            is_failed = true;
+        }
+        else
+            _thread_cpus[thread] = cpu;
+
+        #pragma omp single
+        _pinned_count = (size_t)omp_get_num_threads();
+    }
+
+    free(cores);
+
+    if (is_failed)
+        _pinned_count = 0;
+
+    return !is_failed;
+#else
+    return false;
+#endif
+}
+
+// Processor of the pinned thread, -1 if threads are not pinned
+int nb_numa_thread_cpu(size_t thread)
+{
+    return (thread < _pinned_count) ? _thread_cpus[thread] : -1;
+}
+
+#if defined(__linux__)
+// Find the physical cores of logical processors, which the program may use,
+// sorted by packages and cores. Returns the count of cores.
+size_t _nb_numa_cores(_nb_numa_core *const cores, size_t *const cpus,
+    size_t *const packages)
+{
+    cpu_set_t allowed;
+    size_t count = 0;
+
+    *cpus = 0;
+    *packages = 0;
+
+    if (sched_getaffinity(0, sizeof(cpu_set_t), &allowed) != 0)
+        return 0;
+
+    for (int cpu = 0; cpu < CPU_SETSIZE && cpu < NB_NUMA_CPUS_MAX; cpu++)
+    {
+        _nb_numa_core core;
+        bool is_new = true;
+
+        if (!CPU_ISSET(cpu, &allowed))
+            continue;
+
+        (*cpus)++;
+
+        // without topology each logical processor is a core
+        if (!_nb_numa_read_int(cpu, "physical_package_id", &core.package))
+            core.package = 0;
+        if (!_nb_numa_read_int(cpu, "core_id", &core.core))
+            core.core = cpu;
+        core.cpu = cpu;
+
+        // processors are visited in order, so the first one of the core
+        // is kept
+        for (size_t k = 0; k < count; k++)
+        {
+            if (cores[k].package == core.package &&
+                cores[k].core == core.core)
+            {
+                is_new = false;
+                break;
+            }
+        }
+
+        if (is_new)
+            cores[count++] = core;
+    }
+
+    qsort(cores, count, sizeof(_nb_numa_core), _nb_numa_compare);
+
+    for (size_t k = 0; k < count; k++)
+    {
+        if (k == 0 || cores[k].package != cores[k - 1].package)
+            (*packages)++;
+    }
+
+    return count;
+}
+
+// Read the integer "name" of topology of logical processor "cpu"
+bool _nb_numa_read_int(int cpu, const char *const name, int *const value)
+{
+    char path[PATH_MAX];
+    FILE* file;
+    bool is_read;
+
+    snprintf(path, sizeof(path),
+        "/sys/devices/system/cpu/cpu%d/topology/%s", cpu, name);
+
+    file = fopen(path, "r");
+    if (file == NULL)
+        return false;
+
+    is_read = fscanf(file, "%d", value) == 1;
+    fclose(file);
+
+    return is_read;
+}
+
+int _nb_numa_compare(const void* a, const void* b)
+{
+    const _nb_numa_core *const core_a = (const _nb_numa_core*)a;
+    const _nb_numa_core *const core_b = (const _nb_numa_core*)b;
+
+    if (core_a->package != core_b->package)
+        return (core_a->package > core_b->package) ? 1 : -1;
+    if (core_a->core != core_b->core)
+        return (core_a->core > core_b->core) ? 1 : -1;
+
+    return 0;
+}
+#endif
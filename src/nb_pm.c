@@ -0,0 +1,371 @@
+#include "nb_pm.h"
+
+#include <stdlib.h>
+#include <math.h>
+
+#include <omp.h>
+
+#include "nb_fft.h"
+#include "nb_neighbour.h"
+
+
+// count of empty cells between bodies and edges of isolated mesh
+#define NB_PM_MARGIN 4
+
+
+// Particle-mesh of system. The potential Phi(r) = sum(m_j / |r - r_j|)
+// is found at nodes by FFT, the force is F_i = G * m_i * grad(Phi(r_i)).
+typedef struct _pm_mesh
+{
+    size_t n;                 // count of nodes along axis
+    size_t fft_n;             // size of transform (2 * n for isolated mesh)
+    bool periodic;
+    nb_pm_scheme scheme;
+    nb_float x0, y0;          // coordinates of node (0, 0)
+    nb_float h;               // size of cell
+    nb_float* re;             // masses at nodes, then potential
+    nb_float* im;
+    nb_float* gx;             // gradient of potential at nodes
+    nb_float* gy;
+} _pm_mesh;
+
+
+static bool _pm_init(_pm_mesh *const mesh, const nb_system *const system);
+static void _pm_destroy(_pm_mesh *const mesh);
+static size_t _pm_weights(const _pm_mesh *const mesh, nb_float u,
+    ptrdiff_t *const first, nb_float *const weights);
+static size_t _pm_node(const _pm_mesh *const mesh, ptrdiff_t index);
+static void _pm_assign(_pm_mesh *const mesh, const nb_system *const system);
+static bool _pm_potential(_pm_mesh *const mesh, bool parallel);
+static bool _pm_potential_isolated(_pm_mesh *const mesh, bool parallel);
+static void _pm_gradient(_pm_mesh *const mesh, bool parallel);
+static void _pm_forces(const _pm_mesh *const mesh,
+    const nb_system *const system, size_t i, nb_row_acc *const acc);
+
+
+// Calculate forces by the particle-mesh method
+bool nb_pm_forces(nb_system *const system, bool parallel)
+{
+    const size_t count = system->count;
+    _pm_mesh mesh;
+    nb_row_acc* accs;
+
+    if (!_pm_init(&mesh, system))
+        return false;
+
+    _pm_assign(&mesh, system);
+
+    if (!_pm_potential(&mesh, parallel))
+    {
+        _pm_destroy(&mesh);
+        return false;
+    }
+
+    _pm_gradient(&mesh, parallel);
+
+    accs = (nb_row_acc*)malloc(sizeof(nb_row_acc) * count);
+    if (accs == NULL || !nb_neighbour_pass(system, accs, parallel))
+    {
+        free(accs);
+        _pm_destroy(&mesh);
+        return false;
+    }
+
+    #pragma omp parallel for schedule(dynamic, 64) if (parallel)
+    for (size_t i = 0; i < count; i++)
+    {
+        nb_row_acc acc = accs[i];
+
+        _pm_forces(&mesh, system, i, &acc);
+        nb_calc_set_row(system, i, &acc);
+    }
+
+    free(accs);
+    _pm_destroy(&mesh);
+    return true;
+}
+
+// Place the mesh over the bounding square of bodies and allocate it.
+// The isolated mesh leaves empty cells at its edges, the periodic mesh
+// leaves one cell between the opposite sides of the square.
+bool _pm_init(_pm_mesh *const mesh, const nb_system *const system)
+{
+    nb_float min_x = system->cx[0], max_x = system->cx[0];
+    nb_float min_y = system->cy[0], max_y = system->cy[0];
+    nb_float size;
+
+    mesh->n = calc_settings.pm_grid;
+    mesh->periodic = calc_settings.pm_periodic;
+    mesh->scheme = calc_settings.pm_scheme;
+    mesh->fft_n = mesh->periodic ? mesh->n : 2 * mesh->n;
+
+    for (size_t i = 1; i < system->count; i++)
+    {
+        if (system->cx[i] < min_x) min_x = system->cx[i];
+        if (system->cx[i] > max_x) max_x = system->cx[i];
+        if (system->cy[i] < min_y) min_y = system->cy[i];
+        if (system->cy[i] > max_y) max_y = system->cy[i];
+    }
+
+    size = (max_x - min_x > max_y - min_y) ? max_x - min_x : max_y - min_y;
+    size = (size > 0.0) ? size : 1.0;
+
+    if (mesh->periodic)
+    {
+        mesh->h = size / (mesh->n - 1);
+        mesh->x0 = min_x;
+        mesh->y0 = min_y;
+    }
+    else
+    {
+        mesh->h = size / (mesh->n - 2 * NB_PM_MARGIN - 1);
+        mesh->x0 = (min_x + max_x - size) / 2 - NB_PM_MARGIN * mesh->h;
+        mesh->y0 = (min_y + max_y - size) / 2 - NB_PM_MARGIN * mesh->h;
+    }
+
+    mesh->re = (nb_float*)calloc(mesh->fft_n * mesh->fft_n, sizeof(nb_float));
+    mesh->im = (nb_float*)calloc(mesh->fft_n * mesh->fft_n, sizeof(nb_float));
+    mesh->gx = (nb_float*)calloc(mesh->n * mesh->n, sizeof(nb_float));
+    mesh->gy = (nb_float*)calloc(mesh->n * mesh->n, sizeof(nb_float));
+
+    if (mesh->re == NULL || mesh->im == NULL || mesh->gx == NULL ||
+        mesh->gy == NULL)
+    {
+        _pm_destroy(mesh);
+        return false;
+    }
+
+    return true;
+}
+
+void _pm_destroy(_pm_mesh *const mesh)
+{
+    free(mesh->re);
+    free(mesh->im);
+    free(mesh->gx);
+    free(mesh->gy);
+    mesh->re = NULL;
+    mesh->im = NULL;
+    mesh->gx = NULL;
+    mesh->gy = NULL;
+}
+
+// Find weights of nodes along axis for body at coordinate "u" (in cells
+// from node 0). Returns the count of nodes starting from node "first".
+size_t _pm_weights(const _pm_mesh *const mesh, nb_float u,
+    ptrdiff_t *const first, nb_float *const weights)
+{
+    if (mesh->scheme == NB_PM_CIC)
+    {
+        nb_float node = floor(u);
+        nb_float d = u - node;
+
+        *first = (ptrdiff_t)node;
+        weights[0] = 1.0 - d;
+        weights[1] = d;
+        return 2;
+    }
+
+    nb_float node = floor(u + 0.5);
+    nb_float d = u - node;
+
+    *first = (ptrdiff_t)node - 1;
+    weights[0] = 0.5 * (0.5 - d) * (0.5 - d);
+    weights[1] = 0.75 - d * d;
+    weights[2] = 0.5 * (0.5 + d) * (0.5 + d);
+    return 3;
+}
+
+// Index of node along axis, periodic mesh wraps around
+size_t _pm_node(const _pm_mesh *const mesh, ptrdiff_t index)
+{
+    const ptrdiff_t n = (ptrdiff_t)mesh->n;
+
+    if (mesh->periodic)
+        index = ((index % n) + n) % n;
+
+    return (size_t)index;
+}
+
+// Assign masses of bodies to nodes of mesh
+void _pm_assign(_pm_mesh *const mesh, const nb_system *const system)
+{
+    for (size_t i = 0; i < system->count; i++)
+    {
+        nb_float w_x[3], w_y[3];
+        ptrdiff_t first_x, first_y;
+        size_t count_x = _pm_weights(mesh, (system->cx[i] - mesh->x0) /
+            mesh->h, &first_x, w_x);
+        size_t count_y = _pm_weights(mesh, (system->cy[i] - mesh->y0) /
+            mesh->h, &first_y, w_y);
+
+        for (size_t b = 0; b < count_y; b++)
+        {
+            size_t row = _pm_node(mesh, first_y + b) * mesh->fft_n;
+
+            for (size_t a = 0; a < count_x; a++)
+                mesh->re[row + _pm_node(mesh, first_x + a)] +=
+                    system->mass[i] * w_x[a] * w_y[b];
+        }
+    }
+}
+
+// Replace masses at nodes by the potential. For periodic mesh the
+// potential of a thin layer is solved in Fourier space:
+// Phi_k = 2 * pi * rho_k / |k|, where rho is density of mass per area.
+bool _pm_potential(_pm_mesh *const mesh, bool parallel)
+{
+    const nb_float pi = 3.14159265358979323846264338327950288;
+    const size_t n = mesh->n;
+
+    if (!mesh->periodic)
+        return _pm_potential_isolated(mesh, parallel);
+
+    if (!nb_fft_2d(mesh->re, mesh->im, n, false, parallel))
+        return false;
+
+    #pragma omp parallel for schedule(static) if (parallel)
+    for (size_t row = 0; row < n; row++)
+    {
+        nb_float k_y = 2 * pi * ((row < n / 2) ? (nb_float)row :
+            (nb_float)row - n) / (n * mesh->h);
+
+        for (size_t col = 0; col < n; col++)
+        {
+            nb_float k_x = 2 * pi * ((col < n / 2) ? (nb_float)col :
+                (nb_float)col - n) / (n * mesh->h);
+            nb_float k = NB_SQRT(k_x * k_x + k_y * k_y);
+
+            // the mean density does not create forces
+            nb_float green = (k > 0.0) ?
+                2 * pi / (k * mesh->h * mesh->h) : 0.0;
+
+            mesh->re[row * n + col] *= green;
+            mesh->im[row * n + col] *= green;
+        }
+    }
+
+    return nb_fft_2d(mesh->re, mesh->im, n, true, parallel);
+}
+
+// Convolve masses with Green's function 1/r on the mesh of double size,
+// so that images of bodies do not act on the mesh (method of Hockney)
+bool _pm_potential_isolated(_pm_mesh *const mesh, bool parallel)
+{
+    const size_t fft_n = mesh->fft_n;
+    nb_float* g_re = (nb_float*)malloc(sizeof(nb_float) * fft_n * fft_n);
+    nb_float* g_im = (nb_float*)calloc(fft_n * fft_n, sizeof(nb_float));
+    bool is_done = false;
+
+    if (g_re == NULL || g_im == NULL)
+    {
+        free(g_re);
+        free(g_im);
+        return false;
+    }
+
+    #pragma omp parallel for schedule(static) if (parallel)
+    for (size_t row = 0; row < fft_n; row++)
+    {
+        nb_float d_y = (row <= fft_n / 2) ? row : fft_n - row;
+
+        for (size_t col = 0; col < fft_n; col++)
+        {
+            nb_float d_x = (col <= fft_n / 2) ? col : fft_n - col;
+
+            g_re[row * fft_n + col] = 1.0 /
+                (mesh->h * NB_SQRT(d_x * d_x + d_y * d_y));
+        }
+    }
+
+    // potential of the uniform square cell at its center
+    g_re[0] = 4.0 * log(1.0 + NB_SQRT(2.0)) / mesh->h;
+
+    if (nb_fft_2d(g_re, g_im, fft_n, false, parallel) &&
+        nb_fft_2d(mesh->re, mesh->im, fft_n, false, parallel))
+    {
+        #pragma omp parallel for schedule(static) if (parallel)
+        for (size_t k = 0; k < fft_n * fft_n; k++)
+        {
+            nb_float re = mesh->re[k] * g_re[k] - mesh->im[k] * g_im[k];
+            nb_float im = mesh->re[k] * g_im[k] + mesh->im[k] * g_re[k];
+
+            mesh->re[k] = re;
+            mesh->im[k] = im;
+        }
+
+        is_done = nb_fft_2d(mesh->re, mesh->im, fft_n, true, parallel);
+    }
+
+    free(g_re);
+    free(g_im);
+    return is_done;
+}
+
+// Calculate gradient of potential at nodes by central differences of
+// the fourth order. Nodes near the edges of isolated mesh are skipped,
+// they have no bodies.
+void _pm_gradient(_pm_mesh *const mesh, bool parallel)
+{
+    const size_t n = mesh->n, fft_n = mesh->fft_n;
+    const size_t begin = mesh->periodic ? 0 : 2;
+    const size_t end = mesh->periodic ? n : n - 2;
+    const nb_float scale = 1.0 / (12 * mesh->h);
+    const nb_float *const phi = mesh->re;
+
+    #pragma omp parallel for schedule(static) if (parallel)
+    for (size_t row = begin; row < end; row++)
+    {
+        size_t up_1 = _pm_node(mesh, (ptrdiff_t)row + 1) * fft_n;
+        size_t up_2 = _pm_node(mesh, (ptrdiff_t)row + 2) * fft_n;
+        size_t down_1 = _pm_node(mesh, (ptrdiff_t)row - 1) * fft_n;
+        size_t down_2 = _pm_node(mesh, (ptrdiff_t)row - 2) * fft_n;
+        size_t center = row * fft_n;
+
+        for (size_t col = begin; col < end; col++)
+        {
+            size_t right_1 = _pm_node(mesh, (ptrdiff_t)col + 1);
+            size_t right_2 = _pm_node(mesh, (ptrdiff_t)col + 2);
+            size_t left_1 = _pm_node(mesh, (ptrdiff_t)col - 1);
+            size_t left_2 = _pm_node(mesh, (ptrdiff_t)col - 2);
+
+            mesh->gx[row * n + col] = scale *
+                (8 * (phi[center + right_1] - phi[center + left_1]) -
+                (phi[center + right_2] - phi[center + left_2]));
+            mesh->gy[row * n + col] = scale *
+                (8 * (phi[up_1 + col] - phi[down_1 + col]) -
+                (phi[up_2 + col] - phi[down_2 + col]));
+        }
+    }
+}
+
+// Interpolate gradient of potential from nodes to body "i" by the same
+// scheme, which assigned its mass, so the body does not act on itself
+void _pm_forces(const _pm_mesh *const mesh, const nb_system *const system,
+    size_t i, nb_row_acc *const acc)
+{
+    const nb_float g_mass_i = gravity_const * system->mass[i];
+    nb_float w_x[3], w_y[3];
+    ptrdiff_t first_x, first_y;
+    size_t count_x = _pm_weights(mesh, (system->cx[i] - mesh->x0) / mesh->h,
+        &first_x, w_x);
+    size_t count_y = _pm_weights(mesh, (system->cy[i] - mesh->y0) / mesh->h,
+        &first_y, w_y);
+    nb_float fx = 0.0, fy = 0.0;
+
+    for (size_t b = 0; b < count_y; b++)
+    {
+        size_t row = _pm_node(mesh, first_y + b) * mesh->n;
+
+        for (size_t a = 0; a < count_x; a++)
+        {
+            size_t node = row + _pm_node(mesh, first_x + a);
+
+            fx += w_x[a] * w_y[b] * mesh->gx[node];
+            fy += w_x[a] * w_y[b] * mesh->gy[node];
+        }
+    }
+
+    acc->fx = g_mass_i * fx;
+    acc->fy = g_mass_i * fy;
+}
@@ -0,0 +1,231 @@
+#include "nb_quadtree.h"
+
+#include <stdlib.h>
+
+
+static bool _nb_quadtree_init(nb_quadtree *const tree,
+    const nb_system *const system);
+static size_t _nb_quadtree_new_node(nb_quadtree *const tree, nb_float x,
+    nb_float y, nb_float half, size_t first, size_t count);
+static bool _nb_quadtree_build(nb_quadtree *const tree,
+    const nb_system *const system, size_t index, size_t depth);
+static void _nb_quadtree_leaf(nb_quadtree *const tree,
+    const nb_system *const system, size_t index);
+static void _nb_quadtree_node(nb_quadtree *const tree, size_t index);
+
+
+// Build the tree of system. Each leaf contains at most "leaf_max" bodies,
+// except leaves of the maximum depth.
+bool nb_quadtree_build(nb_quadtree *const tree, const nb_system *const system,
+    size_t leaf_max)
+{
+    tree->leaf_max = (leaf_max > 0) ? leaf_max : 1;
+
+    if (!_nb_quadtree_init(tree, system))
+        return false;
+
+    if (!_nb_quadtree_build(tree, system, 0, 0))
+    {
+        nb_quadtree_destroy(tree);
+        return false;
+    }
+
+    return true;
+}
+
+void nb_quadtree_destroy(nb_quadtree *const tree)
+{
+    free(tree->nodes);
+    free(tree->perm);
+    free(tree->_temp);
+    tree->nodes = NULL;
+    tree->perm = NULL;
+    tree->_temp = NULL;
+    tree->count = 0;
+    tree->capacity = 0;
+}
+
+// Allocate memory of tree and create the root cell, which bounds all bodies
+bool _nb_quadtree_init(nb_quadtree *const tree, const nb_system *const system)
+{
+    const size_t count = system->count;
+    nb_float min_x = system->cx[0], max_x = system->cx[0];
+    nb_float min_y = system->cy[0], max_y = system->cy[0];
+    nb_float half;
+
+    tree->capacity = 2 * (count / tree->leaf_max) + 16;
+    tree->count = 0;
+    tree->nodes = (nb_quad_node*)malloc(sizeof(nb_quad_node) *
+        tree->capacity);
+    tree->perm = (size_t*)malloc(sizeof(size_t) * count);
+    tree->_temp = (size_t*)malloc(sizeof(size_t) * count);
+
+    if (tree->nodes == NULL || tree->perm == NULL || tree->_temp == NULL)
+    {
+        nb_quadtree_destroy(tree);
+        return false;
+    }
+
+    for (size_t i = 0; i < count; i++)
+    {
+        tree->perm[i] = i;
+
+        if (system->cx[i] < min_x) min_x = system->cx[i];
+        if (system->cx[i] > max_x) max_x = system->cx[i];
+        if (system->cy[i] < min_y) min_y = system->cy[i];
+        if (system->cy[i] > max_y) max_y = system->cy[i];
+    }
+
+    half = (max_x - min_x > max_y - min_y) ? max_x - min_x : max_y - min_y;
+    half = (half > 0.0) ? half * 0.5 * (1.0 + 1e-6) : 1.0;
+
+    _nb_quadtree_new_node(tree, (min_x + max_x) / 2, (min_y + max_y) / 2,
+        half, 0, count);
+
+    return true;
+}
+
+// Append the new cell to the tree. Returns 0, if memory allocation failed.
+size_t _nb_quadtree_new_node(nb_quadtree *const tree, nb_float x,
+    nb_float y, nb_float half, size_t first, size_t count)
+{
+    if (tree->count == tree->capacity)
+    {
+        size_t new_capacity = tree->capacity * 2;
+        void* mem_p = realloc(tree->nodes,
+            sizeof(nb_quad_node) * new_capacity);
+
+        if (mem_p == NULL)
+            return 0;
+
+        tree->nodes = (nb_quad_node*)mem_p;
+        tree->capacity = new_capacity;
+    }
+
+    nb_quad_node *const node = &tree->nodes[tree->count];
+
+    node->x = x;
+    node->y = y;
+    node->half = half;
+    node->first = first;
+    node->count = count;
+    node->child[0] = node->child[1] = node->child[2] = node->child[3] = 0;
+    node->is_leaf = true;
+
+    return tree->count++;
+}
+
+// Divide the cell "index" into quadrants recursively and calculate
+// masses of all cells from leaves to root
+bool _nb_quadtree_build(nb_quadtree *const tree,
+    const nb_system *const system, size_t index, size_t depth)
+{
+    nb_quad_node node = tree->nodes[index];
+    size_t quad_count[4] = {0, 0, 0, 0};
+    size_t quad_first[4];
+
+    if (node.count <= tree->leaf_max || depth >= NB_QUAD_DEPTH_MAX)
+    {
+        _nb_quadtree_leaf(tree, system, index);
+        return true;
+    }
+
+    // Stable partition of bodies of cell by quadrants:
+    // 0 - left bottom, 1 - right bottom, 2 - left top, 3 - right top
+    for (size_t k = node.first; k < node.first + node.count; k++)
+    {
+        size_t i = tree->perm[k];
+        size_t q = (system->cx[i] >= node.x) + 2 * (system->cy[i] >= node.y);
+
+        quad_count[q]++;
+    }
+
+    quad_first[0] = node.first;
+    for (size_t q = 1; q < 4; q++)
+        quad_first[q] = quad_first[q - 1] + quad_count[q - 1];
+
+    size_t quad_pos[4] = {quad_first[0], quad_first[1], quad_first[2],
+        quad_first[3]};
+
+    for (size_t k = node.first; k < node.first + node.count; k++)
+    {
+        size_t i = tree->perm[k];
+        size_t q = (system->cx[i] >= node.x) + 2 * (system->cy[i] >= node.y);
+
+        tree->_temp[quad_pos[q]++] = i;
+    }
+
+    for (size_t k = node.first; k < node.first + node.count; k++)
+        tree->perm[k] = tree->_temp[k];
+
+    // Create and build not empty quadrants
+    for (size_t q = 0; q < 4; q++)
+    {
+        nb_float quarter = node.half / 2;
+        size_t child;
+
+        if (quad_count[q] == 0)
+            continue;
+
+        child = _nb_quadtree_new_node(tree,
+            node.x + ((q & 1) ? quarter : -quarter),
+            node.y + ((q & 2) ? quarter : -quarter),
+            quarter, quad_first[q], quad_count[q]);
+        if (child == 0)
+            return false;
+
+        tree->nodes[index].child[q] = child;
+        tree->nodes[index].is_leaf = false;
+
+        if (!_nb_quadtree_build(tree, system, child, depth + 1))
+            return false;
+    }
+
+    _nb_quadtree_node(tree, index);
+    return true;
+}
+
+// Calculate mass of the leaf "index" directly from its bodies
+void _nb_quadtree_leaf(nb_quadtree *const tree, const nb_system *const system,
+    size_t index)
+{
+    nb_quad_node *const node = &tree->nodes[index];
+    nb_float mass = 0.0, mx = 0.0, my = 0.0;
+
+    for (size_t k = node->first; k < node->first + node->count; k++)
+    {
+        size_t i = tree->perm[k];
+
+        mass += system->mass[i];
+        mx += system->mass[i] * system->cx[i];
+        my += system->mass[i] * system->cy[i];
+    }
+
+    node->mass = mass;
+    node->mx = mx / mass;
+    node->my = my / mass;
+}
+
+// Calculate mass of the cell "index" from masses of its children
+void _nb_quadtree_node(nb_quadtree *const tree, size_t index)
+{
+    nb_quad_node *const node = &tree->nodes[index];
+    nb_float mass = 0.0, mx = 0.0, my = 0.0;
+
+    for (size_t q = 0; q < 4; q++)
+    {
+        const nb_quad_node* child;
+
+        if (node->child[q] == 0)
+            continue;
+
+        child = &tree->nodes[node->child[q]];
+        mass += child->mass;
+        mx += child->mass * child->mx;
+        my += child->mass * child->my;
+    }
+
+    node->mass = mass;
+    node->mx = mx / mass;
+    node->my = my / mass;
+}
@@ -0,0 +1,643 @@
+#include "nb_simd.h"
+
+#include <string.h>
+#include <math.h>
+#include <float.h>
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define NB_SIMD_X86
+#include <immintrin.h>
+#endif
+
+
+// The vectorized kernels are written for double-precision numbers only
+#if defined(NB_SIMD_X86) && NB_FLOAT_PRECISION == 2
+#define NB_SIMD_ENABLED
+#endif
+
+
+static void _nb_simd_row_scalar(const nb_system *const system, size_t i,
+    size_t begin, size_t end, nb_row_acc *const acc);
+static void _nb_simd_row_scalar_rsqrt(const nb_system *const system,
+    size_t i, size_t begin, size_t end, nb_row_acc *const acc);
+
+#ifdef NB_SIMD_ENABLED
+static void _nb_simd_row_sse2(const nb_system *const system, size_t i,
+    size_t begin, size_t end, nb_row_acc *const acc);
+static void _nb_simd_row_avx2(const nb_system *const system, size_t i,
+    size_t begin, size_t end, nb_row_acc *const acc);
+static void _nb_simd_row_avx512(const nb_system *const system, size_t i,
+    size_t begin, size_t end, nb_row_acc *const acc);
+static void _nb_simd_row_sse2_rsqrt(const nb_system *const system,
+    size_t i, size_t begin, size_t end, nb_row_acc *const acc);
+static void _nb_simd_row_avx2_rsqrt(const nb_system *const system,
+    size_t i, size_t begin, size_t end, nb_row_acc *const acc);
+static void _nb_simd_row_avx512_rsqrt(const nb_system *const system,
+    size_t i, size_t begin, size_t end, nb_row_acc *const acc);
+#endif
+
+
+static const char *const _simd_names[] = {"none", "sse2", "avx2", "avx512"};
+
+
+nb_simd_level nb_simd_detect()
+{
+#ifdef NB_SIMD_ENABLED
+    __builtin_cpu_init();
+
+    if (__builtin_cpu_supports("avx512f"))
+        return NB_SIMD_AVX512;
+    else if (__builtin_cpu_supports("avx2"))
+        return NB_SIMD_AVX2;
+    else if (__builtin_cpu_supports("sse2"))
+        return NB_SIMD_SSE2;
+#endif
+
+    return NB_SIMD_NONE;
+}
+
+const char* nb_simd_name(nb_simd_level level)
+{
+    return _simd_names[level];
+}
+
+bool nb_simd_parse(const char *const name, nb_simd_level *const level)
+{
+    for (size_t i = 0; i < sizeof(_simd_names) / sizeof(char*); i++)
+    {
+        if (strcmp(name, _simd_names[i]) == 0)
+        {
+            *level = (nb_simd_level)i;
+            return true;
+        }
+    }
+
+    return false;
+}
+
+// Interactions of body "i" with bodies "j" from range [begin, end). If
+// "rsqrt" is set, then the kernel works with squared distances and gets
+// the inverse distance by reciprocal square root.
+void nb_simd_row(nb_simd_level level, bool rsqrt,
+    const nb_system *const system, size_t i, size_t begin, size_t end,
+    nb_row_acc *const acc)
+{
+    void (*row)(const nb_system *const, size_t, size_t, size_t,
+        nb_row_acc *const);
+
+    switch (level)
+    {
+#ifdef NB_SIMD_ENABLED
+    case NB_SIMD_SSE2:
+        row = rsqrt ? _nb_simd_row_sse2_rsqrt : _nb_simd_row_sse2;
+        break;
+    case NB_SIMD_AVX2:
+        row = rsqrt ? _nb_simd_row_avx2_rsqrt : _nb_simd_row_avx2;
+        break;
+    case NB_SIMD_AVX512:
+        row = rsqrt ? _nb_simd_row_avx512_rsqrt : _nb_simd_row_avx512;
+        break;
+#endif
+    default:
+        row = rsqrt ? _nb_simd_row_scalar_rsqrt : _nb_simd_row_scalar;
+        break;
+    }
+
+    // Split the range around body "i" instead of checking "j == i" inside
+    // of the vectorized loop
+    if (begin < i)
+        row(system, i, begin, (i < end) ? i : end, acc);
+    if (i + 1 < end)
+        row(system, i, (i + 1 > begin) ? i + 1 : begin, end, acc);
+}
+
+void _nb_simd_row_scalar(const nb_system *const system, size_t i,
+    size_t begin, size_t end, nb_row_acc *const acc)
+{
+    const nb_float *const cx = system->cx;
+    const nb_float *const cy = system->cy;
+    const nb_float *const sx = system->sx;
+    const nb_float *const sy = system->sy;
+    const nb_float *const mass = system->mass;
+    const nb_float *const rad = system->radius;
+
+    for (size_t j = begin; j < end; j++)
+    {
+        nb_float dx = cx[j] - cx[i];
+        nb_float dy = cy[j] - cy[i];
+        nb_float distance = (nb_float)sqrtl(dx * dx + dy * dy);
+
+        if (distance <= rad[i] + rad[j])
+        {
+            acc->is_collided = true;
+            acc->t_mass += mass[j];
+            acc->t_impulse_x += sx[j] * mass[j];
+            acc->t_impulse_y += sy[j] * mass[j];
+        }
+
+        nb_float temp = distance * distance * distance;
+        nb_float scalar = gravity_const * mass[i] * mass[j] / temp;
+
+        acc->fx += dx * scalar;
+        acc->fy += dy * scalar;
+    }
+}
+
+#ifdef NB_SIMD_ENABLED
+
+// Reciprocal square root: the estimate of float precision (12 bits) is
+// refined by three Newton iterations y = y * (1.5 - x / 2 * y^2), each of
+// them doubles the count of exact bits. Values out of the range of normal
+// float numbers are calculated exactly.
+__attribute__((target("sse2")))
+static inline __m128d _nb_rsqrt_sse2(__m128d x)
+{
+    const __m128d half_x = _mm_mul_pd(_mm_set1_pd(0.5), x);
+    const __m128d three_halves = _mm_set1_pd(1.5);
+    __m128d y = _mm_cvtps_pd(_mm_rsqrt_ps(_mm_cvtpd_ps(x)));
+
+    for (int k = 0; k < 3; k++)
+    {
+        y = _mm_mul_pd(y, _mm_sub_pd(three_halves,
+            _mm_mul_pd(half_x, _mm_mul_pd(y, y))));
+    }
+
+    __m128d out = _mm_or_pd(_mm_cmplt_pd(x, _mm_set1_pd(FLT_MIN)),
+        _mm_cmpgt_pd(x, _mm_set1_pd(FLT_MAX)));
+
+    if (_mm_movemask_pd(out) != 0)
+    {
+        __m128d exact = _mm_div_pd(_mm_set1_pd(1.0), _mm_sqrt_pd(x));
+
+        y = _mm_or_pd(_mm_and_pd(out, exact), _mm_andnot_pd(out, y));
+    }
+
+    return y;
+}
+
+#endif
+
+// Scalar instructions have no estimate of double precision, so the
+// inverse distance is calculated exactly from the squared distance
+void _nb_simd_row_scalar_rsqrt(const nb_system *const system, size_t i,
+    size_t begin, size_t end, nb_row_acc *const acc)
+{
+    const nb_float *const cx = system->cx;
+    const nb_float *const cy = system->cy;
+    const nb_float *const sx = system->sx;
+    const nb_float *const sy = system->sy;
+    const nb_float *const mass = system->mass;
+    const nb_float *const rad = system->radius;
+
+    for (size_t j = begin; j < end; j++)
+    {
+        nb_float dx = cx[j] - cx[i];
+        nb_float dy = cy[j] - cy[i];
+        nb_float square = dx * dx + dy * dy;
+        nb_float rad_sum = rad[i] + rad[j];
+        nb_float inverse = 1.0 / NB_SQRT(square);
+
+        if (square <= rad_sum * rad_sum)
+        {
+            acc->is_collided = true;
+            acc->t_mass += mass[j];
+            acc->t_impulse_x += sx[j] * mass[j];
+            acc->t_impulse_y += sy[j] * mass[j];
+        }
+
+        nb_float scalar = gravity_const * mass[i] * mass[j] *
+            (inverse * inverse * inverse);
+
+        acc->fx += dx * scalar;
+        acc->fy += dy * scalar;
+    }
+}
+
+#ifdef NB_SIMD_ENABLED
+
+// Sum of two lanes of SSE2 register
+static inline double _nb_hsum_sse2(__m128d v)
+{
+    return _mm_cvtsd_f64(_mm_add_sd(v, _mm_unpackhi_pd(v, v)));
+}
+
+__attribute__((target("sse2")))
+void _nb_simd_row_sse2(const nb_system *const system, size_t i,
+    size_t begin, size_t end, nb_row_acc *const acc)
+{
+    const double *const cx = system->cx;
+    const double *const cy = system->cy;
+    const double *const sx = system->sx;
+    const double *const sy = system->sy;
+    const double *const mass = system->mass;
+    const double *const rad = system->radius;
+
+    const __m128d cx_i = _mm_set1_pd(cx[i]);
+    const __m128d cy_i = _mm_set1_pd(cy[i]);
+    const __m128d rad_i = _mm_set1_pd(rad[i]);
+    const __m128d g_mass_i = _mm_set1_pd(gravity_const * mass[i]);
+
+    __m128d fx = _mm_setzero_pd(), fy = _mm_setzero_pd();
+    __m128d t_mass = _mm_setzero_pd();
+    __m128d t_impulse_x = _mm_setzero_pd(), t_impulse_y = _mm_setzero_pd();
+    __m128d collided = _mm_setzero_pd();
+    size_t j = begin;
+
+    for (; j + 2 <= end; j += 2)
+    {
+        __m128d mass_j = _mm_loadu_pd(mass + j);
+        __m128d dx = _mm_sub_pd(_mm_loadu_pd(cx + j), cx_i);
+        __m128d dy = _mm_sub_pd(_mm_loadu_pd(cy + j), cy_i);
+        __m128d distance = _mm_sqrt_pd(
+            _mm_add_pd(_mm_mul_pd(dx, dx), _mm_mul_pd(dy, dy)));
+
+        // collision mask: distance <= rad_i + rad_j
+        __m128d mask = _mm_cmple_pd(distance,
+            _mm_add_pd(rad_i, _mm_loadu_pd(rad + j)));
+        __m128d m_mass_j = _mm_and_pd(mask, mass_j);
+
+        collided = _mm_or_pd(collided, mask);
+        t_mass = _mm_add_pd(t_mass, m_mass_j);
+        t_impulse_x = _mm_add_pd(t_impulse_x,
+            _mm_mul_pd(_mm_loadu_pd(sx + j), m_mass_j));
+        t_impulse_y = _mm_add_pd(t_impulse_y,
+            _mm_mul_pd(_mm_loadu_pd(sy + j), m_mass_j));
+
+        __m128d temp = _mm_mul_pd(_mm_mul_pd(distance, distance), distance);
+        __m128d scalar = _mm_div_pd(_mm_mul_pd(g_mass_i, mass_j), temp);
+
+        fx = _mm_add_pd(fx, _mm_mul_pd(dx, scalar));
+        fy = _mm_add_pd(fy, _mm_mul_pd(dy, scalar));
+    }
+
+    acc->fx += _nb_hsum_sse2(fx);
+    acc->fy += _nb_hsum_sse2(fy);
+    acc->t_mass += _nb_hsum_sse2(t_mass);
+    acc->t_impulse_x += _nb_hsum_sse2(t_impulse_x);
+    acc->t_impulse_y += _nb_hsum_sse2(t_impulse_y);
+    acc->is_collided |= _mm_movemask_pd(collided) != 0;
+
+    _nb_simd_row_scalar(system, i, j, end, acc);
+}
+
+// Sum of four lanes of AVX register
+__attribute__((target("avx2")))
+static inline double _nb_hsum_avx2(__m256d v)
+{
+    __m128d low = _mm256_castpd256_pd128(v);
+    __m128d high = _mm256_extractf128_pd(v, 1);
+
+    return _nb_hsum_sse2(_mm_add_pd(low, high));
+}
+
+__attribute__((target("avx2")))
+void _nb_simd_row_avx2(const nb_system *const system, size_t i,
+    size_t begin, size_t end, nb_row_acc *const acc)
+{
+    const double *const cx = system->cx;
+    const double *const cy = system->cy;
+    const double *const sx = system->sx;
+    const double *const sy = system->sy;
+    const double *const mass = system->mass;
+    const double *const rad = system->radius;
+
+    const __m256d cx_i = _mm256_set1_pd(cx[i]);
+    const __m256d cy_i = _mm256_set1_pd(cy[i]);
+    const __m256d rad_i = _mm256_set1_pd(rad[i]);
+    const __m256d g_mass_i = _mm256_set1_pd(gravity_const * mass[i]);
+
+    __m256d fx = _mm256_setzero_pd(), fy = _mm256_setzero_pd();
+    __m256d t_mass = _mm256_setzero_pd();
+    __m256d t_impulse_x = _mm256_setzero_pd();
+    __m256d t_impulse_y = _mm256_setzero_pd();
+    __m256d collided = _mm256_setzero_pd();
+    size_t j = begin;
+
+    for (; j + 4 <= end; j += 4)
+    {
+        __m256d mass_j = _mm256_loadu_pd(mass + j);
+        __m256d dx = _mm256_sub_pd(_mm256_loadu_pd(cx + j), cx_i);
+        __m256d dy = _mm256_sub_pd(_mm256_loadu_pd(cy + j), cy_i);
+        __m256d distance = _mm256_sqrt_pd(
+            _mm256_add_pd(_mm256_mul_pd(dx, dx), _mm256_mul_pd(dy, dy)));
+
+        // collision mask: distance <= rad_i + rad_j
+        __m256d mask = _mm256_cmp_pd(distance,
+            _mm256_add_pd(rad_i, _mm256_loadu_pd(rad + j)), _CMP_LE_OQ);
+        __m256d m_mass_j = _mm256_and_pd(mask, mass_j);
+
+        collided = _mm256_or_pd(collided, mask);
+        t_mass = _mm256_add_pd(t_mass, m_mass_j);
+        t_impulse_x = _mm256_add_pd(t_impulse_x,
+            _mm256_mul_pd(_mm256_loadu_pd(sx + j), m_mass_j));
+        t_impulse_y = _mm256_add_pd(t_impulse_y,
+            _mm256_mul_pd(_mm256_loadu_pd(sy + j), m_mass_j));
+
+        __m256d temp = _mm256_mul_pd(
+            _mm256_mul_pd(distance, distance), distance);
+        __m256d scalar = _mm256_div_pd(
+            _mm256_mul_pd(g_mass_i, mass_j), temp);
+
+        fx = _mm256_add_pd(fx, _mm256_mul_pd(dx, scalar));
+        fy = _mm256_add_pd(fy, _mm256_mul_pd(dy, scalar));
+    }
+
+    acc->fx += _nb_hsum_avx2(fx);
+    acc->fy += _nb_hsum_avx2(fy);
+    acc->t_mass += _nb_hsum_avx2(t_mass);
+    acc->t_impulse_x += _nb_hsum_avx2(t_impulse_x);
+    acc->t_impulse_y += _nb_hsum_avx2(t_impulse_y);
+    acc->is_collided |= _mm256_movemask_pd(collided) != 0;
+
+    _nb_simd_row_scalar(system, i, j, end, acc);
+}
+
+// The tail of the range is processed by masked loads, so there is no
+// scalar remainder loop in this kernel
+__attribute__((target("avx512f")))
+void _nb_simd_row_avx512(const nb_system *const system, size_t i,
+    size_t begin, size_t end, nb_row_acc *const acc)
+{
+    const double *const cx = system->cx;
+    const double *const cy = system->cy;
+    const double *const sx = system->sx;
+    const double *const sy = system->sy;
+    const double *const mass = system->mass;
+    const double *const rad = system->radius;
+
+    const __m512d cx_i = _mm512_set1_pd(cx[i]);
+    const __m512d cy_i = _mm512_set1_pd(cy[i]);
+    const __m512d rad_i = _mm512_set1_pd(rad[i]);
+    const __m512d g_mass_i = _mm512_set1_pd(gravity_const * mass[i]);
+
+    __m512d fx = _mm512_setzero_pd(), fy = _mm512_setzero_pd();
+    __m512d t_mass = _mm512_setzero_pd();
+    __m512d t_impulse_x = _mm512_setzero_pd();
+    __m512d t_impulse_y = _mm512_setzero_pd();
+    __mmask8 collided = 0;
+
+    for (size_t j = begin; j < end; j += 8)
+    {
+        __mmask8 load = (end - j >= 8) ? 0xFF :
+            (__mmask8)((1u << (end - j)) - 1);
+
+        __m512d mass_j = _mm512_maskz_loadu_pd(load, mass + j);
+        __m512d dx = _mm512_sub_pd(_mm512_maskz_loadu_pd(load, cx + j), cx_i);
+        __m512d dy = _mm512_sub_pd(_mm512_maskz_loadu_pd(load, cy + j), cy_i);
+        __m512d distance = _mm512_sqrt_pd(
+            _mm512_add_pd(_mm512_mul_pd(dx, dx), _mm512_mul_pd(dy, dy)));
+
+        // collision mask: distance <= rad_i + rad_j
+        __mmask8 mask = _mm512_mask_cmp_pd_mask(load, distance,
+            _mm512_add_pd(rad_i, _mm512_maskz_loadu_pd(load, rad + j)),
+            _CMP_LE_OQ);
+
+        collided |= mask;
+        t_mass = _mm512_mask_add_pd(t_mass, mask, t_mass, mass_j);
+        t_impulse_x = _mm512_mask_add_pd(t_impulse_x, mask, t_impulse_x,
+            _mm512_mul_pd(_mm512_maskz_loadu_pd(load, sx + j), mass_j));
+        t_impulse_y = _mm512_mask_add_pd(t_impulse_y, mask, t_impulse_y,
+            _mm512_mul_pd(_mm512_maskz_loadu_pd(load, sy + j), mass_j));
+
+        __m512d temp = _mm512_mul_pd(
+            _mm512_mul_pd(distance, distance), distance);
+        __m512d scalar = _mm512_maskz_div_pd(load,
+            _mm512_mul_pd(g_mass_i, mass_j), temp);
+
+        fx = _mm512_mask_add_pd(fx, load, fx, _mm512_mul_pd(dx, scalar));
+        fy = _mm512_mask_add_pd(fy, load, fy, _mm512_mul_pd(dy, scalar));
+    }
+
+    acc->fx += _mm512_reduce_add_pd(fx);
+    acc->fy += _mm512_reduce_add_pd(fy);
+    acc->t_mass += _mm512_reduce_add_pd(t_mass);
+    acc->t_impulse_x += _mm512_reduce_add_pd(t_impulse_x);
+    acc->t_impulse_y += _mm512_reduce_add_pd(t_impulse_y);
+    acc->is_collided |= collided != 0;
+}
+
+__attribute__((target("sse2")))
+void _nb_simd_row_sse2_rsqrt(const nb_system *const system, size_t i,
+    size_t begin, size_t end, nb_row_acc *const acc)
+{
+    const double *const cx = system->cx;
+    const double *const cy = system->cy;
+    const double *const sx = system->sx;
+    const double *const sy = system->sy;
+    const double *const mass = system->mass;
+    const double *const rad = system->radius;
+
+    const __m128d cx_i = _mm_set1_pd(cx[i]);
+    const __m128d cy_i = _mm_set1_pd(cy[i]);
+    const __m128d rad_i = _mm_set1_pd(rad[i]);
+    const __m128d g_mass_i = _mm_set1_pd(gravity_const * mass[i]);
+
+    __m128d fx = _mm_setzero_pd(), fy = _mm_setzero_pd();
+    __m128d t_mass = _mm_setzero_pd();
+    __m128d t_impulse_x = _mm_setzero_pd(), t_impulse_y = _mm_setzero_pd();
+    __m128d collided = _mm_setzero_pd();
+    size_t j = begin;
+
+    for (; j + 2 <= end; j += 2)
+    {
+        __m128d mass_j = _mm_loadu_pd(mass + j);
+        __m128d dx = _mm_sub_pd(_mm_loadu_pd(cx + j), cx_i);
+        __m128d dy = _mm_sub_pd(_mm_loadu_pd(cy + j), cy_i);
+        __m128d square = _mm_add_pd(_mm_mul_pd(dx, dx), _mm_mul_pd(dy, dy));
+        __m128d rad_sum = _mm_add_pd(rad_i, _mm_loadu_pd(rad + j));
+
+        // collision mask: distance^2 <= (rad_i + rad_j)^2
+        __m128d mask = _mm_cmple_pd(square, _mm_mul_pd(rad_sum, rad_sum));
+        __m128d m_mass_j = _mm_and_pd(mask, mass_j);
+
+        collided = _mm_or_pd(collided, mask);
+        t_mass = _mm_add_pd(t_mass, m_mass_j);
+        t_impulse_x = _mm_add_pd(t_impulse_x,
+            _mm_mul_pd(_mm_loadu_pd(sx + j), m_mass_j));
+        t_impulse_y = _mm_add_pd(t_impulse_y,
+            _mm_mul_pd(_mm_loadu_pd(sy + j), m_mass_j));
+
+        __m128d inverse = _nb_rsqrt_sse2(square);
+        __m128d scalar = _mm_mul_pd(_mm_mul_pd(g_mass_i, mass_j),
+            _mm_mul_pd(_mm_mul_pd(inverse, inverse), inverse));
+
+        fx = _mm_add_pd(fx, _mm_mul_pd(dx, scalar));
+        fy = _mm_add_pd(fy, _mm_mul_pd(dy, scalar));
+    }
+
+    acc->fx += _nb_hsum_sse2(fx);
+    acc->fy += _nb_hsum_sse2(fy);
+    acc->t_mass += _nb_hsum_sse2(t_mass);
+    acc->t_impulse_x += _nb_hsum_sse2(t_impulse_x);
+    acc->t_impulse_y += _nb_hsum_sse2(t_impulse_y);
+    acc->is_collided |= _mm_movemask_pd(collided) != 0;
+
+    _nb_simd_row_scalar_rsqrt(system, i, j, end, acc);
+}
+
+// Reciprocal square root of four lanes, as "_nb_rsqrt_sse2"
+__attribute__((target("avx2")))
+static inline __m256d _nb_rsqrt_avx2(__m256d x)
+{
+    const __m256d half_x = _mm256_mul_pd(_mm256_set1_pd(0.5), x);
+    const __m256d three_halves = _mm256_set1_pd(1.5);
+    __m256d y = _mm256_cvtps_pd(_mm_rsqrt_ps(_mm256_cvtpd_ps(x)));
+
+    for (int k = 0; k < 3; k++)
+    {
+        y = _mm256_mul_pd(y, _mm256_sub_pd(three_halves,
+            _mm256_mul_pd(half_x, _mm256_mul_pd(y, y))));
+    }
+
+    __m256d out = _mm256_or_pd(
+        _mm256_cmp_pd(x, _mm256_set1_pd(FLT_MIN), _CMP_LT_OQ),
+        _mm256_cmp_pd(x, _mm256_set1_pd(FLT_MAX), _CMP_GT_OQ));
+
+    if (_mm256_movemask_pd(out) != 0)
+    {
+        __m256d exact = _mm256_div_pd(_mm256_set1_pd(1.0),
+            _mm256_sqrt_pd(x));
+
+        y = _mm256_blendv_pd(y, exact, out);
+    }
+
+    return y;
+}
+
+__attribute__((target("avx2")))
+void _nb_simd_row_avx2_rsqrt(const nb_system *const system, size_t i,
+    size_t begin, size_t end, nb_row_acc *const acc)
+{
+    const double *const cx = system->cx;
+    const double *const cy = system->cy;
+    const double *const sx = system->sx;
+    const double *const sy = system->sy;
+    const double *const mass = system->mass;
+    const double *const rad = system->radius;
+
+    const __m256d cx_i = _mm256_set1_pd(cx[i]);
+    const __m256d cy_i = _mm256_set1_pd(cy[i]);
+    const __m256d rad_i = _mm256_set1_pd(rad[i]);
+    const __m256d g_mass_i = _mm256_set1_pd(gravity_const * mass[i]);
+
+    __m256d fx = _mm256_setzero_pd(), fy = _mm256_setzero_pd();
+    __m256d t_mass = _mm256_setzero_pd();
+    __m256d t_impulse_x = _mm256_setzero_pd();
+    __m256d t_impulse_y = _mm256_setzero_pd();
+    __m256d collided = _mm256_setzero_pd();
+    size_t j = begin;
+
+    for (; j + 4 <= end; j += 4)
+    {
+        __m256d mass_j = _mm256_loadu_pd(mass + j);
+        __m256d dx = _mm256_sub_pd(_mm256_loadu_pd(cx + j), cx_i);
+        __m256d dy = _mm256_sub_pd(_mm256_loadu_pd(cy + j), cy_i);
+        __m256d square = _mm256_add_pd(_mm256_mul_pd(dx, dx),
+            _mm256_mul_pd(dy, dy));
+        __m256d rad_sum = _mm256_add_pd(rad_i, _mm256_loadu_pd(rad + j));
+
+        // collision mask: distance^2 <= (rad_i + rad_j)^2
+        __m256d mask = _mm256_cmp_pd(square,
+            _mm256_mul_pd(rad_sum, rad_sum), _CMP_LE_OQ);
+        __m256d m_mass_j = _mm256_and_pd(mask, mass_j);
+
+        collided = _mm256_or_pd(collided, mask);
+        t_mass = _mm256_add_pd(t_mass, m_mass_j);
+        t_impulse_x = _mm256_add_pd(t_impulse_x,
+            _mm256_mul_pd(_mm256_loadu_pd(sx + j), m_mass_j));
+        t_impulse_y = _mm256_add_pd(t_impulse_y,
+            _mm256_mul_pd(_mm256_loadu_pd(sy + j), m_mass_j));
+
+        __m256d inverse = _nb_rsqrt_avx2(square);
+        __m256d scalar = _mm256_mul_pd(_mm256_mul_pd(g_mass_i, mass_j),
+            _mm256_mul_pd(_mm256_mul_pd(inverse, inverse), inverse));
+
+        fx = _mm256_add_pd(fx, _mm256_mul_pd(dx, scalar));
+        fy = _mm256_add_pd(fy, _mm256_mul_pd(dy, scalar));
+    }
+
+    acc->fx += _nb_hsum_avx2(fx);
+    acc->fy += _nb_hsum_avx2(fy);
+    acc->t_mass += _nb_hsum_avx2(t_mass);
+    acc->t_impulse_x += _nb_hsum_avx2(t_impulse_x);
+    acc->t_impulse_y += _nb_hsum_avx2(t_impulse_y);
+    acc->is_collided |= _mm256_movemask_pd(collided) != 0;
+
+    _nb_simd_row_scalar_rsqrt(system, i, j, end, acc);
+}
+
+// The estimate of AVX-512 has 14 exact bits and covers the whole range of
+// double numbers, so two Newton iterations are enough
+__attribute__((target("avx512f")))
+void _nb_simd_row_avx512_rsqrt(const nb_system *const system, size_t i,
+    size_t begin, size_t end, nb_row_acc *const acc)
+{
+    const double *const cx = system->cx;
+    const double *const cy = system->cy;
+    const double *const sx = system->sx;
+    const double *const sy = system->sy;
+    const double *const mass = system->mass;
+    const double *const rad = system->radius;
+
+    const __m512d cx_i = _mm512_set1_pd(cx[i]);
+    const __m512d cy_i = _mm512_set1_pd(cy[i]);
+    const __m512d rad_i = _mm512_set1_pd(rad[i]);
+    const __m512d g_mass_i = _mm512_set1_pd(gravity_const * mass[i]);
+    const __m512d three_halves = _mm512_set1_pd(1.5);
+    const __m512d half = _mm512_set1_pd(0.5);
+
+    __m512d fx = _mm512_setzero_pd(), fy = _mm512_setzero_pd();
+    __m512d t_mass = _mm512_setzero_pd();
+    __m512d t_impulse_x = _mm512_setzero_pd();
+    __m512d t_impulse_y = _mm512_setzero_pd();
+    __mmask8 collided = 0;
+
+    for (size_t j = begin; j < end; j += 8)
+    {
+        __mmask8 load = (end - j >= 8) ? 0xFF :
+            (__mmask8)((1u << (end - j)) - 1);
+
+        __m512d mass_j = _mm512_maskz_loadu_pd(load, mass + j);
+        __m512d dx = _mm512_sub_pd(_mm512_maskz_loadu_pd(load, cx + j), cx_i);
+        __m512d dy = _mm512_sub_pd(_mm512_maskz_loadu_pd(load, cy + j), cy_i);
+        __m512d square = _mm512_add_pd(_mm512_mul_pd(dx, dx),
+            _mm512_mul_pd(dy, dy));
+        __m512d rad_sum = _mm512_add_pd(rad_i,
+            _mm512_maskz_loadu_pd(load, rad + j));
+
+        // collision mask: distance^2 <= (rad_i + rad_j)^2
+        __mmask8 mask = _mm512_mask_cmp_pd_mask(load, square,
+            _mm512_mul_pd(rad_sum, rad_sum), _CMP_LE_OQ);
+
+        collided |= mask;
+        t_mass = _mm512_mask_add_pd(t_mass, mask, t_mass, mass_j);
+        t_impulse_x = _mm512_mask_add_pd(t_impulse_x, mask, t_impulse_x,
+            _mm512_mul_pd(_mm512_maskz_loadu_pd(load, sx + j), mass_j));
+        t_impulse_y = _mm512_mask_add_pd(t_impulse_y, mask, t_impulse_y,
+            _mm512_mul_pd(_mm512_maskz_loadu_pd(load, sy + j), mass_j));
+
+        __m512d half_square = _mm512_mul_pd(half, square);
+        __m512d inverse = _mm512_maskz_rsqrt14_pd(load, square);
+
+        for (int k = 0; k < 2; k++)
+        {
+            inverse = _mm512_mul_pd(inverse, _mm512_sub_pd(three_halves,
+                _mm512_mul_pd(half_square, _mm512_mul_pd(inverse, inverse))));
+        }
+
+        __m512d scalar = _mm512_mul_pd(_mm512_mul_pd(g_mass_i, mass_j),
+            _mm512_mul_pd(_mm512_mul_pd(inverse, inverse), inverse));
+
+        fx = _mm512_mask_add_pd(fx, load, fx, _mm512_mul_pd(dx, scalar));
+        fy = _mm512_mask_add_pd(fy, load, fy, _mm512_mul_pd(dy, scalar));
+    }
+
+    acc->fx += _mm512_reduce_add_pd(fx);
+    acc->fy += _mm512_reduce_add_pd(fy);
+    acc->t_mass += _mm512_reduce_add_pd(t_mass);
+    acc->t_impulse_x += _mm512_reduce_add_pd(t_impulse_x);
+    acc->t_impulse_y += _mm512_reduce_add_pd(t_impulse_y);
+    acc->is_collided |= collided != 0;
+}
+
+#endif
@@ -0,0 +1,237 @@
+// threads of POSIX
+#define _POSIX_C_SOURCE 200809L
+
+#include "nb_snapshot.h"
+
+#include <stdlib.h>
+#include <errno.h>
+
+#include <pthread.h>
+#include <omp.h>
+
+
+// Ring of copies of the state of system. The simulation copies the state
+// to the free slot after "head" and goes on, the writer thread writes the
+// slots from "tail". If there is no free slot, the snapshot is dropped, so
+// the simulation never waits for the disk.
+struct nb_snapshot
+{
+    FILE* file;                          // trajectory file
+    nb_trajectory trajectory;            // coder of frames
+    size_t every;                        // count of steps between snapshots
+    nb_system slots[NB_SNAPSHOT_SLOTS];  // copies of the state of system
+    size_t steps[NB_SNAPSHOT_SLOTS];     // steps of run of the copies
+    size_t head;                         // first free slot
+    size_t tail;                         // first slot to write
+    size_t filled;                       // count of slots to write
+    bool is_closing;                     // no more snapshots will come
+    nb_snapshot_stats stats;
+    pthread_t writer;
+    pthread_mutex_t mutex;               // guards the ring and "stats"
+    pthread_cond_t is_filled;            // a slot was filled or closing
+    pthread_cond_t is_free;              // a slot was written
+};
+
+
+static void* _nb_snapshot_writer(void* arg);
+
+
+// Create the trajectory file of the mode with chunks of "chunk" frames and
+// start the writer thread. Returns NULL, if something failed.
+nb_snapshot* nb_snapshot_open(const char *const filename, size_t every,
+    nb_trajectory_mode mode, nb_float max_error, size_t chunk)
+{
+    nb_snapshot* snapshot = (nb_snapshot*)calloc(1, sizeof(nb_snapshot));
+    bool is_mutex, is_cond;
+
+    if (snapshot == NULL)
+        return NULL;
+
+    snapshot->file = fopen(filename, "wb");
+    if (snapshot->file == NULL)
+    {
+        free(snapshot);
+        return NULL;
+    }
+
+    if (!nb_trajectory_init_write(&snapshot->trajectory, snapshot->file,
+        mode, max_error, chunk))
+    {
+        fclose(snapshot->file);
+        free(snapshot);
+        return NULL;
+    }
+
+    errno = 0;
+    for (size_t k = 0; k < NB_SNAPSHOT_SLOTS; k++)
+        nb_system_init_default(&snapshot->slots[k]);
+
+    snapshot->every = (every != 0) ? every : 1;
+    snapshot->stats.every = snapshot->every;
+
+    is_mutex = errno != ENOMEM &&
+        pthread_mutex_init(&snapshot->mutex, NULL) == 0;
+    is_cond = is_mutex &&
+        pthread_cond_init(&snapshot->is_filled, NULL) == 0;
+    if (is_cond && pthread_cond_init(&snapshot->is_free, NULL) != 0)
+    {
+        pthread_cond_destroy(&snapshot->is_filled);
+        is_cond = false;
+    }
+
+    if (is_cond && pthread_create(&snapshot->writer, NULL,
+        _nb_snapshot_writer, snapshot) == 0)
+    {
+        return snapshot;
+    }
+
+    if (is_cond)
+    {
+        pthread_cond_destroy(&snapshot->is_filled);
+        pthread_cond_destroy(&snapshot->is_free);
+    }
+    if (is_mutex)
+        pthread_mutex_destroy(&snapshot->mutex);
+    for (size_t k = 0; k < NB_SNAPSHOT_SLOTS; k++)
+        nb_system_destroy(&snapshot->slots[k]);
+    nb_trajectory_destroy(&snapshot->trajectory);
+    fclose(snapshot->file);
+    free(snapshot);
+    return NULL;
+}
+
+size_t nb_snapshot_every(const nb_snapshot *const snapshot)
+{
+    return snapshot->every;
+}
+
+// Copy the state of system at the step of run to the free slot for the
+// writer. Returns false, if the snapshot was dropped: all slots wait for
+// the writer or memory of the copy can not be allocated. If "is_wait" is
+// set (the last snapshot of run), then a slot is awaited instead.
+bool nb_snapshot_put(nb_snapshot *const snapshot,
+    const nb_system *const system, size_t step, bool is_wait)
+{
+    nb_system* slot;
+
+    pthread_mutex_lock(&snapshot->mutex);
+    while (is_wait && snapshot->filled == NB_SNAPSHOT_SLOTS)
+        pthread_cond_wait(&snapshot->is_free, &snapshot->mutex);
+
+    if (snapshot->filled == NB_SNAPSHOT_SLOTS)
+    {
+        snapshot->stats.dropped++;
+        pthread_mutex_unlock(&snapshot->mutex);
+        return false;
+    }
+
+    slot = &snapshot->slots[snapshot->head];
+    snapshot->steps[snapshot->head] = step;
+    pthread_mutex_unlock(&snapshot->mutex);
+
+    // the slot is not seen by the writer until it is filled
+    if (nb_system_assign(slot, system) == NULL)
+    {
+        pthread_mutex_lock(&snapshot->mutex);
+        snapshot->stats.dropped++;
+        pthread_mutex_unlock(&snapshot->mutex);
+        return false;
+    }
+
+    pthread_mutex_lock(&snapshot->mutex);
+    snapshot->head = (snapshot->head + 1) % NB_SNAPSHOT_SLOTS;
+    snapshot->filled++;
+    pthread_cond_signal(&snapshot->is_filled);
+    pthread_mutex_unlock(&snapshot->mutex);
+
+    return true;
+}
+
+// Wait for the writer to write all filled slots, write the index of
+// frames, close the file and free the writer. The counts of the run are
+// returned in "stats".
+void nb_snapshot_close(nb_snapshot *const snapshot,
+    nb_snapshot_stats *const stats)
+{
+    pthread_mutex_lock(&snapshot->mutex);
+    snapshot->is_closing = true;
+    pthread_cond_signal(&snapshot->is_filled);
+    pthread_mutex_unlock(&snapshot->mutex);
+
+    pthread_join(snapshot->writer, NULL);
+
+    if (!snapshot->stats.is_failed)
+    {
+        if (nb_trajectory_finish(&snapshot->trajectory))
+            snapshot->stats.bytes = snapshot->trajectory.bytes;
+        else
+            snapshot->stats.is_failed = true;
+    }
+
+    if (fclose(snapshot->file) != 0)
+        snapshot->stats.is_failed = true;
+
+    *stats = snapshot->stats;
+
+    pthread_cond_destroy(&snapshot->is_filled);
+    pthread_cond_destroy(&snapshot->is_free);
+    pthread_mutex_destroy(&snapshot->mutex);
+    for (size_t k = 0; k < NB_SNAPSHOT_SLOTS; k++)
+        nb_system_destroy(&snapshot->slots[k]);
+    nb_trajectory_destroy(&snapshot->trajectory);
+    free(snapshot);
+}
+
+// Writer thread: code and write the filled slots in turn until closing
+void* _nb_snapshot_writer(void* arg)
+{
+    nb_snapshot *const snapshot = (nb_snapshot*)arg;
+
+    while (true)
+    {
+        const nb_system* slot;
+        size_t step;
+        double start, finish;
+        bool is_written;
+        long position;
+
+        pthread_mutex_lock(&snapshot->mutex);
+        while (snapshot->filled == 0 && !snapshot->is_closing)
+            pthread_cond_wait(&snapshot->is_filled, &snapshot->mutex);
+
+        if (snapshot->filled == 0)
+        {
+            pthread_mutex_unlock(&snapshot->mutex);
+            break;
+        }
+
+        slot = &snapshot->slots[snapshot->tail];
+        step = snapshot->steps[snapshot->tail];
+        pthread_mutex_unlock(&snapshot->mutex);
+
+        // after a failure the slots are released without writing
+        start = omp_get_wtime();
+        is_written = !snapshot->stats.is_failed &&
+            nb_trajectory_write(&snapshot->trajectory, slot, step) &&
+            fflush(snapshot->file) == 0;
+        position = ftell(snapshot->file);
+        finish = omp_get_wtime();
+
+        pthread_mutex_lock(&snapshot->mutex);
+        if (is_written)
+        {
+            snapshot->stats.written++;
+            snapshot->stats.bytes = (position > 0) ? (size_t)position : 0;
+            snapshot->stats.raw_bytes = snapshot->trajectory.raw_bytes;
+        }
+        else
+            snapshot->stats.is_failed = true;
+        snapshot->stats.busy += finish - start;
+        snapshot->tail = (snapshot->tail + 1) % NB_SNAPSHOT_SLOTS;
+        snapshot->filled--;
+        pthread_cond_signal(&snapshot->is_free);
+        pthread_mutex_unlock(&snapshot->mutex);
+    }
+
+    return NULL;
+}
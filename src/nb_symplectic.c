@@ -0,0 +1,162 @@
+#include "nb_symplectic.h"
+
+#include <omp.h>
+
+
+// maximum count of drifts in one step of scheme
+#define NB_SYMPLECTIC_STAGES_MAX 8
+
+
+// Step of symplectic scheme: kick(0), drift(0), kick(1), ..., drift(n - 1),
+// kick(n), where the coefficients are fractions of the time step. Forces of
+// each kick are calculated after the previous drift, the first kick uses
+// the forces of the last kick of the previous step.
+typedef struct _nb_scheme
+{
+    size_t stages;     // count of drifts
+    nb_float kick[NB_SYMPLECTIC_STAGES_MAX + 1];
+    nb_float drift[NB_SYMPLECTIC_STAGES_MAX];
+} _nb_scheme;
+
+
+static const _nb_scheme* _nb_symplectic_scheme();
+static void _nb_symplectic_kick_drift(nb_system *const system, size_t i,
+    nb_float kick, nb_float drift);
+static void _nb_symplectic_collide(nb_system *const system, size_t i);
+
+
+// Schemes in order of "nb_integrator" starting from the leapfrog. The
+// fourth and sixth order schemes of Yoshida are compositions of leapfrogs
+// with weights w1 w0 w1 and w3 w2 w1 w0 w1 w2 w3, where neighbouring kicks
+// are merged.
+static const _nb_scheme _schemes[] =
+{
+    // leapfrog
+    {1, {0.5, 0.5}, {1.0}},
+    // Forest-Ruth: w1 = 1 / (2 - 2^(1/3)), w0 = 1 - 2 w1
+    {
+        3,
+        {0.675603595979828817023843904485730413,
+            -0.175603595979828817023843904485730413,
+            -0.175603595979828817023843904485730413,
+            0.675603595979828817023843904485730413},
+        {1.351207191959657634047687808971460827,
+            -1.702414383919315268095375617942921654,
+            1.351207191959657634047687808971460827}
+    },
+    // Yoshida, solution A
+    {
+        7,
+        {0.392256805238780, 0.5100434119184585, -0.4710533854097565,
+            0.068753168252518, 0.068753168252518, -0.4710533854097565,
+            0.5100434119184585, 0.392256805238780},
+        {0.784513610477560, 0.235573213359357, -1.17767998417887,
+            1.315186320683906, -1.17767998417887, 0.235573213359357,
+            0.784513610477560}
+    },
+    // PEFRL: xi, (1 - 2 lambda) / 2, chi, lambda, 1 - 2 (chi + xi), ...
+    // The step starts and ends by drift, so it needs no forces of the
+    // previous step.
+    {
+        5,
+        {0.0, 0.7123418310626054, -0.2123418310626054,
+            -0.2123418310626054, 0.7123418310626054, 0.0},
+        {0.1786178958448091, -0.06626458266981849,
+            0.77529337365001878, -0.06626458266981849,
+            0.1786178958448091}
+    }
+};
+
+
+// Calculate forces at the current coordinates, if the first kick of the
+// scheme uses them. Speeds after collisions are not applied here, they are
+// applied once per step.
+void nb_symplectic_init(nb_system *const system, bool parallel)
+{
+    if (system->count == 0 || _nb_symplectic_scheme()->kick[0] == 0.0)
+        return;
+
+    nb_calc_forces(system, parallel);
+}
+
+// One step of the chosen scheme. Forces are calculated after each drift,
+// which is followed by a kick. Speeds after collisions are applied at the
+// last calculation of forces in step.
+void nb_symplectic_step(nb_system *const system, nb_float dt, bool parallel)
+{
+    const _nb_scheme *const scheme = _nb_symplectic_scheme();
+    const size_t max_threads = (size_t)omp_get_max_threads();
+    const size_t stages = scheme->stages;
+
+    size_t count = system->count;  // count of bodies
+    size_t last;                   // the last drift followed by forces
+
+    if (count == 0)
+        return;
+
+    last = (scheme->kick[stages] != 0.0) ? stages - 1 : stages - 2;
+
+    for (size_t s = 0; s < stages; s++)
+    {
+        nb_float kick = scheme->kick[s] * dt;
+        nb_float drift = scheme->drift[s] * dt;
+
+        #pragma omp parallel for schedule(static) \
+            if (parallel && count > max_threads)
+        for (size_t i = 0; i < count; i++)
+            _nb_symplectic_kick_drift(system, i, kick, drift);
+
+        if (s > last)
+            continue;
+
+        // Calculate forces at new coordinates and check probably collisions
+        nb_calc_forces(system, parallel);
+
+        if (s == last)
+        {
+            #pragma omp parallel for schedule(static) \
+                if (parallel && count > max_threads)
+            for (size_t i = 0; i < count; i++)
+                _nb_symplectic_collide(system, i);
+        }
+    }
+
+    if (scheme->kick[stages] != 0.0)
+    {
+        nb_float kick = scheme->kick[stages] * dt;
+
+        #pragma omp parallel for schedule(static) \
+            if (parallel && count > max_threads)
+        for (size_t i = 0; i < count; i++)
+            _nb_symplectic_kick_drift(system, i, kick, 0.0);
+    }
+
+    system->time += dt;
+}
+
+const _nb_scheme* _nb_symplectic_scheme()
+{
+    return &_schemes[calc_settings.integrator - NB_INTEGRATOR_LEAPFROG];
+}
+
+// Kick speed of body "i" by its stored force through time "kick" and move
+// it with the new speed through time "drift"
+void _nb_symplectic_kick_drift(nb_system *const system, size_t i,
+    nb_float kick, nb_float drift)
+{
+    system->sx[i] += kick * system->fx[i] / system->mass[i];
+    system->sy[i] += kick * system->fy[i] / system->mass[i];
+
+    system->cx[i] += drift * system->sx[i];
+    system->cy[i] += drift * system->sy[i];
+}
+
+// Set speed of body "i" after probably collisions
+void _nb_symplectic_collide(nb_system *const system, size_t i)
+{
+    nb_float* const sx_new = (nb_float*)system->_calc_buf;
+    nb_float* const sy_new = (nb_float*)system->_calc_buf + system->count;
+
+    system->sx[i] = sx_new[i];
+    system->sy[i] = sy_new[i];
+}
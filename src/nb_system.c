@@ -2,78 +2,115 @@
 
 #include <stdlib.h>
 #include <string.h>
+#include <stdint.h>
+#include <math.h>
 #include <errno.h>
 
+#include <omp.h>
+
 #include "nb_calculation.h"
+#include "nb_symplectic.h"
+#include "nb_block.h"
+#include "nb_balance.h"
+#include "nb_neighbour.h"
+#include "nb_snapshot.h"
+#include "nb_format.h"
+
+
+// relative difference of the quotient of times from an integer, which is
+// considered as the rounding error
+#define NB_SYSTEM_STEPS_EPS 1e-9
+// minimum capacity of system, which memory is touched by multiple threads
+#define NB_SYSTEM_TOUCH_MIN 4096
+// number of "nb_float" columns in the memory block of system
+#define NB_SYSTEM_COLUMNS 8
+// size of blocks, by which files of systems are read
+#define NB_SYSTEM_READ_BLOCK (1 << 20)
+
+
+static bool _nb_system_realloc(nb_system *const system, size_t capacity);
+static size_t _nb_system_read_capacity(FILE* stream, size_t count);
+static void _nb_system_touch(const nb_system *const system,
+    nb_float* block, nb_float* calc_buf, size_t capacity, size_t count);
+static void _nb_system_set_columns(nb_system *const system, nb_float* block,
+    size_t capacity);
+static void _nb_system_free_columns(nb_system *const system);
 
 
 void nb_system_init_default(nb_system *const system)
 {   
-    system->bodies = (nb_body*)malloc(sizeof(nb_body));
-    if (system->bodies == NULL || errno != 0)
-    {
-        system->capacity = 0;
-        return;
-    }
-    else
-        system->capacity = 1;
-    
-    system->_calc_buf = malloc(sizeof(nb_float) * 2);
+    system->cx = NULL;
+    system->names = NULL;
+    system->_calc_buf = NULL;
+    system->_step_buf = NULL;
+    system->_balance_buf = NULL;
+    system->_neighbour_buf = NULL;
+    system->_pair_buf = NULL;
+    system->_map_buf = NULL;
     system->count = 0;
+    system->capacity = 0;
     system->time = 0.0;
+
+    _nb_system_realloc(system, 1);
 }
 
 void nb_system_copy(nb_system *const system, const nb_system *const copy)
 {
-    void* mem_p = malloc(sizeof(nb_body) * copy->capacity);
-    if (mem_p == NULL || errno != 0)
-        return;
-    else
-        system->bodies = (nb_body*)mem_p;
-
-    mem_p = malloc(sizeof(nb_float) * copy->capacity * 2);
-    if (mem_p == NULL || errno != 0)
+    nb_system_init_default(system);
+    if (!_nb_system_realloc(system, copy->capacity))
         return;
-    else
-        system->_calc_buf = mem_p;
 
-    for (size_t i = 0; i < copy->count; i++)
-        nb_body_copy(&system->bodies[i], &copy->bodies[i]);
+    // the columns of copy may be placed apart (in the mapping of file)
+    memcpy(system->cx, copy->cx, sizeof(nb_float) * copy->count);
+    memcpy(system->cy, copy->cy, sizeof(nb_float) * copy->count);
+    memcpy(system->sx, copy->sx, sizeof(nb_float) * copy->count);
+    memcpy(system->sy, copy->sy, sizeof(nb_float) * copy->count);
+    memcpy(system->fx, copy->fx, sizeof(nb_float) * copy->count);
+    memcpy(system->fy, copy->fy, sizeof(nb_float) * copy->count);
+    memcpy(system->mass, copy->mass, sizeof(nb_float) * copy->count);
+    memcpy(system->radius, copy->radius, sizeof(nb_float) * copy->count);
+    memcpy(system->names, copy->names, NB_NAME_MAX * copy->count);
     
     system->count = copy->count;
-    system->capacity = copy->capacity;
     system->time = copy->time;
 }
 
 const nb_system* nb_system_assign(nb_system *const system,
     const nb_system *const copy)
 {
+    size_t named;
+
     if (system == copy)
         return system;
     
     if (copy->capacity > system->capacity ||
         copy->capacity <= system->capacity / 4) 
     {
-        nb_system_destroy(system);
-
-        void* mem_p = malloc(sizeof(nb_body) * copy->capacity);
-        if (mem_p == NULL || errno != 0)
-            return NULL;
-        else
-            system->bodies = (nb_body*)mem_p;
-        
-        mem_p = malloc(sizeof(nb_float) * copy->capacity * 2);
-        if (mem_p == NULL || errno != 0)
+        system->count = 0;
+        if (!_nb_system_realloc(system, copy->capacity))
             return NULL;
-        else
-            system->_calc_buf = mem_p;
+    }
 
-        system->capacity = copy->capacity;
+    memcpy(system->cx, copy->cx, sizeof(nb_float) * copy->count);
+    memcpy(system->cy, copy->cy, sizeof(nb_float) * copy->count);
+    memcpy(system->sx, copy->sx, sizeof(nb_float) * copy->count);
+    memcpy(system->sy, copy->sy, sizeof(nb_float) * copy->count);
+    memcpy(system->fx, copy->fx, sizeof(nb_float) * copy->count);
+    memcpy(system->fy, copy->fy, sizeof(nb_float) * copy->count);
+    memcpy(system->mass, copy->mass, sizeof(nb_float) * copy->count);
+    memcpy(system->radius, copy->radius, sizeof(nb_float) * copy->count);
+
+    // the names seldom change between assignments (of the same system), so
+    // only the names, which differ, are copied
+    named = (system->count < copy->count) ? system->count : copy->count;
+    for (size_t i = 0; i < named; i++)
+    {
+        if (strcmp(system->names[i], copy->names[i]) != 0)
+            strcpy(system->names[i], copy->names[i]);
     }
+    for (size_t i = named; i < copy->count; i++)
+        strcpy(system->names[i], copy->names[i]);
 
-    for (size_t i = 0; i < copy->count; i++)
-        nb_body_copy(&system->bodies[i], &copy->bodies[i]);
-    
     system->count = copy->count;
     system->time = copy->time;
 
@@ -82,11 +119,17 @@ const nb_system* nb_system_assign(nb_system *const system,
 
 void nb_system_destroy(nb_system *const system)
 {
-    if (system->bodies != NULL && system->_calc_buf != NULL)
+    if (system->cx != NULL && system->_calc_buf != NULL)
     {
-        free(system->bodies);
+        _nb_system_free_columns(system);
+        free(system->names);
         free(system->_calc_buf);
-        system->bodies = NULL;
+        nb_block_destroy(system);
+        nb_balance_destroy(system);
+        nb_neighbour_destroy(system);
+        nb_calc_pairs_destroy(system);
+        _nb_system_set_columns(system, NULL, 0);
+        system->names = NULL;
         system->_calc_buf = NULL;
         system->capacity = 0;
         system->count = 0;
@@ -94,6 +137,41 @@ void nb_system_destroy(nb_system *const system)
     }
 }
 
+void nb_system_reserve(nb_system *const system, size_t capacity)
+{
+    if (system->capacity == 0 || capacity <= system->capacity)
+        return;
+
+    _nb_system_realloc(system, capacity);
+}
+
+void nb_system_get_body(const nb_system *const system, size_t index,
+    nb_body *const body)
+{
+    nb_vector2 coords = {system->cx[index], system->cy[index]};
+    nb_vector2 speed = {system->sx[index], system->sy[index]};
+    nb_vector2 force = {system->fx[index], system->fy[index]};
+
+    nb_body_init(body, system->names[index], &coords, &speed, &force,
+        system->mass[index], system->radius[index]);
+}
+
+void nb_system_set_body(nb_system *const system, size_t index,
+    const nb_body *const body)
+{
+    strncpy(system->names[index], body->name, NB_NAME_MAX - 1);
+    system->names[index][NB_NAME_MAX - 1] = '\0';
+
+    system->cx[index] = body->coords.x;
+    system->cy[index] = body->coords.y;
+    system->sx[index] = body->speed.x;
+    system->sy[index] = body->speed.y;
+    system->fx[index] = body->force.x;
+    system->fy[index] = body->force.y;
+    system->mass[index] = body->mass;
+    system->radius[index] = body->radius;
+}
+
 void nb_system_add_body(nb_system *const system, const nb_body *const body)
 {
     size_t last = system->count;
@@ -103,77 +181,39 @@ void nb_system_add_body(nb_system *const system, const nb_body *const body)
 
     if (system->count + 1 > system->capacity)
     {
-        size_t new_capacity = system->capacity * 2;
-
-        void* mem_p = malloc(sizeof(nb_body) * new_capacity);
-        if (mem_p == NULL || errno != 0)
-            return;
-        else
-        {
-            memcpy(mem_p, system->bodies, sizeof(nb_body) * system->count);
-            free(system->bodies);
-            system->bodies = (nb_body*)mem_p;
-        }
-
-        mem_p = malloc(sizeof(nb_float) * new_capacity * 2);
-        if (mem_p == NULL || errno != 0)
+        if (!_nb_system_realloc(system, system->capacity * 2))
             return;
-        else
-        {
-            free(system->_calc_buf);
-            system->_calc_buf = mem_p;
-        }
-        
-        system->capacity = new_capacity;
     }
 
-    nb_body_copy(&system->bodies[last], body);
+    nb_system_set_body(system, last, body);
     system->count++;
 }
 
 void nb_system_remove_body(nb_system *const system, size_t index)
 {
+    nb_float* columns[NB_SYSTEM_COLUMNS] = {
+        system->cx, system->cy, system->sx, system->sy,
+        system->fx, system->fy, system->mass, system->radius
+    };
+    size_t tail;
+
     if (index >= system->count)
         return;
     
-    for (size_t i = index; i < system->count - 1; i++)
-        nb_body_copy(&system->bodies[i], &system->bodies[i + 1]);
-
-    if (system->count - 1 < system->capacity / 4)
+    // shift each column and the names to the left by one element
+    tail = system->count - index - 1;
+    for (size_t k = 0; k < NB_SYSTEM_COLUMNS; k++)
     {
-        size_t new_capacity = system->capacity / 4;
-        
-        void* mem_p = malloc(sizeof(nb_body) * new_capacity);
-        if (mem_p == NULL || errno != 0)
-        {
-            system->count--;
-            return;
-        }
-        else
-        {
-            memcpy(mem_p, system->bodies, 
-                sizeof(nb_body) * (system->count - 1));
-            free(system->bodies);
-            system->bodies = (nb_body*)mem_p;
-            system->count--;
-        }
-
-        mem_p = malloc(sizeof(nb_float) * new_capacity * 2);
-        if (mem_p == NULL || errno != 0)
-        {
-            system->count--;
-            return;
-        }
-        else
-        {
-            free(system->_calc_buf);
-            system->_calc_buf = mem_p;
-        }
-
-        system->capacity = new_capacity;
+        memmove(columns[k] + index, columns[k] + index + 1,
+            sizeof(nb_float) * tail);
     }
+    memmove(system->names[index], system->names[index + 1],
+        NB_NAME_MAX * tail);
 
     system->count--;
+
+    if (system->count < system->capacity / 4)
+        _nb_system_realloc(system, system->capacity / 4);
 }
 
 void nb_system_clear(nb_system *const system)
@@ -182,22 +222,136 @@ void nb_system_clear(nb_system *const system)
     return nb_system_init_default(system);
 }
 
+// Prepare the system for steps of the chosen integrator. It must be called
+// before the first step of each run, because the bodies may be changed
+// between runs.
+void nb_system_run_init(nb_system *const system, bool parallel)
+{
+    nb_schedule_apply();
+    nb_balance_reset(system);
+    nb_neighbour_reset(system);
+
+    if (calc_settings.integrator == NB_INTEGRATOR_HERMITE ||
+        calc_settings.integrator == NB_INTEGRATOR_BLOCK)
+    {
+        nb_block_init(system);
+    }
+    else if (calc_settings.integrator != NB_INTEGRATOR_EULER)
+        nb_symplectic_init(system, parallel);
+}
+
 void nb_system_run(nb_system *const system, const nb_float dt,
     const bool parralel)
 {
-    if (parralel)
+    const bool is_hermite =
+        calc_settings.integrator == NB_INTEGRATOR_HERMITE ||
+        calc_settings.integrator == NB_INTEGRATOR_BLOCK;
+
+    // if memory for accelerations and jerks can not be allocated, then the
+    // step is done by the Euler scheme
+    if (is_hermite && nb_block_step(system, dt, parralel))
+        return;
+
+    if (calc_settings.integrator != NB_INTEGRATOR_EULER && !is_hermite)
+    {
+        nb_symplectic_step(system, dt, parralel);
+    }
+    else if (parralel)
         nb_euler_multithreading(system, dt);
     else
         nb_euler_singlethread(system, dt);
 }
 
+// Count of steps "dt" before time "end_time". The quotient, which differs
+// from an integer only by rounding errors, is rounded to this integer.
+size_t nb_system_steps(nb_float end_time, nb_float dt)
+{
+    nb_float quotient = end_time / dt;
+    nb_float nearest = round(quotient);
+
+    if (quotient <= 0.0)
+        return 0;
+
+    if (fabs(quotient - nearest) <= quotient * NB_SYSTEM_STEPS_EPS)
+        return (size_t)nearest;
+
+    return (size_t)quotient;
+}
+
+// Run the system through "steps" steps "dt". The Euler scheme with the
+// direct kernel keeps one team of threads during the whole run, the other
+// schemes are run step by step.
+void nb_system_run_steps(nb_system *const system, size_t steps,
+    nb_float dt, bool parallel)
+{
+    nb_system_run_snapshots(system, steps, dt, parallel, NULL);
+}
+
+// Run the system as "nb_system_run_steps" does and put its state to
+// "snapshot" (unless it is NULL) at the start, after each "every" steps
+// and at the end. The team of threads of the Euler scheme is kept between
+// snapshots.
+void nb_system_run_snapshots(nb_system *const system, size_t steps,
+    nb_float dt, bool parallel, struct nb_snapshot *const snapshot)
+{
+    const size_t every = (snapshot != NULL) ?
+        nb_snapshot_every(snapshot) : steps;
+
+    nb_system_run_init(system, parallel);
+
+    if (snapshot != NULL)
+        nb_snapshot_put(snapshot, system, 0, steps == 0);
+
+    for (size_t done = 0; done < steps; )
+    {
+        size_t chunk = (steps - done < every) ? steps - done : every;
+
+        if (calc_settings.integrator != NB_INTEGRATOR_EULER ||
+            !nb_euler_run(system, chunk, dt, parallel))
+        {
+            for (size_t i = 0; i < chunk; i++)
+                nb_system_run(system, dt, parallel);
+        }
+
+        done += chunk;
+
+        // the last snapshot is never dropped, the run is over
+        if (snapshot != NULL)
+            nb_snapshot_put(snapshot, system, done, done == steps);
+    }
+}
+
+void nb_system_run_for(nb_system *const system, nb_float end_time,
+    nb_float dt, bool parallel)
+{
+    nb_system_run_steps(system, nb_system_steps(end_time, dt), dt,
+        parallel);
+}
+
+// Read the system in the format of "nb_body_read": the count of bodies,
+// the time and the records of bodies (the name with zero terminator and 8
+// numbers). Memory of all bodies is allocated at once by the count, the
+// file is read by large blocks, and the records are parsed from the block
+// straight to the columns. Files of columnar format are detected by the
+// magic and read by "nb_format_read_v2".
 bool nb_system_read(nb_system *const system, FILE* stream)
 {
-    bool is_read = true;
-    nb_body body;
-    size_t count;
+    const size_t record_max = NB_NAME_MAX + NB_SYSTEM_COLUMNS *
+        sizeof(nb_float);
+    const size_t record_min = 1 + NB_SYSTEM_COLUMNS * sizeof(nb_float);
+    nb_float* columns[NB_SYSTEM_COLUMNS];
+    char* block;
+    size_t filled = 0, pos = 0;
+    bool is_read = true, is_end = false;
+    size_t count, capacity;
     nb_float time;
 
+    if (nb_format_is_v2(stream))
+    {
+        fseek(stream, NB_FORMAT_MAGIC_SIZE, SEEK_CUR);
+        return nb_format_read_v2(system, stream);
+    }
+
     is_read &= fread(&count, sizeof(size_t), 1, stream) == 1;
     is_read &= fread(&time, sizeof(nb_float), 1, stream) == 1;
 
@@ -207,48 +361,102 @@ bool nb_system_read(nb_system *const system, FILE* stream)
     system->count = 0;  // better rewrite old data then reallocate memory
     system->time = time;
 
-    for (size_t i = 0; i < count; i++)
+    // memory of all bodies, which the rest of stream can hold, is
+    // allocated (and touched by threads) at once
+    capacity = _nb_system_read_capacity(stream, count);
+    if (capacity > system->capacity && !_nb_system_realloc(system, capacity))
+        return false;
+
+    block = (char*)malloc(NB_SYSTEM_READ_BLOCK + record_max);
+    if (block == NULL)
+        return false;
+
+    for (size_t i = 0; i < count && is_read; i++)
     {
-        is_read &= nb_body_read(&body, stream);
+        const char* name;
+        const char* end;
+
+        // the count of header may be greater than the stream holds, the
+        // memory grows by the records, which are read
+        if (i == system->capacity)
+        {
+            capacity = (count / 2 < i) ? count : 2 * i + 1;
+            if (!_nb_system_realloc(system, capacity))
+            {
+                is_read = false;
+                break;
+            }
+        }
+
+        // the numbers of record go in order of columns
+        columns[0] = system->cx;
+        columns[1] = system->cy;
+        columns[2] = system->sx;
+        columns[3] = system->sy;
+        columns[4] = system->fx;
+        columns[5] = system->fy;
+        columns[6] = system->mass;
+        columns[7] = system->radius;
+
+        // the block is refilled by the least size, which the rest of system
+        // takes, so the stream is never read after the system and the next
+        // system may follow it (on a pipe too)
+        while (true)
+        {
+            const size_t rest = filled - pos;
+            size_t need, others;
+
+            name = block + pos;
+            end = (const char*)memchr(name, '\0',
+                (rest < NB_NAME_MAX) ? rest : NB_NAME_MAX);
+
+            need = ((end != NULL) ? (size_t)(end - name) : rest) + 1 +
+                NB_SYSTEM_COLUMNS * sizeof(nb_float);
+            if (end != NULL && need <= rest)
+                break;
+
+            if (is_end || (end == NULL && rest >= NB_NAME_MAX))
+            {
+                is_read = false;
+                break;
+            }
+
+            others = count - i - 1;
+            others = (others < NB_SYSTEM_READ_BLOCK / record_min) ?
+                others * record_min : NB_SYSTEM_READ_BLOCK;
+            need = (need - rest + others < NB_SYSTEM_READ_BLOCK) ?
+                need - rest + others : NB_SYSTEM_READ_BLOCK;
+
+            memmove(block, name, rest);
+            filled = rest;
+            pos = 0;
+            filled += fread(block + filled, 1, need, stream);
+            is_end = filled - rest < need;
+        }
 
         if (!is_read)
             break;
-        
-        nb_system_add_body(system, &body);
-        if (errno != 0)
+
+        memcpy(system->names[i], name, end + 1 - name);
+        pos = end + 1 - block;
+
+        for (size_t k = 0; k < NB_SYSTEM_COLUMNS; k++)
         {
-            is_read = false;
-            break;
+            memcpy(&columns[k][i], block + pos, sizeof(nb_float));
+            pos += sizeof(nb_float);
         }
+
+        system->count++;
     }
 
+    free(block);
+
     size_t new_capacity = system->capacity;
     while (system->count < new_capacity / 4)
         new_capacity = new_capacity / 4;
     
     if (new_capacity != system->capacity)
-    {
-        void* mem_p = malloc(sizeof(nb_body) * new_capacity);
-        if (mem_p == NULL || errno != 0)
-            return is_read;
-        else
-        {
-            memcpy(mem_p, system->bodies, sizeof(nb_body) * system->count);
-            free(system->bodies);
-            system->bodies = (nb_body*)mem_p;
-        }
-
-        mem_p = malloc(sizeof(nb_float) * new_capacity * 2);
-        if (mem_p == NULL || errno != 0)
-            return is_read;
-        else
-        {
-            free(system->_calc_buf);
-            system->_calc_buf = mem_p;
-        }
-
-        system->capacity = new_capacity;
-    }
+        _nb_system_realloc(system, new_capacity);
 
     return is_read;
 }
@@ -262,7 +470,10 @@ bool nb_system_write(const nb_system *const system, FILE* stream)
 
     for (size_t i = 0; i < system->count; i++)
     {
-        is_write &= nb_body_write(&system->bodies[i], stream);
+        nb_body body;
+
+        nb_system_get_body(system, i, &body);
+        is_write &= nb_body_write(&body, stream);
 
         if (!is_write)
             break;
@@ -285,8 +496,11 @@ bool nb_system_print(const nb_system *const system, FILE* stream)
 
     for (size_t i = 0; i < system->count; i++)
     {
+        nb_body body;
+
+        nb_system_get_body(system, i, &body);
         is_print &= fprintf(stream, "Body index: %lu\n", i) > 0;
-        is_print &= nb_body_print(&system->bodies[i], stream);
+        is_print &= nb_body_print(&body, stream);
         is_print &= fprintf(stream, "\n") > 0;
 
         if (!is_print)
@@ -295,3 +509,159 @@ bool nb_system_print(const nb_system *const system, FILE* stream)
 
     return is_print;
 }
+
+// Count of bodies of the header of stream, which the rest of stream can
+// hold: each record has a name terminator and 8 numbers at least. The
+// rest of streams, which can not be sought, is not known, then the count
+// is limited by the bodies of one block of reading.
+size_t _nb_system_read_capacity(FILE* stream, size_t count)
+{
+    const size_t record_min = 1 + NB_SYSTEM_COLUMNS * sizeof(nb_float);
+    const int error = errno;
+    const long position = ftell(stream);
+    size_t rest = NB_SYSTEM_READ_BLOCK;
+    long end;
+
+    if (position >= 0 && fseek(stream, 0, SEEK_END) == 0)
+    {
+        end = ftell(stream);
+        if (end >= position)
+            rest = (size_t)(end - position);
+        fseek(stream, position, SEEK_SET);
+    }
+
+    // "errno" of failed seeking is not an error of reading
+    errno = error;
+    return (count < rest / record_min) ? count : rest / record_min;
+}
+
+// Reallocate memory of system for "capacity" bodies and keep the bodies
+// that fit into it. Returns false, if memory allocation failed or the
+// size of memory overflows.
+bool _nb_system_realloc(nb_system *const system, size_t capacity)
+{
+    size_t count = (system->count < capacity) ? system->count : capacity;
+    nb_float* block;
+    void* names;
+    nb_float* calc_buf;
+
+    if (capacity > SIZE_MAX / (NB_SYSTEM_COLUMNS * sizeof(nb_float)) ||
+        capacity > SIZE_MAX / NB_NAME_MAX)
+    {
+        errno = ENOMEM;
+        return false;
+    }
+
+    block = (nb_float*)malloc(sizeof(nb_float) * capacity * NB_SYSTEM_COLUMNS);
+    if (block == NULL || errno != 0)
+        return false;
+
+    names = malloc(NB_NAME_MAX * capacity);
+    if (names == NULL || errno != 0)
+    {
+        free(block);
+        return false;
+    }
+
+    calc_buf = (nb_float*)malloc(sizeof(nb_float) * capacity * 2);
+    if (calc_buf == NULL || errno != 0)
+    {
+        free(block);
+        free(names);
+        return false;
+    }
+
+    _nb_system_touch(system, block, calc_buf, capacity, count);
+
+    if (system->cx != NULL)
+    {
+        memcpy(names, system->names, NB_NAME_MAX * count);
+
+        _nb_system_free_columns(system);
+        free(system->names);
+        free(system->_calc_buf);
+    }
+
+    _nb_system_set_columns(system, block, capacity);
+    system->names = (char (*)[NB_NAME_MAX])names;
+    system->_calc_buf = calc_buf;
+    system->count = count;
+    system->capacity = capacity;
+
+    return true;
+}
+
+// Copy "count" rows of system to the new memory "block" and fill the rest
+// of rows and "calc_buf" by zeros. Pages of memory are placed on the NUMA
+// node of the thread, which touches them first. The force loops split the
+// rows of system by the static schedule, so the kept rows (or all rows, if
+// the memory is filled anew) are split the same way; the spare rows after
+// them are zeroed by a separate loop.
+void _nb_system_touch(const nb_system *const system, nb_float* block,
+    nb_float* calc_buf, size_t capacity, size_t count)
+{
+    const nb_float *const old_columns[NB_SYSTEM_COLUMNS] = {
+        system->cx, system->cy, system->sx, system->sy,
+        system->fx, system->fy, system->mass, system->radius
+    };
+    size_t rows;
+
+    if (system->cx == NULL)
+        count = 0;
+
+    rows = (count != 0) ? count : capacity;
+
+    #pragma omp parallel if (capacity >= NB_SYSTEM_TOUCH_MIN)
+    {
+        for (size_t k = 0; k < NB_SYSTEM_COLUMNS; k++)
+        {
+            nb_float *const column = block + k * capacity;
+
+            #pragma omp for schedule(static) nowait
+            for (size_t i = 0; i < rows; i++)
+                column[i] = (i < count) ? old_columns[k][i] : 0.0;
+
+            #pragma omp for schedule(static) nowait
+            for (size_t i = rows; i < capacity; i++)
+                column[i] = 0.0;
+        }
+
+        #pragma omp for schedule(static) nowait
+        for (size_t i = 0; i < rows; i++)
+        {
+            calc_buf[i] = 0.0;
+            calc_buf[capacity + i] = 0.0;
+        }
+
+        #pragma omp for schedule(static) nowait
+        for (size_t i = rows; i < capacity; i++)
+        {
+            calc_buf[i] = 0.0;
+            calc_buf[capacity + i] = 0.0;
+        }
+    }
+}
+
+// Set pointers of columns of system to the parts of the memory "block"
+void _nb_system_set_columns(nb_system *const system, nb_float* block,
+    size_t capacity)
+{
+    system->cx = block;
+    system->cy = (block != NULL) ? block + capacity : NULL;
+    system->sx = (block != NULL) ? block + capacity * 2 : NULL;
+    system->sy = (block != NULL) ? block + capacity * 3 : NULL;
+    system->fx = (block != NULL) ? block + capacity * 4 : NULL;
+    system->fy = (block != NULL) ? block + capacity * 5 : NULL;
+    system->mass = (block != NULL) ? block + capacity * 6 : NULL;
+    system->radius = (block != NULL) ? block + capacity * 7 : NULL;
+}
+
+// Free the memory block of columns or release the mapping of file, which
+// holds them
+void _nb_system_free_columns(nb_system *const system)
+{
+    if (system->_map_buf != NULL)
+        nb_format_unmap(system);
+    else
+        free(system->cx);
+}
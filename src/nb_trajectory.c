@@ -0,0 +1,1328 @@
+#include "nb_trajectory.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <stdint.h>
+#include <math.h>
+#include <limits.h>
+#include <errno.h>
+
+
+// version of compressed trajectory files
+#define NB_TRAJECTORY_VERSION 2
+// written in the byte order of host, so other orders are detected
+#define NB_TRAJECTORY_BYTE_ORDER 0x01020304u
+// count of 64-bit words of number
+#define NB_TRAJECTORY_WORDS ((sizeof(nb_float) + 7) / 8)
+// limit of quantized values of lossy mode (2^50), predicted values are
+// less than 2^52
+#define NB_TRAJECTORY_QUANT_MAX 1125899906842624.0
+// count of columns, which are quantized in lossy mode
+#define NB_TRAJECTORY_QUANT_COLUMNS 4
+// count of numbers, which are predicted at once before packing
+#define NB_TRAJECTORY_BLOCK 256
+// order of the header of index, which goes after the last frame
+#define NB_TRAJECTORY_INDEX_ORDER 0xffffffffu
+
+
+// Header of compressed trajectory file. It is followed by frames: the
+// header of frame and the coded frame of "size" bytes. The frames are
+// followed by the index: the header of frame of the order
+// NB_TRAJECTORY_INDEX_ORDER with the count of entries, the entries and the
+// trailer, which points to the header of index. The coded frame
+// starts with the names, if it is a key frame (the size of names and the
+// names with zero terminators), then the columns "cx", "cy", "sx", "sy",
+// "mass" and "radius" go: the way of coding of column (a byte) and the
+// words of column. Words are packed by pairs: a byte with counts of
+// significant bytes of both words (by 4 bits) and their significant bytes
+// starting from the lowest one.
+typedef struct _nb_trajectory_header
+{
+    char magic[8];               // "\x89NBT\r\n\x1a\n"
+    uint32_t version;            // version of format
+    uint32_t float_size;         // size of numbers
+    uint32_t mode;               // "nb_trajectory_mode"
+    uint32_t byte_order;         // NB_TRAJECTORY_BYTE_ORDER
+    unsigned char max_error[16]; // bound of error of lossy mode
+    uint32_t chunk;              // count of frames of chunk
+    unsigned char reserved[20];
+} _nb_trajectory_header;
+
+// Header of frame
+typedef struct _nb_trajectory_frame
+{
+    uint64_t count;              // count of bodies
+    uint64_t size;               // size of coded frame
+    uint64_t step;               // step of run
+    uint32_t order;              // order of prediction (0 - key frame)
+    uint32_t reserved;
+    unsigned char time[16];      // time of system
+} _nb_trajectory_frame;
+
+// Entry of index of file
+typedef struct _nb_trajectory_index_entry
+{
+    uint64_t step;               // step of run
+    uint64_t offset;             // offset of header of frame
+    uint32_t order;              // order of prediction of frame
+    uint32_t reserved;
+    unsigned char time[16];      // time of system
+} _nb_trajectory_index_entry;
+
+// End of file with index
+typedef struct _nb_trajectory_trailer
+{
+    char magic[8];               // "NBTINDEX"
+    uint64_t offset;             // offset of header of index
+} _nb_trajectory_trailer;
+
+// Ways of coding of columns
+typedef enum _nb_trajectory_column
+{
+    _NB_COLUMN_XOR,       // numbers XOR predicted numbers
+    _NB_COLUMN_QUANTIZED  // quantized numbers minus predicted ones
+} _nb_trajectory_column;
+
+static const char _magic[8] = {
+    '\x89', 'N', 'B', 'T', '\r', '\n', '\x1a', '\n'
+};
+static const char _index_magic[8] = {'N', 'B', 'T', 'I', 'N', 'D', 'E', 'X'};
+static const char *const _mode_names[] = {"none", "xor", "lossy"};
+
+
+static void _nb_trajectory_columns(const nb_system *const system,
+    nb_float* columns[NB_TRAJECTORY_COLUMNS]);
+static nb_float* _nb_trajectory_history(const nb_trajectory *const
+    trajectory, size_t frame, size_t k);
+static bool _nb_trajectory_reserve(nb_trajectory *const trajectory,
+    size_t count);
+static bool _nb_trajectory_buffer(nb_trajectory *const trajectory,
+    size_t size);
+static size_t _nb_trajectory_max_size(size_t count, size_t names_size);
+static bool _nb_trajectory_add_entry(nb_trajectory *const trajectory,
+    nb_float time, size_t step, size_t offset, bool is_key);
+static bool _nb_trajectory_read_index(nb_trajectory *const trajectory);
+static bool _nb_trajectory_scan_frames(nb_trajectory *const trajectory);
+static bool _nb_trajectory_scan_systems(nb_trajectory *const trajectory);
+static const char* _nb_trajectory_parse_range(const char* list,
+    size_t *const first, size_t *const last);
+static bool _nb_trajectory_is_key(const nb_trajectory *const trajectory,
+    const nb_system *const system);
+static bool _nb_trajectory_store_names(nb_trajectory *const trajectory,
+    const nb_system *const system);
+static bool _nb_trajectory_is_quantizable(const nb_float *const x,
+    const nb_float *const p1, const nb_float *const p2, size_t count,
+    size_t order, nb_float step);
+static unsigned char* _nb_trajectory_encode(const nb_float *const x,
+    const nb_float *const p1, nb_float *const p2, size_t count,
+    size_t order, nb_float step, unsigned char* out);
+static const unsigned char* _nb_trajectory_decode(const unsigned char* in,
+    const unsigned char *const end, nb_float *const x,
+    const nb_float *const p1, nb_float *const p2, size_t count,
+    size_t order, nb_float step);
+static void _nb_trajectory_predict(size_t order, const nb_float *const p1,
+    const nb_float *const p2, size_t count, nb_float *const predicted);
+static inline int64_t _nb_trajectory_round(nb_float value);
+static unsigned char* _nb_trajectory_pack(const uint64_t *const words,
+    size_t count, unsigned char* out);
+static const unsigned char* _nb_trajectory_unpack(const unsigned char* in,
+    const unsigned char *const end, uint64_t *const words, size_t count);
+
+
+const char* nb_trajectory_mode_name(nb_trajectory_mode mode)
+{
+    return _mode_names[mode];
+}
+
+bool nb_trajectory_mode_parse(const char *const name,
+    nb_trajectory_mode *const mode)
+{
+    for (size_t i = 0; i < sizeof(_mode_names) / sizeof(char*); i++)
+    {
+        if (strcmp(name, _mode_names[i]) == 0)
+        {
+            *mode = (nb_trajectory_mode)i;
+            return true;
+        }
+    }
+
+    return false;
+}
+
+// Does the file start with the header of compressed trajectory? The
+// position of file is kept.
+bool nb_trajectory_is_compressed(FILE* file)
+{
+    char magic[sizeof(_magic)];
+    long position = ftell(file);
+    bool is_compressed;
+
+    is_compressed = fread(magic, 1, sizeof(magic), file) == sizeof(magic) &&
+        memcmp(magic, _magic, sizeof(magic)) == 0;
+    fseek(file, position, SEEK_SET);
+
+    return is_compressed;
+}
+
+// Start the trajectory in the file: write the header of compressed modes.
+// The bound of error is used by lossy mode only, chunks of "chunk" frames
+// (NB_TRAJECTORY_CHUNK, if it is zero) are used by compressed modes only.
+// Returns false, if the header can not be written.
+bool nb_trajectory_init_write(nb_trajectory *const trajectory, FILE* file,
+    nb_trajectory_mode mode, nb_float max_error, size_t chunk)
+{
+    _nb_trajectory_header header;
+
+    memset(trajectory, 0, sizeof(nb_trajectory));
+    trajectory->file = file;
+    trajectory->mode = mode;
+    trajectory->max_error = (mode == NB_TRAJECTORY_LOSSY) ? max_error : 0.0;
+    trajectory->chunk = (chunk != 0 && chunk <= UINT32_MAX) ? chunk :
+        NB_TRAJECTORY_CHUNK;
+    trajectory->start = ftell(file);
+
+    if (mode == NB_TRAJECTORY_NONE)
+        return true;
+
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, _magic, sizeof(_magic));
+    header.version = NB_TRAJECTORY_VERSION;
+    header.float_size = sizeof(nb_float);
+    header.mode = (uint32_t)mode;
+    header.byte_order = NB_TRAJECTORY_BYTE_ORDER;
+    memcpy(header.max_error, &trajectory->max_error, sizeof(nb_float));
+    header.chunk = (uint32_t)trajectory->chunk;
+
+    // offsets of frames are counted from the end of header
+    trajectory->bytes = sizeof(header);
+    trajectory->start += (long)sizeof(header);
+    return trajectory->start >= (long)sizeof(header) &&
+        fwrite(&header, sizeof(header), 1, file) == 1;
+}
+
+// Start reading of the trajectory from the file. Files without the header
+// are sequences of systems. Returns false and sets "errno" to EINVAL, if
+// the file is of other version, precision or byte order.
+bool nb_trajectory_init_read(nb_trajectory *const trajectory, FILE* file)
+{
+    _nb_trajectory_header header;
+    const long position = ftell(file);
+
+    memset(trajectory, 0, sizeof(nb_trajectory));
+    trajectory->file = file;
+    trajectory->mode = NB_TRAJECTORY_NONE;
+    trajectory->start = position;
+
+    if (fread(&header, sizeof(header), 1, file) != 1 ||
+        memcmp(header.magic, _magic, sizeof(_magic)) != 0)
+    {
+        return fseek(file, position, SEEK_SET) == 0;
+    }
+
+    if (header.version != NB_TRAJECTORY_VERSION ||
+        header.float_size != sizeof(nb_float) ||
+        header.byte_order != NB_TRAJECTORY_BYTE_ORDER ||
+        (header.mode != NB_TRAJECTORY_XOR &&
+        header.mode != NB_TRAJECTORY_LOSSY))
+    {
+        errno = EINVAL;
+        return false;
+    }
+
+    trajectory->mode = (nb_trajectory_mode)header.mode;
+    memcpy(&trajectory->max_error, header.max_error, sizeof(nb_float));
+    trajectory->chunk = header.chunk;
+    trajectory->bytes = sizeof(header);
+    trajectory->start = position + (long)sizeof(header);
+
+    return true;
+}
+
+// Write the frame of system at the step of run. A new key frame is
+// started by each chunk and if the count or names of bodies have changed.
+// Returns false and sets "errno", if memory can not be allocated or the
+// frame can not be written.
+bool nb_trajectory_write(nb_trajectory *const trajectory,
+    const nb_system *const system, size_t step)
+{
+    const size_t count = system->count;
+    const nb_float quantum = 2.0 * trajectory->max_error;
+    nb_float* columns[NB_TRAJECTORY_COLUMNS];
+    _nb_trajectory_frame frame;
+    unsigned char* out;
+    size_t order;
+
+    if (trajectory->mode == NB_TRAJECTORY_NONE)
+    {
+        size_t size = sizeof(size_t) + sizeof(nb_float) +
+            8 * sizeof(nb_float) * count;
+
+        for (size_t i = 0; i < count; i++)
+            size += strlen(system->names[i]) + 1;
+
+        if (!nb_system_write(system, trajectory->file))
+            return false;
+
+        trajectory->frames++;
+        trajectory->raw_bytes += size;
+        trajectory->bytes += size;
+        return true;
+    }
+
+    order = trajectory->order;
+    if (_nb_trajectory_is_key(trajectory, system))
+    {
+        if (!_nb_trajectory_store_names(trajectory, system) ||
+            !_nb_trajectory_reserve(trajectory, count))
+        {
+            return false;
+        }
+
+        order = 0;
+    }
+
+    if (!_nb_trajectory_buffer(trajectory,
+        _nb_trajectory_max_size(count, trajectory->names_size)))
+    {
+        return false;
+    }
+
+    out = trajectory->buffer;
+    if (order == 0)
+    {
+        const uint64_t names_size = trajectory->names_size;
+
+        memcpy(out, &names_size, sizeof(uint64_t));
+        memcpy(out + sizeof(uint64_t), trajectory->names,
+            trajectory->names_size);
+        out += sizeof(uint64_t) + trajectory->names_size;
+    }
+
+    _nb_trajectory_columns(system, columns);
+
+    // the older frame of history is replaced by this frame
+    for (size_t k = 0; k < NB_TRAJECTORY_COLUMNS; k++)
+    {
+        const nb_float *const p1 = _nb_trajectory_history(trajectory,
+            trajectory->last, k);
+        nb_float *const p2 = _nb_trajectory_history(trajectory,
+            1 - trajectory->last, k);
+        const bool is_quantized = trajectory->mode == NB_TRAJECTORY_LOSSY &&
+            k < NB_TRAJECTORY_QUANT_COLUMNS &&
+            _nb_trajectory_is_quantizable(columns[k], p1, p2, count, order,
+            quantum);
+
+        *out++ = is_quantized ? _NB_COLUMN_QUANTIZED : _NB_COLUMN_XOR;
+        out = _nb_trajectory_encode(columns[k], p1, p2, count, order,
+            is_quantized ? quantum : 0.0, out);
+    }
+
+    memset(&frame, 0, sizeof(frame));
+    frame.count = count;
+    frame.size = (uint64_t)(out - trajectory->buffer);
+    frame.step = step;
+    frame.order = (uint32_t)order;
+    memcpy(frame.time, &system->time, sizeof(nb_float));
+
+    if (fwrite(&frame, sizeof(frame), 1, trajectory->file) != 1 ||
+        fwrite(trajectory->buffer, 1, (size_t)frame.size, trajectory->file)
+        != frame.size ||
+        !_nb_trajectory_add_entry(trajectory, system->time, step,
+        (size_t)trajectory->start - sizeof(_nb_trajectory_header) +
+        trajectory->bytes, order == 0))
+    {
+        return false;
+    }
+
+    trajectory->count = count;
+    trajectory->order = (order < 2) ? order + 1 : 2;
+    trajectory->last = 1 - trajectory->last;
+    trajectory->frames++;
+    trajectory->raw_bytes += sizeof(size_t) + sizeof(nb_float) +
+        trajectory->names_size + 8 * sizeof(nb_float) * count;
+    trajectory->bytes += sizeof(frame) + (size_t)frame.size;
+
+    return true;
+}
+
+// End the trajectory: write the index of frames of compressed modes.
+// Returns false, if the index can not be written.
+bool nb_trajectory_finish(nb_trajectory *const trajectory)
+{
+    _nb_trajectory_frame header;
+    _nb_trajectory_trailer trailer;
+
+    if (trajectory->mode == NB_TRAJECTORY_NONE)
+        return true;
+
+    memset(&header, 0, sizeof(header));
+    header.count = trajectory->index_count;
+    header.size = trajectory->index_count *
+        sizeof(_nb_trajectory_index_entry);
+    header.order = NB_TRAJECTORY_INDEX_ORDER;
+
+    memcpy(trailer.magic, _index_magic, sizeof(_index_magic));
+    trailer.offset = (size_t)trajectory->start -
+        sizeof(_nb_trajectory_header) + trajectory->bytes;
+
+    if (fwrite(&header, sizeof(header), 1, trajectory->file) != 1)
+        return false;
+
+    for (size_t i = 0; i < trajectory->index_count; i++)
+    {
+        const nb_trajectory_entry *const entry = &trajectory->index[i];
+        _nb_trajectory_index_entry record;
+
+        memset(&record, 0, sizeof(record));
+        record.step = entry->step;
+        record.offset = entry->offset;
+        record.order = (entry->key == i) ? 0 : 1;
+        memcpy(record.time, &entry->time, sizeof(nb_float));
+
+        if (fwrite(&record, sizeof(record), 1, trajectory->file) != 1)
+            return false;
+    }
+
+    if (fwrite(&trailer, sizeof(trailer), 1, trajectory->file) != 1)
+        return false;
+
+    trajectory->bytes += sizeof(header) + (size_t)header.size +
+        sizeof(trailer);
+    return true;
+}
+
+// Read the next frame to the system. Forces are not kept by compressed
+// modes, they are zero. Returns false at the end of file ("is_end" is set)
+// or if reading failed ("errno" is EINVAL, if the file is damaged).
+bool nb_trajectory_read(nb_trajectory *const trajectory,
+    nb_system *const system)
+{
+    _nb_trajectory_frame frame;
+    const unsigned char* in;
+    const unsigned char* end;
+    nb_float* columns[NB_TRAJECTORY_COLUMNS];
+    const char* name;
+    size_t count, size, read;
+
+    if (trajectory->mode == NB_TRAJECTORY_NONE)
+    {
+        int c = fgetc(trajectory->file);
+
+        if (c == EOF)
+        {
+            trajectory->is_end = !ferror(trajectory->file);
+            return false;
+        }
+
+        ungetc(c, trajectory->file);
+        if (!nb_system_read(system, trajectory->file))
+            return false;
+
+        // sequences of systems keep no steps, frames are numbered
+        trajectory->step = trajectory->frames++;
+        return true;
+    }
+
+    read = fread(&frame, 1, sizeof(frame), trajectory->file);
+    if ((read == 0 && feof(trajectory->file)) ||
+        (read == sizeof(frame) && frame.order == NB_TRAJECTORY_INDEX_ORDER))
+    {
+        trajectory->is_end = true;
+        return false;
+    }
+
+    count = (size_t)frame.count;
+    size = (size_t)frame.size;
+
+    if (read != sizeof(frame) || frame.order > 2 ||
+        frame.count > SIZE_MAX / NB_NAME_MAX ||
+        (frame.order != 0 && (frame.order > trajectory->order ||
+        count != trajectory->count)) ||
+        frame.size > _nb_trajectory_max_size(count, count * NB_NAME_MAX))
+    {
+        errno = EINVAL;
+        return false;
+    }
+
+    if (!_nb_trajectory_buffer(trajectory, size))
+        return false;
+
+    if (fread(trajectory->buffer, 1, size, trajectory->file) != size)
+    {
+        errno = EINVAL;
+        return false;
+    }
+    memset(trajectory->buffer + size, 0, sizeof(uint64_t));
+
+    in = trajectory->buffer;
+    end = trajectory->buffer + size;
+
+    if (frame.order == 0)
+    {
+        uint64_t names_size;
+        char* names;
+        size_t zeros = 0, length = 0;
+        bool is_valid = true;
+
+        if (size < sizeof(uint64_t))
+        {
+            errno = EINVAL;
+            return false;
+        }
+
+        memcpy(&names_size, in, sizeof(uint64_t));
+        in += sizeof(uint64_t);
+
+        if (names_size > (uint64_t)(end - in))
+        {
+            errno = EINVAL;
+            return false;
+        }
+
+        names = (char*)realloc(trajectory->names, (size_t)names_size + 1);
+        if (names == NULL)
+            return false;
+
+        trajectory->names = names;
+        trajectory->names_size = (size_t)names_size;
+        memcpy(names, in, (size_t)names_size);
+        in += names_size;
+
+        // each name fits into NB_NAME_MAX with its terminator
+        for (size_t i = 0; i < names_size && is_valid; i++)
+        {
+            if (names[i] == '\0')
+            {
+                zeros++;
+                length = 0;
+            }
+            else
+                is_valid = ++length < NB_NAME_MAX;
+        }
+
+        if (!is_valid || zeros != count || length != 0)
+        {
+            errno = EINVAL;
+            return false;
+        }
+
+        if (!_nb_trajectory_reserve(trajectory, count))
+            return false;
+    }
+
+    // the system is empty, unless the whole frame is decoded
+    system->count = 0;
+    errno = 0;
+    nb_system_reserve(system, count);
+    if (system->capacity < count)
+        return false;
+
+    _nb_trajectory_columns(system, columns);
+
+    for (size_t k = 0; k < NB_TRAJECTORY_COLUMNS; k++)
+    {
+        const nb_float *const p1 = _nb_trajectory_history(trajectory,
+            trajectory->last, k);
+        nb_float *const p2 = _nb_trajectory_history(trajectory,
+            1 - trajectory->last, k);
+        unsigned char column;
+
+        if (in >= end)
+        {
+            errno = EINVAL;
+            return false;
+        }
+
+        column = *in++;
+        in = (column > _NB_COLUMN_QUANTIZED) ? NULL :
+            _nb_trajectory_decode(in, end, columns[k], p1, p2, count,
+            frame.order, (column == _NB_COLUMN_QUANTIZED) ?
+            2.0 * trajectory->max_error : 0.0);
+
+        if (in == NULL)
+        {
+            errno = EINVAL;
+            return false;
+        }
+    }
+
+    name = trajectory->names;
+    for (size_t i = 0; i < count; i++)
+    {
+        const size_t length = strlen(name) + 1;
+
+        memcpy(system->names[i], name, length);
+        name += length;
+    }
+
+    memset(system->fx, 0, sizeof(nb_float) * count);
+    memset(system->fy, 0, sizeof(nb_float) * count);
+    memcpy(&system->time, frame.time, sizeof(nb_float));
+    system->count = count;
+
+    trajectory->count = count;
+    trajectory->order = (frame.order < 2) ? frame.order + 1 : 2;
+    trajectory->last = 1 - trajectory->last;
+    trajectory->frames++;
+    trajectory->step = (size_t)frame.step;
+    trajectory->bytes += sizeof(frame) + size;
+
+    return true;
+}
+
+// Load the index of frames: the index of compressed file or, if the file
+// has not been finished, the headers of its frames, which are complete.
+// Sequences of systems have no index, they are read through. The next
+// frame to read is the first one. Returns false and sets "errno", if
+// reading failed.
+bool nb_trajectory_load_index(nb_trajectory *const trajectory)
+{
+    bool is_loaded;
+
+    trajectory->index_count = 0;
+
+    if (trajectory->mode == NB_TRAJECTORY_NONE)
+        is_loaded = _nb_trajectory_scan_systems(trajectory);
+    else
+    {
+        errno = 0;
+        is_loaded = _nb_trajectory_read_index(trajectory);
+        if (!is_loaded && errno != ENOMEM)
+        {
+            trajectory->index_count = 0;
+            is_loaded = _nb_trajectory_scan_frames(trajectory);
+        }
+    }
+
+    trajectory->frames = 0;
+    trajectory->order = 0;
+    trajectory->is_end = false;
+
+    return fseek(trajectory->file, trajectory->start, SEEK_SET) == 0 &&
+        is_loaded;
+}
+
+// Index of the frame, which time is the nearest one to "time", by the
+// loaded index (frames go by time). Returns 0, if the index is empty.
+size_t nb_trajectory_find(const nb_trajectory *const trajectory,
+    nb_float time)
+{
+    const nb_trajectory_entry *const index = trajectory->index;
+    size_t low = 0, high = trajectory->index_count;
+
+    // the first frame, which is not earlier than "time"
+    while (low < high)
+    {
+        const size_t middle = low + (high - low) / 2;
+
+        if (index[middle].time < time)
+            low = middle + 1;
+        else
+            high = middle;
+    }
+
+    if (low == trajectory->index_count)
+        return (low != 0) ? low - 1 : 0;
+
+    if (low != 0 && time - index[low - 1].time <= index[low].time - time)
+        return low - 1;
+
+    return low;
+}
+
+// Read the frame of the loaded index to the system. The frames are decoded
+// from the key frame of the frame, unless the frames of the chunk before
+// the frame have been decoded. Returns false and sets "errno", if there is
+// no such frame or reading failed.
+bool nb_trajectory_read_frame(nb_trajectory *const trajectory,
+    size_t frame, nb_system *const system)
+{
+    size_t key;
+
+    if (frame >= trajectory->index_count)
+    {
+        errno = EINVAL;
+        return false;
+    }
+
+    key = trajectory->index[frame].key;
+    if (trajectory->frames < key || trajectory->frames > frame)
+    {
+        if (fseek(trajectory->file, (long)trajectory->index[key].offset,
+            SEEK_SET) != 0)
+        {
+            return false;
+        }
+
+        trajectory->frames = key;
+        trajectory->order = 0;
+        trajectory->is_end = false;
+    }
+
+    while (trajectory->frames <= frame)
+    {
+        if (!nb_trajectory_read(trajectory, system))
+        {
+            // the position of file is lost
+            if (trajectory->is_end)
+                errno = EINVAL;
+            trajectory->frames = SIZE_MAX;
+            return false;
+        }
+    }
+
+    return true;
+}
+
+// Keep the bodies of the list of indices and ranges of indices (e.g.
+// "0,5-9") in the system in order of the list. Indices go up. Returns
+// false and sets "errno" to EINVAL, if the list is wrong, the system is
+// kept then.
+bool nb_trajectory_select(nb_system *const system,
+    const char *const bodies)
+{
+    size_t count = 0;
+
+    // the list is checked by the first pass, the bodies are moved by the
+    // second one
+    for (size_t pass = 0; pass < 2; pass++)
+    {
+        const char* list = bodies;
+        size_t next = 0;
+
+        count = 0;
+        while (true)
+        {
+            size_t first, last;
+
+            list = _nb_trajectory_parse_range(list, &first, &last);
+            if (list == NULL || first < next || last >= system->count)
+            {
+                errno = EINVAL;
+                return false;
+            }
+
+            for (size_t i = first; pass == 1 && i <= last; i++)
+            {
+                nb_body body;
+
+                if (i != count + i - first)
+                {
+                    nb_system_get_body(system, i, &body);
+                    nb_system_set_body(system, count + i - first, &body);
+                }
+            }
+
+            count += last - first + 1;
+            next = last + 1;
+
+            if (*list == '\0')
+                break;
+
+            if (*list++ != ',')
+            {
+                errno = EINVAL;
+                return false;
+            }
+        }
+    }
+
+    system->count = count;
+    return true;
+}
+
+// Free the memory of coder, the file is left to the caller
+void nb_trajectory_destroy(nb_trajectory *const trajectory)
+{
+    free(trajectory->history);
+    free(trajectory->names);
+    free(trajectory->buffer);
+    free(trajectory->index);
+    trajectory->history = NULL;
+    trajectory->names = NULL;
+    trajectory->buffer = NULL;
+    trajectory->index = NULL;
+    trajectory->capacity = 0;
+    trajectory->names_size = 0;
+    trajectory->buffer_size = 0;
+    trajectory->index_count = 0;
+    trajectory->index_capacity = 0;
+}
+
+// Pointers to the columns of system in order of frames
+void _nb_trajectory_columns(const nb_system *const system,
+    nb_float* columns[NB_TRAJECTORY_COLUMNS])
+{
+    columns[0] = system->cx;
+    columns[1] = system->cy;
+    columns[2] = system->sx;
+    columns[3] = system->sy;
+    columns[4] = system->mass;
+    columns[5] = system->radius;
+}
+
+// Column "k" of the frame "frame" (0 or 1) of history
+nb_float* _nb_trajectory_history(const nb_trajectory *const trajectory,
+    size_t frame, size_t k)
+{
+    return trajectory->history +
+        (frame * NB_TRAJECTORY_COLUMNS + k) * trajectory->capacity;
+}
+
+// Allocate history for "count" bodies. It is done by key frames, so the
+// old frames are not kept.
+bool _nb_trajectory_reserve(nb_trajectory *const trajectory, size_t count)
+{
+    nb_float* history;
+
+    if (count <= trajectory->capacity && trajectory->history != NULL)
+        return true;
+
+    history = (nb_float*)calloc(2 * NB_TRAJECTORY_COLUMNS * (count + 1),
+        sizeof(nb_float));
+    if (history == NULL)
+        return false;
+
+    free(trajectory->history);
+    trajectory->history = history;
+    trajectory->capacity = count + 1;
+
+    return true;
+}
+
+// Grow the buffer of coded frame to "size" bytes. Words are read and
+// written by 8 bytes, so the buffer has 8 more bytes.
+bool _nb_trajectory_buffer(nb_trajectory *const trajectory, size_t size)
+{
+    unsigned char* buffer;
+
+    if (size + sizeof(uint64_t) <= trajectory->buffer_size)
+        return true;
+
+    buffer = (unsigned char*)malloc(size + sizeof(uint64_t));
+    if (buffer == NULL)
+        return false;
+
+    free(trajectory->buffer);
+    trajectory->buffer = buffer;
+    trajectory->buffer_size = size + sizeof(uint64_t);
+
+    return true;
+}
+
+// The largest size of coded frame of "count" bodies with names of
+// "names_size" bytes
+size_t _nb_trajectory_max_size(size_t count, size_t names_size)
+{
+    const size_t words = count * NB_TRAJECTORY_WORDS;
+
+    return sizeof(uint64_t) + names_size + NB_TRAJECTORY_COLUMNS *
+        (1 + words * sizeof(uint64_t) + (words + 1) / 2);
+}
+
+// Add the entry of frame at "offset" to the index. Frames, which are not
+// key ones, are decoded from the key frame of the previous frame. Returns
+// false and sets "errno" to EINVAL, if the first frame is not a key one.
+bool _nb_trajectory_add_entry(nb_trajectory *const trajectory,
+    nb_float time, size_t step, size_t offset, bool is_key)
+{
+    nb_trajectory_entry* entry;
+
+    if (!is_key && trajectory->index_count == 0)
+    {
+        errno = EINVAL;
+        return false;
+    }
+
+    if (trajectory->index_count == trajectory->index_capacity)
+    {
+        const size_t capacity = (trajectory->index_capacity != 0) ?
+            2 * trajectory->index_capacity : 64;
+        nb_trajectory_entry* index = (nb_trajectory_entry*)realloc(
+            trajectory->index, capacity * sizeof(nb_trajectory_entry));
+
+        if (index == NULL)
+            return false;
+
+        trajectory->index = index;
+        trajectory->index_capacity = capacity;
+    }
+
+    entry = &trajectory->index[trajectory->index_count];
+    entry->time = time;
+    entry->step = step;
+    entry->offset = offset;
+    entry->key = is_key ? trajectory->index_count : entry[-1].key;
+    trajectory->index_count++;
+
+    return true;
+}
+
+// Read the index, which the trailer points to. Returns false, if there is
+// no trailer or the index is damaged.
+bool _nb_trajectory_read_index(nb_trajectory *const trajectory)
+{
+    FILE *const file = trajectory->file;
+    _nb_trajectory_trailer trailer;
+    _nb_trajectory_frame header;
+    uint64_t previous = 0;
+
+    if (fseek(file, -(long)sizeof(trailer), SEEK_END) != 0 ||
+        fread(&trailer, sizeof(trailer), 1, file) != 1 ||
+        memcmp(trailer.magic, _index_magic, sizeof(_index_magic)) != 0 ||
+        trailer.offset < (uint64_t)trajectory->start ||
+        trailer.offset > (uint64_t)LONG_MAX ||
+        fseek(file, (long)trailer.offset, SEEK_SET) != 0 ||
+        fread(&header, sizeof(header), 1, file) != 1 ||
+        header.order != NB_TRAJECTORY_INDEX_ORDER ||
+        header.size != header.count * sizeof(_nb_trajectory_index_entry))
+    {
+        return false;
+    }
+
+    // frames go one by one before the index
+    for (uint64_t i = 0; i < header.count; i++)
+    {
+        _nb_trajectory_index_entry record;
+        nb_float time;
+
+        if (fread(&record, sizeof(record), 1, file) != 1 ||
+            record.offset < (uint64_t)trajectory->start ||
+            record.offset >= trailer.offset ||
+            (i != 0 && record.offset <= previous))
+        {
+            return false;
+        }
+
+        memcpy(&time, record.time, sizeof(nb_float));
+        if (!_nb_trajectory_add_entry(trajectory, time,
+            (size_t)record.step, (size_t)record.offset, record.order == 0))
+        {
+            return false;
+        }
+
+        previous = record.offset;
+    }
+
+    return true;
+}
+
+// Build the index by the headers of frames of the file, which has not been
+// finished. The last frame, which is not complete, is left out.
+bool _nb_trajectory_scan_frames(nb_trajectory *const trajectory)
+{
+    FILE *const file = trajectory->file;
+    _nb_trajectory_frame frame;
+    long offset = trajectory->start, size;
+
+    if (fseek(file, 0, SEEK_END) != 0 || (size = ftell(file)) < 0 ||
+        fseek(file, offset, SEEK_SET) != 0)
+    {
+        return false;
+    }
+
+    while (fread(&frame, sizeof(frame), 1, file) == 1 &&
+        frame.order <= 2 && frame.size <= (uint64_t)(size - offset) -
+        sizeof(frame))
+    {
+        nb_float time;
+
+        memcpy(&time, frame.time, sizeof(nb_float));
+        if (!_nb_trajectory_add_entry(trajectory, time, (size_t)frame.step,
+            (size_t)offset, frame.order == 0))
+        {
+            return false;
+        }
+
+        offset += (long)(sizeof(frame) + frame.size);
+        if (fseek(file, offset, SEEK_SET) != 0)
+            return false;
+    }
+
+    return true;
+}
+
+// Build the index of sequence of systems by reading them. The last system,
+// which can not be read, is left out.
+bool _nb_trajectory_scan_systems(nb_trajectory *const trajectory)
+{
+    FILE *const file = trajectory->file;
+    nb_system system;
+    bool is_done = true;
+
+    errno = 0;
+    nb_system_init_default(&system);
+    if (errno == ENOMEM)
+        return false;
+
+    if (fseek(file, trajectory->start, SEEK_SET) != 0)
+        is_done = false;
+
+    while (is_done)
+    {
+        const long offset = ftell(file);
+        int c = fgetc(file);
+
+        if (c == EOF)
+            break;
+
+        ungetc(c, file);
+        errno = 0;
+        if (offset < 0 || !nb_system_read(&system, file))
+        {
+            is_done = errno != ENOMEM;
+            break;
+        }
+
+        is_done = _nb_trajectory_add_entry(trajectory, system.time,
+            trajectory->index_count, (size_t)offset, true);
+    }
+
+    nb_system_destroy(&system);
+    return is_done;
+}
+
+// Parse the index or the range of indices "first-last" at the start of
+// list. Returns the end of range or NULL, if there is no range.
+const char* _nb_trajectory_parse_range(const char* list,
+    size_t *const first, size_t *const last)
+{
+    char* end;
+
+    if (!isdigit((unsigned char)*list))
+        return NULL;
+
+    errno = 0;
+    *first = (size_t)strtoull(list, &end, 10);
+    *last = *first;
+
+    if (*end == '-')
+    {
+        list = end + 1;
+        if (!isdigit((unsigned char)*list))
+            return NULL;
+
+        *last = (size_t)strtoull(list, &end, 10);
+    }
+
+    return (errno == 0 && *first <= *last) ? end : NULL;
+}
+
+// Does the system start a key frame: the chunk starts or the count or
+// names of bodies differ from the last key frame?
+bool _nb_trajectory_is_key(const nb_trajectory *const trajectory,
+    const nb_system *const system)
+{
+    const char* name = trajectory->names;
+
+    if (trajectory->frames % trajectory->chunk == 0 ||
+        system->count != trajectory->count)
+    {
+        return true;
+    }
+
+    // the names of key frame are as many as bodies, each one is terminated
+    for (size_t i = 0; i < system->count; i++)
+    {
+        const char* other = system->names[i];
+
+        while (*name != '\0' && *name == *other)
+        {
+            name++;
+            other++;
+        }
+
+        if (*name != *other)
+            return true;
+
+        name++;
+    }
+
+    return false;
+}
+
+// Keep the names of system one by one for the key frame
+bool _nb_trajectory_store_names(nb_trajectory *const trajectory,
+    const nb_system *const system)
+{
+    size_t size = 0;
+    char* names;
+
+    for (size_t i = 0; i < system->count; i++)
+        size += strlen(system->names[i]) + 1;
+
+    names = (char*)realloc(trajectory->names, size + 1);
+    if (names == NULL)
+        return false;
+
+    trajectory->names = names;
+    trajectory->names_size = size;
+
+    for (size_t i = 0; i < system->count; i++)
+    {
+        const size_t length = strlen(system->names[i]) + 1;
+
+        memcpy(names, system->names[i], length);
+        names += length;
+    }
+
+    return true;
+}
+
+// Can the column and the frames, which predict it, be quantized by "step"
+// without overflow?
+bool _nb_trajectory_is_quantizable(const nb_float *const x,
+    const nb_float *const p1, const nb_float *const p2, size_t count,
+    size_t order, nb_float step)
+{
+    const nb_float limit = NB_TRAJECTORY_QUANT_MAX * step;
+    const nb_float *const columns[3] = {x, p1, p2};
+    int is_out = !(step > 0.0);
+
+    // infinities and NaN are out of limit too
+    for (size_t k = 0; k <= order && k < 3; k++)
+    {
+        const nb_float *const column = columns[k];
+
+        for (size_t i = 0; i < count; i++)
+            is_out |= !(fabs(column[i]) < limit);
+    }
+
+    return !is_out;
+}
+
+// Code the column "x" by the frames "p1" (the last) and "p2" (the older)
+// to "out", the decoded column replaces "p2". If "step" is zero, then the
+// bits of numbers are XOR-ed with the bits of predicted numbers, otherwise
+// the numbers are quantized by "step" and the differences of quantized
+// numbers and predicted ones are coded. Numbers are predicted by blocks,
+// so the loops of prediction and packing are simple. Returns the end of
+// coded column.
+unsigned char* _nb_trajectory_encode(const nb_float *const x,
+    const nb_float *const p1, nb_float *const p2, size_t count,
+    size_t order, nb_float step, unsigned char* out)
+{
+    uint64_t words[NB_TRAJECTORY_BLOCK * NB_TRAJECTORY_WORDS + 1];
+    nb_float predicted[NB_TRAJECTORY_BLOCK];
+    const nb_float inverse = (step > 0.0) ? 1.0 / step : 0.0;
+
+    for (size_t start = 0; start < count; start += NB_TRAJECTORY_BLOCK)
+    {
+        const size_t size = (count - start < NB_TRAJECTORY_BLOCK) ?
+            count - start : NB_TRAJECTORY_BLOCK;
+        const nb_float *const block = x + start;
+        nb_float *const decoded = p2 + start;
+
+        _nb_trajectory_predict(order, p1 + start, p2 + start, size,
+            predicted);
+
+        if (step > 0.0)
+        {
+            for (size_t i = 0; i < size; i++)
+            {
+                const int64_t q = _nb_trajectory_round(block[i] * inverse);
+                const int64_t r = q -
+                    _nb_trajectory_round(predicted[i] * inverse);
+
+                // small differences of both signs get small words
+                words[i] = (r < 0) ? ~((uint64_t)r << 1) : (uint64_t)r << 1;
+                decoded[i] = (nb_float)q * step;
+            }
+        }
+        else
+        {
+            for (size_t i = 0; i < size; i++)
+            {
+                uint64_t bits[NB_TRAJECTORY_WORDS] = {0};
+                uint64_t predicted_bits[NB_TRAJECTORY_WORDS] = {0};
+
+                memcpy(bits, &block[i], sizeof(nb_float));
+                memcpy(predicted_bits, &predicted[i], sizeof(nb_float));
+
+                for (size_t w = 0; w < NB_TRAJECTORY_WORDS; w++)
+                {
+                    words[i * NB_TRAJECTORY_WORDS + w] =
+                        bits[w] ^ predicted_bits[w];
+                }
+            }
+
+            memcpy(decoded, block, sizeof(nb_float) * size);
+        }
+
+        // words are packed by pairs
+        words[size * NB_TRAJECTORY_WORDS] = 0;
+        out = _nb_trajectory_pack(words, size * NB_TRAJECTORY_WORDS, out);
+    }
+
+    return out;
+}
+
+// Decode the column coded by "_nb_trajectory_encode" to "x" and "p2".
+// Returns the end of coded column or NULL, if the coded frame is damaged.
+const unsigned char* _nb_trajectory_decode(const unsigned char* in,
+    const unsigned char *const end, nb_float *const x,
+    const nb_float *const p1, nb_float *const p2, size_t count,
+    size_t order, nb_float step)
+{
+    uint64_t words[NB_TRAJECTORY_BLOCK * NB_TRAJECTORY_WORDS + 1];
+    nb_float predicted[NB_TRAJECTORY_BLOCK];
+    const nb_float inverse = (step > 0.0) ? 1.0 / step : 0.0;
+
+    for (size_t start = 0; start < count; start += NB_TRAJECTORY_BLOCK)
+    {
+        const size_t size = (count - start < NB_TRAJECTORY_BLOCK) ?
+            count - start : NB_TRAJECTORY_BLOCK;
+        nb_float *const block = x + start;
+
+        in = _nb_trajectory_unpack(in, end, words,
+            size * NB_TRAJECTORY_WORDS);
+        if (in == NULL)
+            return NULL;
+
+        _nb_trajectory_predict(order, p1 + start, p2 + start, size,
+            predicted);
+
+        if (step > 0.0)
+        {
+            for (size_t i = 0; i < size; i++)
+            {
+                const int64_t r = (words[i] & 1) ?
+                    (int64_t)~(words[i] >> 1) : (int64_t)(words[i] >> 1);
+                const int64_t q = r +
+                    _nb_trajectory_round(predicted[i] * inverse);
+
+                block[i] = (nb_float)q * step;
+            }
+        }
+        else
+        {
+            for (size_t i = 0; i < size; i++)
+            {
+                uint64_t bits[NB_TRAJECTORY_WORDS] = {0};
+
+                memcpy(bits, &predicted[i], sizeof(nb_float));
+                for (size_t w = 0; w < NB_TRAJECTORY_WORDS; w++)
+                    bits[w] ^= words[i * NB_TRAJECTORY_WORDS + w];
+
+                memcpy(&block[i], bits, sizeof(nb_float));
+            }
+        }
+
+        memcpy(p2 + start, block, sizeof(nb_float) * size);
+    }
+
+    return in;
+}
+
+// Numbers predicted by the last frames: the last numbers or the linear
+// extrapolation of two last numbers. Key frames are predicted by zeros.
+void _nb_trajectory_predict(size_t order, const nb_float *const p1,
+    const nb_float *const p2, size_t count, nb_float *const predicted)
+{
+    if (order == 0)
+    {
+        for (size_t i = 0; i < count; i++)
+            predicted[i] = 0.0;
+    }
+    else if (order == 1)
+    {
+        for (size_t i = 0; i < count; i++)
+            predicted[i] = p1[i];
+    }
+    else
+    {
+        for (size_t i = 0; i < count; i++)
+            predicted[i] = 2.0 * p1[i] - p2[i];
+    }
+}
+
+// Nearest integer of number. Halves are rounded away from zero, numbers
+// next to halves may be rounded to the other side, the error stays within
+// the step of quantization.
+int64_t _nb_trajectory_round(nb_float value)
+{
+    return (int64_t)(value + copysign(0.5, value));
+}
+
+// Pack "count" words by pairs: the byte of counts of significant bytes of
+// both words and their significant bytes. The word after the last one is
+// zero, it completes the last pair of odd count.
+unsigned char* _nb_trajectory_pack(const uint64_t *const words,
+    size_t count, unsigned char* out)
+{
+    for (size_t w = 0; w < count; w += 2)
+    {
+        const uint64_t first = words[w], second = words[w + 1];
+        const size_t first_bytes = (first == 0) ? 0 :
+            (71 - __builtin_clzll(first)) / 8;
+        const size_t second_bytes = (second == 0) ? 0 :
+            (71 - __builtin_clzll(second)) / 8;
+
+        *out++ = (unsigned char)(first_bytes | second_bytes << 4);
+
+#if __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+        // the buffer has room for whole words after any packed word
+        memcpy(out, &first, sizeof(uint64_t));
+        memcpy(out + first_bytes, &second, sizeof(uint64_t));
+#else
+        for (size_t b = 0; b < first_bytes; b++)
+            out[b] = (unsigned char)(first >> (8 * b));
+        for (size_t b = 0; b < second_bytes; b++)
+            out[first_bytes + b] = (unsigned char)(second >> (8 * b));
+#endif
+
+        out += first_bytes + second_bytes;
+    }
+
+    return out;
+}
+
+// Unpack "count" words, there is room for one more word of the last pair
+// of odd count. Returns the end of packed words or NULL, if they go beyond
+// "end".
+const unsigned char* _nb_trajectory_unpack(const unsigned char* in,
+    const unsigned char *const end, uint64_t *const words, size_t count)
+{
+    static const uint64_t masks[9] = {
+        0x0, 0xff, 0xffff, 0xffffff, 0xffffffff, 0xffffffffff,
+        0xffffffffffff, 0xffffffffffffff, 0xffffffffffffffff
+    };
+
+    for (size_t w = 0; w < count; w += 2)
+    {
+        size_t first_bytes, second_bytes;
+
+        if (in >= end)
+            return NULL;
+
+        first_bytes = *in & 0x0f;
+        second_bytes = *in >> 4;
+        in++;
+
+        if (first_bytes > 8 || second_bytes > 8 ||
+            (size_t)(end - in) < first_bytes + second_bytes)
+        {
+            return NULL;
+        }
+
+#if __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+        // the buffer has 8 more bytes after the coded frame
+        memcpy(&words[w], in, sizeof(uint64_t));
+        memcpy(&words[w + 1], in + first_bytes, sizeof(uint64_t));
+        words[w] &= masks[first_bytes];
+        words[w + 1] &= masks[second_bytes];
+#else
+        words[w] = 0;
+        words[w + 1] = 0;
+        for (size_t b = 0; b < first_bytes; b++)
+            words[w] |= (uint64_t)in[b] << (8 * b);
+        for (size_t b = 0; b < second_bytes; b++)
+            words[w + 1] |= (uint64_t)in[first_bytes + b] << (8 * b);
+#endif
+
+        in += first_bytes + second_bytes;
+    }
+
+    return in;
+}